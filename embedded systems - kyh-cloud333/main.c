@@ -19,33 +19,1102 @@
 #include "inc/hw_trng.h" // we need TRNG direct register access
 #include "driverlib/trng.h" // random number generator
 #include "driverlib/aon_batmon.h" // battery and temperature monitor
+#include "driverlib/udma.h" // micro direct memory access, lets the UART pull whole buffers out of memory without the CPU
+#include "inc/hw_uart.h" // UART register offsets, the uDMA needs the address of the data register (UART_O_DR)
+#include "inc/hw_gpt.h" // timer register offsets, the match interrupt enable bit (TAMIE) has no driverlib function
+#include "inc/hw_ints.h" // interrupt numbers (INT_GPT0A)
+#include "driverlib/interrupt.h" // NVIC access, so we can pend the timer interrupt ourselves
+#include "inc/hw_cpu_dwt.h" // data watchpoint and trace unit, its free running cycle counter (CYCCNT) is how we measure the cost of our ISRs
+#include "inc/hw_cpu_scs.h" // system control space, the trace block has to be switched on here (DEMCR) before the DWT will count
+#include <string.h> // memcpy, the transmit ring buffer takes whole spans
 
 #define ONE_MS_32BIT_DIVIDER 48000000/(1000*16) // is 1 millisecond in our CPUT clock speed for the 32-bit timer configuration
 
 
 // set up globals:
 uint32_t random = 0;
-char random_str[11]; // 10 characters for maximum number of digits (4294967296 max value for uint32_t), and need 1 character for null terminator '\0'
 
-short currently_running = 0;
 short echo_enabled = 0;
-short blinker_period = 0;
-short stopper = 0;
-char mode = ' ';
 
 short first_startup = 1;
 
 int32_t temperature; //32 bit integer signed, and our temperature values are bit 16 to 8 (INT) in Figure 18-12 (page 1450)
 static uint32_t voltage; // static 32 bit integer signed, and our voltage values are bit 10 to 8 (INT) and bit 7 to 0 (FRAC) -- Figure 18-10 (page 1448)
 
+// critical sections: mask every interrupt while main() touches something an ISR touches too
+// IntMasterDisable returns whether interrupts were already masked, so a critical section inside another one (or inside an ISR) doesn't unmask them early
+static inline bool critical_enter(){
+    return IntMasterDisable();
+}
+
+static inline void critical_exit(bool was_masked){
+    if (!was_masked){
+        IntMasterEnable();
+    }
+}
+
+// UART transmit ring buffer: producers only copy bytes in here and return, the UART TX interrupt moves them into the hardware FIFO
+// UARTCharPut spins until there is room in the FIFO, at 9600 baud that's about 1ms per character, which is forever inside an ISR
+#define UART_TX_BUFFER_SIZE 512 // must be a power of 2 (we mask the indices), and big enough to hold the whole menu
+uint8_t uart_tx_buffer[UART_TX_BUFFER_SIZE];
+volatile uint16_t uart_tx_head = 0; // next free slot, only moved by producers
+volatile uint16_t uart_tx_tail = 0; // next byte to send, only moved by the TX interrupt
+// the indices are free running and only masked when used, so head - tail is always the number of queued bytes (even after they wrap)
+
+uint32_t uart_tx_dropped = 0; // bytes thrown away because the ring buffer was full
+uint32_t uart_tx_deferred = 0; // bytes that didn't fit in the hardware FIFO right away and had to wait in the ring buffer
+
+// uDMA transmit: big constant buffers (like the menu) are handed to the uDMA, which feeds the TX FIFO by itself while the CPU sleeps
+// the buffer has to stay valid until it's sent, so only use this for static/const data
+#define UDMA_MAX_TRANSFER 1024 // the uDMA can move at most 1024 items per transfer, longer buffers are sent in pieces
+#define UART_TX_DMA_QUEUE_SIZE 8 // must be a power of 2
+
+// the control table tells the uDMA what to move for every channel (primary + alternate structure), it must be aligned to 1024 bytes
+#pragma DATA_ALIGN(udma_control_table, 1024)
+tDMAControlTable udma_control_table[64];
+
+typedef struct {
+    const char *data; // what's left to send
+    uint32_t length;
+    uint16_t ring_mark; // uart_tx_head when this was queued, everything in the ring buffer before the mark has to go out first to keep the order
+} uart_tx_dma_segment_t;
+
+uart_tx_dma_segment_t uart_tx_dma_queue[UART_TX_DMA_QUEUE_SIZE];
+volatile uint8_t uart_tx_dma_head = 0; // same free running index idea as the ring buffer
+volatile uint8_t uart_tx_dma_tail = 0;
+volatile bool uart_tx_dma_active = false; // while true the uDMA owns the TX FIFO and the CPU must not put anything in it
+
+uint32_t uart_tx_dma_bytes = 0; // bytes the uDMA sent for us instead of the CPU
+
+// start (or continue) sending the oldest queued buffer with the uDMA
+void uart_tx_dma_start(){
+    uart_tx_dma_segment_t *segment = &uart_tx_dma_queue[uart_tx_dma_tail & (UART_TX_DMA_QUEUE_SIZE - 1)];
+    uint32_t chunk = segment->length;
+    if (chunk > UDMA_MAX_TRANSFER){
+        chunk = UDMA_MAX_TRANSFER;
+    }
+
+    // basic mode: move "chunk" bytes, source address increments, destination is always the UART data register
+    uDMAChannelTransferSet(UDMA0_BASE, UDMA_CHAN_UART0_TX | UDMA_PRI_SELECT, UDMA_MODE_BASIC, (void *) (segment->data), (void *) (UART0_BASE + UART_O_DR), chunk);
+    segment->data += chunk;
+    segment->length -= chunk;
+    uart_tx_dma_bytes += chunk;
+
+    uart_tx_dma_active = true;
+    UARTIntDisable(UART0_BASE, UART_INT_TX); // the uDMA is filling the FIFO now, we don't need to hear about it
+    uDMAChannelEnable(UDMA0_BASE, UDMA_CHAN_UART0_TX);
+    UARTDMAEnable(UART0_BASE, UART_DMA_TX); // let the UART request data from the uDMA, this starts the transfer
+}
+
+// move as much as fits from the ring buffer into the TX FIFO, called by producers to get things started and by the TX interrupt to keep it going
+void uart_tx_refill(){
+    if (uart_tx_dma_active){
+        return; // wait for the uDMA done interrupt, it calls us again
+    }
+
+    // only send ring bytes up to the next uDMA buffer, those go out in the order they were written
+    uint16_t stop = uart_tx_head;
+    bool dma_waiting = (uart_tx_dma_tail != uart_tx_dma_head);
+    if (dma_waiting){
+        stop = uart_tx_dma_queue[uart_tx_dma_tail & (UART_TX_DMA_QUEUE_SIZE - 1)].ring_mark;
+    }
+
+    while (uart_tx_tail != stop && UARTSpaceAvail(UART0_BASE)){
+        UARTCharPutNonBlocking(UART0_BASE, uart_tx_buffer[uart_tx_tail & (UART_TX_BUFFER_SIZE - 1)]);
+        uart_tx_tail++;
+    }
+
+    // everything in front of the uDMA buffer is in the FIFO, hand it over
+    if (dma_waiting && uart_tx_tail == stop){
+        uart_tx_dma_start();
+        return;
+    }
+
+    // the TX interrupt is raised when the FIFO drains below 1/8 (4 characters), we only want it while there is something left to send
+    if (uart_tx_tail != uart_tx_head){
+        UARTIntEnable(UART0_BASE, UART_INT_TX);
+    }
+    else{
+        UARTIntDisable(UART0_BASE, UART_INT_TX);
+    }
+}
+
+// the uDMA done interrupt for the TX channel comes in on the UART interrupt
+void uart_tx_dma_done(){
+    uDMAIntClear(UDMA0_BASE, 1 << UDMA_CHAN_UART0_TX);
+    UARTDMADisable(UART0_BASE, UART_DMA_TX); // stop the UART requesting more, otherwise the done interrupt keeps firing
+    uart_tx_dma_active = false;
+
+    // a buffer longer than one transfer still has pieces left
+    if (uart_tx_dma_queue[uart_tx_dma_tail & (UART_TX_DMA_QUEUE_SIZE - 1)].length > 0){
+        uart_tx_dma_start();
+        return;
+    }
+
+    uart_tx_dma_tail++;
+    uart_tx_refill();
+}
+
+// queue bytes for output, never blocks
+// the UART ISR (echo) and main() both send, so the ring buffer and the FIFO are only touched with interrupts masked, once for the whole write
+void uart_write(const char *data, uint32_t length){
+    bool was_masked = critical_enter();
+
+    // nothing waiting, the first bytes can go straight to the hardware
+    uint32_t sent = 0;
+    if (uart_tx_tail == uart_tx_head && uart_tx_dma_tail == uart_tx_dma_head && !uart_tx_dma_active){
+        while (sent < length && UARTSpaceAvail(UART0_BASE)){
+            UARTCharPutNonBlocking(UART0_BASE, (uint8_t) (data[sent]));
+            sent++;
+        }
+    }
+
+    // the rest goes into the ring buffer, one copy up to its end and one from its start if the span wraps around
+    uint32_t count = length - sent;
+    uint32_t space = UART_TX_BUFFER_SIZE - (uint16_t) (uart_tx_head - uart_tx_tail);
+    if (count > space){
+        uart_tx_dropped += count - space;
+        count = space;
+    }
+    uint32_t offset = uart_tx_head & (UART_TX_BUFFER_SIZE - 1);
+    uint32_t first = UART_TX_BUFFER_SIZE - offset;
+    if (first > count){
+        first = count;
+    }
+    memcpy(&uart_tx_buffer[offset], &data[sent], first);
+    memcpy(uart_tx_buffer, &data[sent + first], count - first);
+    uart_tx_head += count;
+    uart_tx_deferred += count;
+
+    uart_tx_refill();
+    critical_exit(was_masked);
+}
+
+// queue a single character
+void uart_put_char(char c){
+    uart_write(&c, 1);
+}
+
+// how many bytes uart_write() can take right now without dropping any
+uint32_t uart_tx_space(){
+    return UART_TX_BUFFER_SIZE - (uint16_t) (uart_tx_head - uart_tx_tail);
+}
+
+// true once the ring buffer and the uDMA queue are empty, the FIFO can still hold up to 32 characters
+bool uart_tx_flushed(){
+    return uart_tx_tail == uart_tx_head && uart_tx_dma_tail == uart_tx_dma_head && !uart_tx_dma_active;
+}
+
+// true once everything queued went out, the last bit included (the UART stays busy until its shift register is empty)
+bool uart_tx_idle(){
+    return uart_tx_flushed() && !UARTBusy(UART0_BASE);
+}
+
+// queue a constant buffer to be sent by the uDMA without copying it, never blocks
+void uart_write_dma(const char *data, uint32_t length){
+    bool was_masked = critical_enter();
+
+    // all uDMA slots are taken, fall back to copying it into the ring buffer
+    if ((uint8_t) (uart_tx_dma_head - uart_tx_dma_tail) >= UART_TX_DMA_QUEUE_SIZE){
+        uart_write(data, length);
+        critical_exit(was_masked);
+        return;
+    }
+
+    uart_tx_dma_segment_t *segment = &uart_tx_dma_queue[uart_tx_dma_head & (UART_TX_DMA_QUEUE_SIZE - 1)];
+    segment->data = data;
+    segment->length = length;
+    segment->ring_mark = uart_tx_head;
+    uart_tx_dma_head++;
+
+    uart_tx_refill();
+    critical_exit(was_masked);
+}
+
+// uDMA receive: the uDMA moves received characters from the RX FIFO into a ping-pong buffer, the CPU only wakes up
+// when one half is full or when the line goes quiet (receive timeout), instead of an interrupt plus 4 UARTCharGetNonBlocking calls every 4 bytes
+// the uDMA only answers "burst" requests (FIFO at its 1/8 = 4 character threshold) and takes 2 characters per burst, so it stops with 2 or 3 still in the FIFO
+// and those trigger the timeout: if it took all 4, a line with a length that's a multiple of 4 ("echo on\r") would leave the FIFO empty, RT would never fire
+// (it needs characters sitting in the FIFO) and the line would wait for the next keypress
+#define UART_RX_DMA_HALF 32 // bytes per half, must be a multiple of the 2 byte burst
+uint8_t uart_rx_dma_buffer[2][UART_RX_DMA_HALF];
+uint8_t uart_rx_dma_half = 0; // which half the uDMA is filling right now, 0 = primary control structure, 1 = alternate
+uint16_t uart_rx_dma_consumed = 0; // bytes of the current half we already handed to uart_rx_char()
+
+uint32_t uart_rx_dma_bytes = 0; // bytes the uDMA received for us
+uint32_t uart_rx_bytes = 0; // every byte we received, the uDMA's and the few left in the FIFO
+uint32_t uart_rx_overruns = 0; // times the RX FIFO was full and a character was lost
+uint32_t uart_rx_framing_errors = 0; // a character without its stop bit, usually the wrong baud rate on the other end
+uint32_t uart_rx_parity_errors = 0; // can't happen without parity, counted anyway in case somebody turns it on
+uint32_t uart_rx_breaks = 0; // the line was held low for longer than a whole character
+
+// point one half of the ping-pong back at its buffer, the uDMA switches to it when the other half is full
+void uart_rx_dma_arm(uint8_t half){
+    uint32_t structure = (half == 0) ? UDMA_PRI_SELECT : UDMA_ALT_SELECT;
+    uDMAChannelTransferSet(UDMA0_BASE, UDMA_CHAN_UART0_RX | structure, UDMA_MODE_PINGPONG, (void *) (UART0_BASE + UART_O_DR), uart_rx_dma_buffer[half], UART_RX_DMA_HALF);
+}
+
+// cycle profiler: every ISR and every command records how many CPU cycles it took, so we have a baseline before changing anything
+// the DWT cycle counter runs at the CPU clock (48 MHz) and stops while the CPU is asleep in PRCMSleep, so these numbers are "CPU awake" cycles
+typedef struct {
+    uint32_t calls; // how many times it ran
+    uint64_t total_cycles; // sum of all runs, 64 bits so it doesn't wrap after ~90 seconds of awake time
+    uint32_t max_cycles; // the single worst run
+} cycle_stats_t;
+
+cycle_stats_t uart_isr_stats;
+cycle_stats_t timer_isr_stats;
+
+// stack usage: at boot the unused stack is filled with a known pattern, whatever got overwritten since then has been used at some point
+#define STACK_PAINT 0xDEADBEEF
+extern uint32_t __stack; // bottom of the stack, from the linker (the stack grows down towards it)
+extern uint32_t __STACK_END; // top of the stack
+
+// fill the stack below us with the pattern
+void stack_paint(){
+    uint32_t *word = &__stack;
+    uintptr_t limit = (uintptr_t) &word - 64; // our own local variable is about where the stack pointer is, leave some room below it
+
+    while ((uintptr_t) word < limit){
+        *word = STACK_PAINT;
+        word++;
+    }
+}
+
+// the most stack we ever used, in bytes
+uint32_t stack_used(){
+    uint32_t *word = &__stack;
+
+    while (word < &__STACK_END && *word == STACK_PAINT){
+        word++;
+    }
+    return (uint32_t) (&__STACK_END - word) * sizeof(uint32_t);
+}
+
+// turn on the DWT cycle counter (Cortex-M3 technical reference, DWT_CTRL and DEMCR)
+void setup_Profiler(){
+    stack_paint();
+
+    HWREG(CPU_SCS_BASE + CPU_SCS_O_DEMCR) |= CPU_SCS_DEMCR_TRCENA; // the trace block must be enabled first or the DWT registers are ignored
+    HWREG(CPU_DWT_BASE + CPU_DWT_O_CYCCNT) = 0;
+    HWREG(CPU_DWT_BASE + CPU_DWT_O_CTRL) |= CPU_DWT_CTRL_CYCCNTENA; // start counting
+}
+
+// read the current cycle count, the subtraction in cycle_stats_add() is unsigned so a wrap in between is still measured correctly
+static inline uint32_t cycles_now(){
+    return HWREG(CPU_DWT_BASE + CPU_DWT_O_CYCCNT);
+}
+
+// add one run that started at cycle count "start" and ends right now
+void cycle_stats_add(cycle_stats_t *stats, uint32_t start){
+    uint32_t spent = cycles_now() - start;
+
+    stats->calls++;
+    stats->total_cycles += spent;
+    if (spent > stats->max_cycles){
+        stats->max_cycles = spent;
+    }
+}
+
+// number formatting: every function writes the text into "out" (no null terminator) and returns how many characters it wrote
+// the Cortex-M3 divide takes up to 12 cycles, and printing a number the usual way needs two of them (/ and %) for every digit
+// instead we divide by 100 with one multiply (UMULL, 1 cycle on the M3) and look up two digits at a time in a table
+#define FORMAT_U32_MAX 10 // 4294967295
+#define FORMAT_I32_MAX 11 // -2147483648
+
+// "00" to "99"
+static const char format_digit_pairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char format_hex_digits[16] = "0123456789ABCDEF";
+
+// value / 100 for any uint32_t: multiply by 2^37/100 (rounded up) and shift the 64 bit product back down, the error is too small to ever reach the next integer
+static inline uint32_t divide_by_100(uint32_t value){
+    return (uint32_t) (((uint64_t) value * 0x51EB851F) >> 37);
+}
+
+// unsigned decimal, 0 prints as "0"
+int format_u32(char *out, uint32_t value){
+    char digits[FORMAT_U32_MAX];
+    int start = FORMAT_U32_MAX;
+
+    // fill from the back, two digits per step
+    while (value >= 100){
+        uint32_t quotient = divide_by_100(value);
+        uint32_t pair = value - quotient*100;
+        start -= 2;
+        digits[start] = format_digit_pairs[2*pair];
+        digits[start + 1] = format_digit_pairs[2*pair + 1];
+        value = quotient;
+    }
+    if (value >= 10){
+        start -= 2;
+        digits[start] = format_digit_pairs[2*value];
+        digits[start + 1] = format_digit_pairs[2*value + 1];
+    }
+    else{
+        start--;
+        digits[start] = '0' + value;
+    }
+
+    int length = FORMAT_U32_MAX - start;
+    for (int i = 0; i < length; i++){
+        out[i] = digits[start + i];
+    }
+    return length;
+}
+
+// signed decimal, works for INT32_MIN too (its magnitude doesn't fit in an int32_t, so it's taken as unsigned)
+int format_i32(char *out, int32_t value){
+    if (value < 0){
+        out[0] = '-';
+        return 1 + format_u32(out + 1, 0u - (uint32_t) value);
+    }
+    return format_u32(out, (uint32_t) value);
+}
+
+// hexadecimal with exactly "digits" digits (1 to 8), leading zeros included
+int format_hex(char *out, uint32_t value, int digits){
+    for (int i = digits - 1; i >= 0; i--){
+        out[i] = format_hex_digits[value & 0xF];
+        value >>= 4;
+    }
+    return digits;
+}
+
+// fixed point (the BATMON registers are Q numbers: the low frac_bits bits are the fraction) to decimal, rounded to "decimals" places (0 to 4)
+// 3.28V from the battery monitor is 0x348 in Q8, format_fixed(out, 0x348, 8, 2) gives "3.28"
+int format_fixed(char *out, int32_t value, int frac_bits, int decimals){
+    static const uint32_t scales[5] = {1, 10, 100, 1000, 10000};
+    uint32_t magnitude = (value < 0) ? 0u - (uint32_t) value : (uint32_t) value;
+    uint32_t whole = magnitude >> frac_bits;
+    uint32_t fraction = magnitude & ((1u << frac_bits) - 1);
+
+    // fraction * 10^decimals / 2^frac_bits, rounded to nearest, in 64 bits so nothing overflows
+    uint32_t scale = scales[decimals];
+    uint32_t rounded = (uint32_t) (((uint64_t) fraction * scale + ((1u << frac_bits) >> 1)) >> frac_bits);
+    if (rounded >= scale){
+        whole++; // 2.999 rounds up to 3.00
+        rounded -= scale;
+    }
+
+    int length = 0;
+    if (value < 0 && (whole != 0 || rounded != 0)){
+        out[length++] = '-'; // but no "-0.00"
+    }
+    length += format_u32(&out[length], whole);
+
+    if (decimals > 0){
+        char digits[FORMAT_U32_MAX];
+        int count = format_u32(digits, rounded);
+
+        out[length++] = '.';
+        for (int i = count; i < decimals; i++){
+            out[length++] = '0'; // 3.05 has a leading zero in its fraction
+        }
+        for (int i = 0; i < count; i++){
+            out[length++] = digits[i];
+        }
+    }
+    return length;
+}
+
+// output an unsigned number in decimal
+void uart_put_number(uint32_t value){
+    char text[FORMAT_U32_MAX];
+    uart_write(text, format_u32(text, value));
+}
+
+// output a number in hexadecimal, "digits" digits wide
+void uart_put_hex(uint32_t value, int digits){
+    char text[8];
+    uart_write(text, format_hex(text, value, digits));
+}
+
+// output a null terminated string, in one uart_write()
+void uart_put_string(const char *str){
+    uart_write(str, strlen(str));
+}
+
+// output one line of the profiler report: "<name> calls N avg N max N"
+void print_cycle_stats(const char *name, const cycle_stats_t *live_stats){
+    // take a copy with interrupts masked, an ISR could update the 64 bit total halfway through us reading it
+    bool was_masked = critical_enter();
+    cycle_stats_t copy = *live_stats;
+    critical_exit(was_masked);
+    const cycle_stats_t *stats = &copy;
+
+    uint32_t average = 0;
+    if (stats->calls > 0){
+        average = (uint32_t) (stats->total_cycles / stats->calls);
+    }
+
+    uart_put_string(name);
+    uart_put_string(" calls ");
+    uart_put_number(stats->calls);
+    uart_put_string(" avg ");
+    uart_put_number(average);
+    uart_put_string(" max ");
+    uart_put_number(stats->max_cycles);
+    uart_put_string(" cycles\r\n");
+}
+
+// deferred work: the ISRs only do what can't wait (move bytes, reprogram the timer) and post a small event, main() does the real work between sleeps
+// every ISR has its own queue, so each queue has exactly one producer (the ISR) and one consumer (main), and needs no locking:
+// only the producer moves head, only the consumer moves tail, and the slot is written before head moves past it
+#define EVENT_QUEUE_SIZE 8 // must be a power of 2
+
+#define EVENT_COMMAND 1 // a complete command line, data is its slot in uart_rx_lines
+#define EVENT_TASK_TIMER 2 // a task's timer expired, data is its index in tasks
+
+typedef struct {
+    uint8_t type; // EVENT_
+    uint8_t data;
+    uint32_t posted; // cycle count when the ISR posted it, for the latency stats
+} event_t;
+
+typedef struct {
+    event_t events[EVENT_QUEUE_SIZE];
+    volatile uint8_t head; // free running like the TX ring buffer indices
+    volatile uint8_t tail;
+    uint32_t dropped; // events thrown away because main() fell too far behind
+} event_queue_t;
+
+event_queue_t uart_events;
+event_queue_t timer_events;
+
+cycle_stats_t command_latency_stats; // from the enter key arriving in the UART ISR to main() starting the command
+cycle_stats_t task_latency_stats; // from the GPT0 ISR to main() seeing the task's timer event
+
+// called from the queue's ISR only
+bool event_post(event_queue_t *queue, uint8_t type, uint8_t data){
+    uint8_t head = queue->head;
+    if ((uint8_t) (head - queue->tail) >= EVENT_QUEUE_SIZE){
+        queue->dropped++;
+        return false;
+    }
+
+    event_t *event = &queue->events[head & (EVENT_QUEUE_SIZE - 1)];
+    event->type = type;
+    event->data = data;
+    event->posted = cycles_now();
+    queue->head = head + 1; // publish it, main() won't look at the slot before this
+    return true;
+}
+
+// called from main() only
+bool event_take(event_queue_t *queue, event_t *event){
+    uint8_t tail = queue->tail;
+    if (tail == queue->head){
+        return false;
+    }
+
+    *event = queue->events[tail & (EVENT_QUEUE_SIZE - 1)];
+    queue->tail = tail + 1; // hand the slot back to the ISR
+    return true;
+}
+
+// a command writes its whole reply into the TX ring buffer at once, so it only runs once there's room for the longest one ("stat")
+// until then it waits in the queue with its line slot, and with flow control on RTS holds the PC off
+#define COMMAND_REPLY_MAX 256
+
+bool command_can_run(){
+    return uart_tx_space() >= COMMAND_REPLY_MAX;
+}
+
+// room for a task's output: tasks leave the reply space of a waiting command alone, so a busy monitor can't starve the command line
+bool uart_tx_room(uint32_t bytes){
+    uint32_t reserved = (uart_events.tail != uart_events.head) ? COMMAND_REPLY_MAX : 0;
+    return uart_tx_space() >= bytes + reserved;
+}
+
+// an event main() can take right now, a command waiting for TX space doesn't count: the TX interrupt wakes us as the buffer drains
+bool events_pending(){
+    return (uart_events.tail != uart_events.head && command_can_run()) || (timer_events.tail != timer_events.head);
+}
+
+// protothreads: stackless coroutines, so a mode can be written as plain sequential code that waits ("wait for the timer, then for the TRNG, then for TX space")
+// instead of a state machine spread over globals. A thread is a function that main() calls again and again, the only state it keeps is the source line
+// it stopped at, and PT_BEGIN jumps straight back there with a switch (the same trick as Duff's device), so a whole task costs 2 bytes of RAM
+// the catches: local variables are gone after a wait (keep anything that has to survive one in a global), a thread can't use a switch statement
+// of its own around a wait, and only one PT_ macro per source line (the line number is the label)
+typedef struct {
+    uint16_t line; // where to continue, 0 = from the top
+} pt_t;
+
+#define PT_WAITING 0 // blocked until an interrupt changes something, main() may sleep
+#define PT_POLLING 1 // waiting on something that has no interrupt of its own, main() must not sleep
+#define PT_ENDED 2
+
+#define PT_INIT(pt) ((pt)->line = 0)
+#define PT_BEGIN(pt) switch((pt)->line){ case 0:
+#define PT_END(pt) } (pt)->line = 0; return PT_ENDED
+
+// give up the CPU until cond is true, it's checked every time the thread is called again
+#define PT_WAIT_UNTIL(pt, cond) do { (pt)->line = __LINE__; case __LINE__: if (!(cond)) return PT_WAITING; } while (0)
+// same, but for conditions nothing will wake us up for, main() keeps calling without sleeping until it's true
+#define PT_POLL_UNTIL(pt, cond) do { (pt)->line = __LINE__; case __LINE__: if (!(cond)) return PT_POLLING; } while (0)
+
+// software timers: GPT0 timer A counts up freely (it never stops or reloads), and every software timer is just a deadline on that count
+// the deadlines are kept in a binary min-heap, so the nearest one is always at the top, and only that one is programmed into the match register
+// starting, stopping and expiring a timer is O(log n), no matter how many timers are running
+#define MS_TO_TICKS(ms) ((uint32_t) (ms) * (ONE_MS_32BIT_DIVIDER)) // the timer clock is 48 MHz / 16 = 3 MHz, so 3000 ticks per ms
+#ifndef SW_TIMER_MAX
+#define SW_TIMER_MAX 32 // how many software timers can run at the same time, 4 bytes of RAM each, the tasks use one each and the rest is headroom
+#endif
+// the counter wraps every 2^32 ticks (~23 minutes), comparing "a - b" as signed handles that as long as no delay is longer than half of it (~11 minutes)
+
+typedef struct sw_timer sw_timer_t;
+typedef void (*sw_timer_callback_t)(sw_timer_t *timer);
+
+struct sw_timer {
+    uint32_t deadline; // GPT0 count at which it expires
+    uint32_t expired; // the deadline it expired at last time, sw_timer_continue() counts from here
+    uint32_t period; // ticks between expiries for a periodic timer, 0 for a one shot
+    sw_timer_callback_t callback; // called from the GPT0 ISR when it expires, keep it short and post an event for anything slow
+    int16_t index; // position in the heap, -1 while it isn't running
+};
+
+sw_timer_t *sw_timer_heap[SW_TIMER_MAX];
+uint16_t sw_timer_count = 0;
+_Static_assert(SW_TIMER_MAX <= INT16_MAX, "the heap positions are int16_t");
+
+uint32_t sw_timer_late_max = 0; // the latest a periodic timer ever ran after its deadline, in ticks
+uint32_t sw_timer_missed = 0; // periods skipped because a periodic timer fell more than a whole period behind
+
+// the current GPT0 count
+static inline uint32_t sw_timer_now(){
+    return TimerValueGet(GPT0_BASE, TIMER_A);
+}
+
+// true if timer a expires before timer b
+static inline bool sw_timer_before(const sw_timer_t *a, const sw_timer_t *b){
+    return (int32_t) (a->deadline - b->deadline) < 0;
+}
+
+// put a timer at a heap position and remember where it is (so stop can find it without searching)
+static inline void sw_timer_place(int16_t index, sw_timer_t *timer){
+    sw_timer_heap[index] = timer;
+    timer->index = index;
+}
+
+// move a timer towards the top while it expires before its parent
+void sw_timer_sift_up(int16_t index){
+    sw_timer_t *timer = sw_timer_heap[index];
+
+    while (index > 0){
+        int16_t parent = (index - 1)/2;
+        if (!sw_timer_before(timer, sw_timer_heap[parent])){
+            break;
+        }
+        sw_timer_place(index, sw_timer_heap[parent]);
+        index = parent;
+    }
+    sw_timer_place(index, timer);
+}
+
+// move a timer towards the bottom while one of its children expires before it
+void sw_timer_sift_down(int16_t index){
+    sw_timer_t *timer = sw_timer_heap[index];
+
+    while (1){
+        int16_t child = 2*index + 1;
+        if (child >= sw_timer_count){
+            break;
+        }
+        if (child + 1 < sw_timer_count && sw_timer_before(sw_timer_heap[child + 1], sw_timer_heap[child])){
+            child++;
+        }
+        if (!sw_timer_before(sw_timer_heap[child], timer)){
+            break;
+        }
+        sw_timer_place(index, sw_timer_heap[child]);
+        index = child;
+    }
+    sw_timer_place(index, timer);
+}
+
+// take a timer out of the heap
+void sw_timer_remove(sw_timer_t *timer){
+    int16_t index = timer->index;
+
+    sw_timer_count--;
+    if (index != sw_timer_count){
+        // the last timer fills the hole, then goes up or down to where it belongs
+        sw_timer_t *moved = sw_timer_heap[sw_timer_count];
+        sw_timer_place(index, moved);
+        sw_timer_sift_up(index);
+        sw_timer_sift_down(moved->index);
+    }
+    timer->index = -1;
+}
+
+// program the match register for the nearest deadline
+void sw_timer_program(){
+    if (sw_timer_count == 0){
+        TimerIntDisable(GPT0_BASE, TIMER_TIMA_MATCH); // nothing to wait for
+        return;
+    }
+
+    TimerMatchSet(GPT0_BASE, TIMER_A, sw_timer_heap[0]->deadline);
+    TimerIntEnable(GPT0_BASE, TIMER_TIMA_MATCH);
+
+    // the match only fires when the count is exactly equal, if we were too late (or the delay was 0) run the ISR ourselves
+    if ((int32_t) (sw_timer_heap[0]->deadline - sw_timer_now()) <= 0){
+        IntPendSet(INT_GPT0A);
+    }
+}
+
+// true while the timer is waiting to expire
+bool sw_timer_running(const sw_timer_t *timer){
+    return timer->index >= 0;
+}
+
+// start (or restart) a timer: it expires after delay_ms, then every period_ms if that isn't 0
+bool sw_timer_start(sw_timer_t *timer, uint32_t delay_ms, uint32_t period_ms){
+    bool was_masked = critical_enter(); // the GPT0 ISR works on the heap too
+
+    if (sw_timer_running(timer)){
+        sw_timer_remove(timer);
+    }
+    if (sw_timer_count >= SW_TIMER_MAX){
+        critical_exit(was_masked);
+        return false;
+    }
+
+    timer->deadline = sw_timer_now() + MS_TO_TICKS(delay_ms);
+    timer->period = MS_TO_TICKS(period_ms);
+
+    sw_timer_place(sw_timer_count, timer);
+    sw_timer_count++;
+    sw_timer_sift_up(timer->index);
+
+    sw_timer_program();
+    critical_exit(was_masked);
+    return true;
+}
+
+// start a one shot timer delay_ms after the deadline it last expired at (instead of after now), call it from the timer's own callback (or the work it posted)
+// chaining steps like this keeps a sequence exact, the time spent in the ISR between the steps doesn't add up
+bool sw_timer_continue(sw_timer_t *timer, uint32_t delay_ms){
+    bool was_masked = critical_enter();
+
+    if (sw_timer_running(timer)){
+        sw_timer_remove(timer);
+    }
+    if (sw_timer_count >= SW_TIMER_MAX){
+        critical_exit(was_masked);
+        return false;
+    }
+
+    timer->deadline = timer->expired + MS_TO_TICKS(delay_ms);
+    timer->period = 0;
+    // the chain was broken (the timer sat idle for a while), catching up on every step we missed would be a burst, count from now instead
+    if ((int32_t) (sw_timer_now() - timer->deadline) > 0){
+        timer->deadline = sw_timer_now() + MS_TO_TICKS(delay_ms);
+    }
+
+    sw_timer_place(sw_timer_count, timer);
+    sw_timer_count++;
+    sw_timer_sift_up(timer->index);
+
+    sw_timer_program();
+    critical_exit(was_masked);
+    return true;
+}
+
+// cancel a timer, nothing happens if it isn't running
+void sw_timer_stop(sw_timer_t *timer){
+    bool was_masked = critical_enter();
+
+    if (sw_timer_running(timer)){
+        sw_timer_remove(timer);
+        sw_timer_program();
+    }
+    critical_exit(was_masked);
+}
+
+// run every timer whose deadline has passed, called by the GPT0 ISR
+void sw_timer_expire(){
+    while (sw_timer_count > 0 && (int32_t) (sw_timer_now() - sw_timer_heap[0]->deadline) >= 0){
+        sw_timer_t *timer = sw_timer_heap[0];
+        sw_timer_remove(timer);
+        timer->expired = timer->deadline;
+
+        // periodic timers go straight back in before the callback runs, so the callback can still stop or restart them
+        // the next deadline is the old deadline + period, not now + period, so the time the ISR and the callback take never adds up into drift
+        if (timer->period != 0){
+            uint32_t now = sw_timer_now();
+            uint32_t late = now - timer->deadline;
+            if (late > sw_timer_late_max){
+                sw_timer_late_max = late;
+            }
+
+            timer->deadline += timer->period;
+            // if we fell a whole period (or more) behind, skip those periods instead of firing a burst to catch up
+            while ((int32_t) (now - timer->deadline) >= 0){
+                timer->deadline += timer->period;
+                sw_timer_missed++;
+            }
+
+            sw_timer_place(sw_timer_count, timer);
+            sw_timer_count++;
+            sw_timer_sift_up(timer->index);
+        }
+
+        timer->callback(timer);
+    }
+
+    sw_timer_program();
+}
+
+// the modes a command is allowed in, one bit per task, MODE_IDLE while none of them runs
+#define MODE_IDLE 0x01 // nothing running
+#define MODE_LEDS 0x02 // blinker
+#define MODE_MONI 0x04 // monitor
+#define MODE_TRNG 0x08 // random numbers
+#define MODE_DRBG 0x10 // DRBG output
+#define MODE_CAL 0x20 // TRNG calibration sweep
+#define MODE_ANY (MODE_IDLE | MODE_LEDS | MODE_MONI | MODE_TRNG | MODE_DRBG | MODE_CAL)
+
+// tasks: the blinker, the monitor and the TRNG output are separate tasks, so they can all run at the same time, each at its own rate
+// every task is a protothread plus its own software timer, and all of those timers share GPT0 through the timer heap
+// the timer ISR only posts an event, main() counts the task's tick and the protothread picks it up (see tasks_poll)
+typedef struct task task_t;
+typedef int (*task_thread_t)(task_t *task);
+
+struct task {
+    sw_timer_t timer; // has to stay the first member, the timer callback gets a pointer to it and turns it back into the task
+    uint8_t ticks; // timer periods that ended and the thread hasn't seen yet, more than 1 if it was held up
+    uint8_t elapsed; // the periods its last TASK_WAIT_TICK took up, so a step can tell how much time went by
+    bool running;
+    pt_t pt;
+    uint32_t period_ms; // 0 for a task that sets its own delay every step (the blinker)
+    const char *name; // for "stop <name>"
+    uint8_t mode; // its MODE_ bit
+    task_thread_t thread;
+    void (*stopped)(void); // puts the hardware back when the task is stopped, or NULL
+};
+
+#define TASK_LEDS 0
+#define TASK_MONI 1
+#define TASK_TRNG 2
+#define TASK_DRBG 3
+#define TASK_RAW 4
+#define TASK_CAL 5
+#define TASK_BAUD 6
+#define TASK_PROF 7
+#define TASK_COUNT 8
+_Static_assert(SW_TIMER_MAX >= TASK_COUNT, "every task can have its timer running at once");
+
+#define TASK_PERIOD_MIN_MS 10 // a monitor line takes ~10ms to send at 9600 baud, faster than that just fills the TX buffer
+#define TASK_PERIOD_MAX_MS 600000 // 10 minutes, timer deadlines can't be more than ~11 minutes away (see MS_TO_TICKS)
+
+void task_timer_expired(sw_timer_t *timer);
+int task_leds_thread(task_t *task);
+int task_moni_thread(task_t *task);
+void moni_stopped();
+int task_trng_thread(task_t *task);
+int task_drbg_thread(task_t *task);
+int task_raw_thread(task_t *task);
+int task_cal_thread(task_t *task);
+int task_baud_thread(task_t *task);
+int task_prof_thread(task_t *task);
+void baud_stopped();
+void leds_stopped();
+void trng_cal_stopped();
+
+task_t tasks[TASK_COUNT] = {
+    [TASK_LEDS] = {.timer = {0, 0, 0, task_timer_expired, -1}, .name = "leds", .mode = MODE_LEDS, .thread = task_leds_thread, .stopped = leds_stopped},
+    [TASK_MONI] = {.timer = {0, 0, 0, task_timer_expired, -1}, .name = "moni", .mode = MODE_MONI, .thread = task_moni_thread, .stopped = moni_stopped},
+    [TASK_TRNG] = {.timer = {0, 0, 0, task_timer_expired, -1}, .name = "trng", .mode = MODE_TRNG, .thread = task_trng_thread, .stopped = NULL},
+    [TASK_DRBG] = {.timer = {0, 0, 0, task_timer_expired, -1}, .name = "drbg", .mode = MODE_DRBG, .thread = task_drbg_thread, .stopped = NULL},
+    [TASK_RAW] = {.timer = {0, 0, 0, task_timer_expired, -1}, .name = "raw", .mode = MODE_TRNG, .thread = task_raw_thread, .stopped = NULL},
+    [TASK_CAL] = {.timer = {0, 0, 0, task_timer_expired, -1}, .name = "cal", .mode = MODE_CAL, .thread = task_cal_thread, .stopped = trng_cal_stopped},
+    [TASK_BAUD] = {.timer = {0, 0, 0, task_timer_expired, -1}, .name = "baud", .mode = 0, .thread = task_baud_thread, .stopped = baud_stopped}, // no mode of its own, commands don't care
+    [TASK_PROF] = {.timer = {0, 0, 0, task_timer_expired, -1}, .name = "prof", .mode = 0, .thread = task_prof_thread, .stopped = NULL}, // prints the (prof) report
+};
+
+cycle_stats_t task_thread_stats; // one call into a task's protothread, the cost of switching to it and back
+
+// called from the GPT0 ISR
+void task_timer_expired(sw_timer_t *timer){
+    task_t *task = (task_t *) timer;
+    event_post(&timer_events, EVENT_TASK_TIMER, (uint8_t) (task - tasks));
+}
+
+// start a task (or change its period), its protothread does the actual work from main()
+// periodic tasks run their timer against absolute deadlines (see sw_timer_expire)
+// starting a task that already runs with the same period changes nothing, the thread picks up new settings (like the LED pattern) by itself
+void task_start(task_t *task, uint32_t period_ms){
+    if (task->running && task->period_ms == period_ms){
+        return;
+    }
+
+    task->running = true;
+    task->period_ms = period_ms;
+    PT_INIT(&task->pt); // start the thread from the top
+    task->ticks = 0;
+    sw_timer_start(&task->timer, 0, period_ms); // will run it immediately
+}
+
+void task_stop(task_t *task){
+    if (!task->running){
+        return;
+    }
+
+    task->running = false;
+    sw_timer_stop(&task->timer);
+    task->ticks = 0; // an event that was already posted is simply ignored
+    if (task->stopped != NULL){
+        task->stopped();
+    }
+}
+
+// MODE_ bits of every running task
+uint8_t task_modes(){
+    uint8_t modes = 0;
+    for (int i = 0; i < TASK_COUNT; i++){
+        if (tasks[i].running){
+            modes |= tasks[i].mode;
+        }
+    }
+    return (modes != 0) ? modes : MODE_IDLE;
+}
+
+// wait for the next period of a periodic task, all the periods that ended meanwhile go into task->elapsed
+#define TASK_WAIT_TICK(task) do { PT_WAIT_UNTIL(&(task)->pt, (task)->ticks != 0); (task)->elapsed = (task)->ticks; (task)->ticks = 0; } while (0)
+// after a wait for something else (TX room, say), the periods that ended during it go with this step too, it's happening that much later
+#define TASK_TAKE_TICKS(task) do { (task)->elapsed = (uint8_t) (((task)->elapsed + (task)->ticks > UINT8_MAX) ? UINT8_MAX : (task)->elapsed + (task)->ticks); (task)->ticks = 0; } while (0)
+// wait ms after the last time the task's timer fired, steps chained like this don't drift (see sw_timer_continue)
+#define TASK_SLEEP(task, ms) do { sw_timer_continue(&(task)->timer, ms); (task)->ticks = 0; TASK_WAIT_TICK(task); } while (0)
+
+// every message the user can see, in one const pool: the strings and this table stay in flash (.const), nothing is copied to the stack or to RAM
+// they're sent by ID straight from flash with the uDMA, so even the 400 byte menu costs the CPU nothing but queueing a pointer
+typedef enum {
+    MSG_MENU,
+    MSG_NEWLINE,
+    MSG_ECHO_ON,
+    MSG_ECHO_OFF,
+    MSG_STOP,
+    MSG_LEDS_ON,
+    MSG_MONI_ON,
+    MSG_TRNG_ON,
+    MSG_COMMAND_TOO_LONG,
+    MSG_INVALID_NUMBER,
+    MSG_LEDS_UNKNOWN_PATTERN,
+    MSG_LEDS_BAD_STEPS,
+    MSG_LEDS_LOADED,
+    MSG_LEDS_BAD_LEVEL,
+    MSG_PROF_CLEARED,
+    MSG_STOP_UNKNOWN,
+    MSG_BAD_PERIOD,
+    MSG_TRNG_EMPTY,
+    MSG_DRBG_USAGE,
+    MSG_DRBG_RESEEDED,
+    MSG_DRBG_INTERVAL,
+    MSG_TRNG_RAW_USAGE,
+    MSG_TRNG_CAL_ON,
+    MSG_MONI_BATCH_USAGE,
+    MSG_BAUD_USAGE,
+    MSG_BAUD_SWITCHING,
+    MSG_BAUD_CHANGED,
+    MSG_BAUD_FALLBACK,
+    MSG_FLOW_ON,
+    MSG_FLOW_OFF,
+    MSG_MONI_CHANGE_USAGE,
+    MSG_COUNT
+} message_id_t;
+
+typedef struct {
+    const char *text;
+    uint16_t length; // without the null terminator, we don't send that
+} message_t;
+
+#define MESSAGE(text) {text, sizeof(text) - 1}
+
+const message_t messages[MSG_COUNT] = {
+    [MSG_MENU] = MESSAGE("Menu for 11 user commands (press enter after each command):\r\n(stop) - stop current operation, reset system, and wait for next input, (stop leds), (stop moni) or (stop trng) stops just one\r\n(echo) - enables echo mode for user input to the UART, (echo on) and (echo off) set it directly\r\n(leds) - runs blinker mode, cycles through red, green, and red + green every second, (leds 1) to (leds 4) picks a pattern, (leds fade) fades and (leds dim 0) to (leds dim 100) sets the brightness\r\n(ledl) - loads LED pattern 4, pairs of r/g/b/o and milliseconds, like (ledl r 1000 o 400 g 1000)\r\n(moni) - runs temperature and battery monitoring, (moni 100) prints every 100ms, (moni bin) sends binary packets, (moni batch 32) packs 32 samples into one and (moni txt) is text again, (moni change) only reports changes\r\n(trng) - output a random number using TRNG to UART, (trng 5000) every 5 seconds, (trng raw 1000) sends 1000 raw binary bytes, (trng raw 1000 frame) with framing, (trng cal) tunes the TRNG and (trng stat) shows its health\r\n(prof) - show CPU cycles spent in each interrupt and command, (prof clear) starts over\r\n(drbg) - (drbg 1000) prints 1000 random bytes from a TRNG seeded ChaCha20 generator, (drbg reseed) reseeds it\r\n(baud) - (baud 115200) switches the UART to 115200 baud, up to 3000000, just (baud) shows the current rate\r\n(flow) - toggles RTS/CTS hardware flow control, (flow on) and (flow off) set it directly\r\n(stat) - shows the UART rate and its error counters\r\n"),
+    [MSG_NEWLINE] = MESSAGE("\r\n"),
+    [MSG_ECHO_ON] = MESSAGE("Echo mode on\r\n"),
+    [MSG_ECHO_OFF] = MESSAGE("Echo mode off\r\n"),
+    [MSG_STOP] = MESSAGE("Operation stopped - waiting for next input\r\n"),
+    [MSG_LEDS_ON] = MESSAGE("LED blinker mode on\r\nPlease use (stop) or (stop leds) to safely stop the blinker mode\r\n(leds) "),
+    [MSG_MONI_ON] = MESSAGE("Temperature and Battery monitor mode on\r\n"),
+    [MSG_TRNG_ON] = MESSAGE("TRNG mode on\r\n"),
+    [MSG_COMMAND_TOO_LONG] = MESSAGE("Command too long\r\n"),
+    [MSG_INVALID_NUMBER] = MESSAGE("Invalid argument, expected a number\r\n"),
+    [MSG_LEDS_UNKNOWN_PATTERN] = MESSAGE("Unknown pattern, use (leds 1) to (leds 4)\r\n"),
+    [MSG_LEDS_BAD_STEPS] = MESSAGE("Expected up to 16 pairs of r/g/b/o and 50-60000 milliseconds, like (ledl r 1000 o 400)\r\n"),
+    [MSG_LEDS_LOADED] = MESSAGE("Pattern loaded, use (leds 4) to run it\r\n"),
+    [MSG_LEDS_BAD_LEVEL] = MESSAGE("Expected a brightness from 0 to 100, like (leds dim 30)\r\n"),
+    [MSG_PROF_CLEARED] = MESSAGE("Profiler cleared\r\n"),
+    [MSG_STOP_UNKNOWN] = MESSAGE("Not running, use (stop), (stop leds), (stop moni), (stop trng), (stop raw), (stop drbg) or (stop cal)\r\n"),
+    [MSG_BAD_PERIOD] = MESSAGE("Expected a period from 10 to 600000 milliseconds, like (moni 100)\r\n"),
+    [MSG_TRNG_EMPTY] = MESSAGE("Not enough entropy yet\r\n"),
+    [MSG_DRBG_USAGE] = MESSAGE("Use (drbg N) for N random bytes (1 to 65536), (drbg reseed) to reseed now or (drbg reseed N) to reseed every N bytes\r\n"),
+    [MSG_DRBG_RESEEDED] = MESSAGE("DRBG reseeded from the TRNG\r\n"),
+    [MSG_DRBG_INTERVAL] = MESSAGE("DRBG reseed interval set\r\n"),
+    [MSG_TRNG_RAW_USAGE] = MESSAGE("Use (trng raw N) for N raw bytes (1 to 1048576), or (trng raw N frame) for framed ones\r\n"),
+    [MSG_TRNG_CAL_ON] = MESSAGE("TRNG calibration, numbers keep coming while it runs\r\n"),
+    [MSG_MONI_BATCH_USAGE] = MESSAGE("Use (moni batch N) for N samples per packet (1 to 64), like (moni batch 32) or (moni batch 32 100)\r\n"),
+    [MSG_BAUD_USAGE] = MESSAGE("Use (baud N) with 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000, 1500000 or 3000000\r\n"),
+    [MSG_BAUD_SWITCHING] = MESSAGE("Switching, change your terminal and send any command within 5 seconds, or it goes back to 9600\r\n"),
+    [MSG_BAUD_CHANGED] = MESSAGE("New baud rate, send any command to keep it\r\n"),
+    [MSG_BAUD_FALLBACK] = MESSAGE("No command at the new baud rate, back to 9600\r\n"),
+    [MSG_FLOW_ON] = MESSAGE("Hardware flow control on (RTS/CTS)\r\n"),
+    [MSG_FLOW_OFF] = MESSAGE("Hardware flow control off\r\n"),
+    [MSG_MONI_CHANGE_USAGE] = MESSAGE("Use (moni change) for changes of 1c or 10mV, (moni change T MV) for 1-100c and 1-1000mV, or (moni change off)\r\n"),
+};
+
+// send a message from the pool, zero copy
+void uart_send_message(message_id_t id){
+    uart_write_dma(messages[id].text, messages[id].length);
+}
+
 // display the user menu
 void menu_display(){
-    char menu[] = "Menu for 5 user commands:\r\n(stop) - stop current operation, reset system, and wait for next input\r\n(echo) - enables echo mode for user input to the UART\r\n(leds) - runs blinker mode, cycles through red, green, and red + green every second\r\n(moni) - runs temperature and battery monitoring\r\n(trng) - output a random number using TRNG to UART\r\n";
+    uart_send_message(MSG_MENU);
+}
 
-    for (int i = 0; i < sizeof(menu)/sizeof(menu[0]); i++){
-        UARTCharPut(UART0_BASE, (uint8_t) (menu[i]));
+// LED blink sequencer: a blink pattern is a table of steps {what DOUT7_4 should be, how long to keep it}
+// every timer tick is one table lookup and one register write, changing a pattern means changing data instead of code
+// DOUT7_4 has one byte per DIO: DIO4 is bit 0, DIO5 bit 8, DIO6 (red) bit 16 and DIO7 (green) bit 24
+#define LED_OFF 0x00000000
+#define LED_RED 0x00010000
+#define LED_GREEN 0x01000000
+#define LED_BOTH (LED_RED | LED_GREEN)
+
+#define LED_STEP_MIN_MS 50 // you dont want the led light to toggle on and off too quickly (dangerous), so loaded patterns can't go faster than this
+#define LED_USER_STEPS_MAX 16 // longest pattern that can be loaded with (ledl)
+
+typedef struct {
+    uint32_t dout; // value written to GPIO_O_DOUT7_4
+    uint16_t duration_ms; // how long it stays like this
+} led_step_t;
+
+typedef struct {
+    const led_step_t *steps;
+    uint8_t length;
+} led_pattern_t;
+
+// 1: red, green, red + green for a second each with 400ms off in between (the original blinker)
+const led_step_t led_steps_cycle[] = {
+    {LED_RED, 1000}, {LED_OFF, 400}, {LED_GREEN, 1000}, {LED_OFF, 400}, {LED_BOTH, 1000}, {LED_OFF, 400}
+};
+// 2: red and green taking turns
+const led_step_t led_steps_alternate[] = {
+    {LED_RED, 500}, {LED_GREEN, 500}
+};
+// 3: red heartbeat, two short beats and a pause
+const led_step_t led_steps_heartbeat[] = {
+    {LED_RED, 100}, {LED_OFF, 150}, {LED_RED, 100}, {LED_OFF, 650}
+};
+
+// 4: loaded at runtime with (ledl)
+led_step_t led_steps_user[LED_USER_STEPS_MAX] = {{LED_OFF, 1000}};
+uint8_t led_steps_user_length = 1;
+
+#define LED_PATTERN_BUILT_IN 3 // patterns 1 to 3 are in flash, pattern 4 is the loaded one
+#define LED_PATTERN_COUNT (LED_PATTERN_BUILT_IN + 1)
+
+const led_pattern_t led_patterns[LED_PATTERN_BUILT_IN] = {
+    {led_steps_cycle, sizeof(led_steps_cycle)/sizeof(led_steps_cycle[0])},
+    {led_steps_alternate, sizeof(led_steps_alternate)/sizeof(led_steps_alternate[0])},
+    {led_steps_heartbeat, sizeof(led_steps_heartbeat)/sizeof(led_steps_heartbeat[0])},
+};
+
+// the pattern being played and where we are in it
+const led_step_t *led_steps = led_steps_cycle;
+uint8_t led_length = sizeof(led_steps_cycle)/sizeof(led_steps_cycle[0]);
+uint8_t led_step = 0;
+
+// choose a pattern (0 based), it starts from its first step on the next tick
+void led_select_pattern(uint32_t pattern){
+    if (pattern < LED_PATTERN_BUILT_IN){
+        led_steps = led_patterns[pattern].steps;
+        led_length = led_patterns[pattern].length;
+    }
+    else{
+        led_steps = led_steps_user;
+        led_length = led_steps_user_length;
     }
+    led_step = 0;
+}
 
+// one step of the blinker, returns how long to keep it
+uint16_t led_sequencer_step(){
+    const led_step_t *step = &led_steps[led_step];
+
+    HWREG(GPIO_BASE + GPIO_O_DOUT7_4) = step->dout;
+
+    led_step++;
+    if (led_step >= led_length){
+        led_step = 0;
+    }
+    return step->duration_ms;
+}
+
+// PWM dimming: DIO6 and DIO7 can be taken away from the GPIO module and given to timer outputs instead
+// the IOC routes GPT1A to MCU port event 2 and GPT2A to port event 4, so red runs off GPT1 and green off GPT2
+// once the duty cycle is set the timers keep the LEDs at that brightness on their own, the CPU can sleep through it
+#define LED_PWM_PERIOD 3000 // timer clock is 48MHz/16 = 3MHz, 3000 ticks is a 1kHz PWM (too fast to see any flicker)
+#define LED_FADE_STEP_MS 20 // one brightness step per 20ms, 100 steps up and 100 back down is a 4 second breath
+#define LED_LEVEL_MAX 100 // brightness in percent
+
+bool led_pwm = false; // the LEDs are on the timers instead of GPIO
+bool led_fade = false; // and the blinker task is fading them
+uint8_t led_fade_level = 0;
+int8_t led_fade_direction = 1;
+
+// set the brightness of one LED timer, 0 to LED_LEVEL_MAX percent
+// the eye sees brightness roughly as the square of the duty cycle, so squaring the level makes the fade look even
+void led_pwm_level(uint32_t base, uint32_t level){
+    uint32_t on_ticks = (LED_PWM_PERIOD * level * level) / (LED_LEVEL_MAX * LED_LEVEL_MAX);
+
+    // in PWM mode the output goes high when the timer reloads and low when it counts down to the match value
+    TimerMatchSet(base, TIMER_A, LED_PWM_PERIOD - on_ticks);
+}
+
+// hand the LED pins to the PWM timers
+void led_pwm_on(){
+    if (!led_pwm){
+        led_pwm = true;
+        IOCPortConfigureSet(IOID_6, IOC_PORT_MCU_PORT_EVENT2, IOC_STD_OUTPUT); // red from GPT1A
+        IOCPortConfigureSet(IOID_7, IOC_PORT_MCU_PORT_EVENT4, IOC_STD_OUTPUT); // green from GPT2A
+        TimerEnable(GPT1_BASE, TIMER_A);
+        TimerEnable(GPT2_BASE, TIMER_A);
+    }
+}
+
+// give the LED pins back to GPIO, the blink patterns write DOUT7_4 directly
+void led_pwm_off(){
+    led_fade = false;
+    if (led_pwm){
+        led_pwm = false;
+        TimerDisable(GPT1_BASE, TIMER_A);
+        TimerDisable(GPT2_BASE, TIMER_A);
+        IOCPinTypeGpioOutput(IOID_6);
+        IOCPinTypeGpioOutput(IOID_7);
+    }
+}
+
+// one step of the fade: red breathes in while green breathes out and back again
+void led_fade_step(){
+    led_pwm_level(GPT1_BASE, led_fade_level);
+    led_pwm_level(GPT2_BASE, LED_LEVEL_MAX - led_fade_level);
+
+    if (led_fade_level == 0){
+        led_fade_direction = 1;
+    }
+    else if (led_fade_level == LED_LEVEL_MAX){
+        led_fade_direction = -1;
+    }
+    led_fade_level += led_fade_direction;
 }
 
 void IOC_Interrupt_Handler(){
@@ -107,6 +1176,346 @@ void setup_GPIO(){
 }
 
 
+// set up GPT1 and GPT2 as PWM timers for the LEDs, they only drive the pins once led_pwm_on() routes them there
+// the timer clock division is shared by all GPTs and set in setup_Timer
+void setup_PWM(){
+    // power on GPT1 and GPT2, and keep them running while the MCU sleeps, that's the whole point
+    PRCMPeripheralRunEnable(PRCM_PERIPH_TIMER1);
+    PRCMPeripheralRunEnable(PRCM_PERIPH_TIMER2);
+    PRCMPeripheralSleepEnable(PRCM_PERIPH_TIMER1);
+    PRCMPeripheralSleepEnable(PRCM_PERIPH_TIMER2);
+    PRCMLoadSet();
+    while (!PRCMLoadGet());
+
+    // timer A of each as a 16 bit PWM, counting down from LED_PWM_PERIOD
+    TimerConfigure(GPT1_BASE, TIMER_CFG_SPLIT_PAIR | TIMER_CFG_A_PWM);
+    TimerConfigure(GPT2_BASE, TIMER_CFG_SPLIT_PAIR | TIMER_CFG_A_PWM);
+    TimerLoadSet(GPT1_BASE, TIMER_A, LED_PWM_PERIOD);
+    TimerLoadSet(GPT2_BASE, TIMER_A, LED_PWM_PERIOD);
+    led_pwm_level(GPT1_BASE, 0);
+    led_pwm_level(GPT2_BASE, 0);
+}
+
+// TRNG entropy pool: the TRNG interrupt drops every new 64 bit number into this ring while the CPU sleeps, and the users take words out of it
+// nobody waits for the TRNG anymore, an empty pool is reported (trng_pool_take returns false) instead of spun on
+// when the pool is full the ISR leaves the number in the TRNG unacknowledged and turns its interrupt off, the TRNG then holds still until there's room
+#define TRNG_POOL_SIZE 32 // 32 bit words, must be a power of 2
+uint32_t trng_pool[TRNG_POOL_SIZE];
+volatile uint8_t trng_pool_head = 0; // only moved by the TRNG ISR, free running like the other rings
+volatile uint8_t trng_pool_tail = 0; // only moved by main()
+
+cycle_stats_t trng_isr_stats;
+uint32_t trng_pool_empty = 0; // times somebody wanted a word and there wasn't one
+uint32_t trng_fro_shutdowns = 0; // times the TRNG shut down oscillators for repeating themselves
+uint32_t trng_fro_alarms = 0; // oscillators shut down in all those times, one shutdown can stop several
+uint32_t trng_start_ticks = 0; // GPT0 count when the TRNG was enabled
+uint32_t trng_first_ticks = 0; // GPT0 ticks from enabling the TRNG to the first number in the pool
+bool trng_first_done = false;
+
+// TRNGConfigure settings: samples per number (2^6 to 2^14 here, more samples, more entropy per number) and FRO clocks between two samples minus 1
+// faster isn't always fine, the calibration sweep (trng cal) measures each one and keeps the fastest that passes the health tests below
+typedef struct {
+    uint16_t min_samples;
+    uint8_t clocks_per_sample;
+} trng_setting_t;
+
+const trng_setting_t trng_settings[] = {
+    {64, 0},
+    {64, 1},
+    {128, 0},
+    {128, 1}, // what we always used, every 2nd sample and 128 samples per number
+    {256, 1},
+    {512, 3},
+};
+#define TRNG_SETTING_COUNT (sizeof(trng_settings) / sizeof(trng_settings[0]))
+#define TRNG_SETTING_DEFAULT 3
+#define TRNG_MAX_SAMPLES 16777216 // 2^24, also how long the FROs may sit idle before they're shut down
+
+uint8_t trng_setting = TRNG_SETTING_DEFAULT;
+volatile bool trng_calibrating = false; // the ISR takes every number to count it, the ones that pass still go into the pool while there's room
+volatile uint32_t trng_numbers = 0; // every number the TRNG made, kept or not
+
+// online health tests (NIST SP 800-90B 4.4) on every output byte, we assume at least 4 bits of entropy per byte and a false alarm rate of 2^-20
+// repetition count: the same byte 6 times in a row (1 + 20/4), adaptive proportion: the first byte of a 512 byte window 62 more times in it
+// a number that fails either is thrown away instead of going into the pool
+#define TRNG_RCT_CUTOFF 6
+#define TRNG_APT_WINDOW 512
+#define TRNG_APT_CUTOFF 62
+
+uint8_t trng_rct_last;
+uint8_t trng_rct_count = 0;
+uint8_t trng_apt_first;
+uint16_t trng_apt_seen = 0; // bytes of the current window so far, 0 starts a new one
+uint16_t trng_apt_count;
+uint32_t trng_rct_failures = 0;
+uint32_t trng_apt_failures = 0;
+
+// run both tests on one byte, returns false if either failed, only called by the TRNG ISR
+bool trng_health_byte(uint8_t sample){
+    bool pass = true;
+
+    if (trng_rct_count > 0 && sample == trng_rct_last){
+        if (trng_rct_count < TRNG_RCT_CUTOFF){
+            trng_rct_count++; // it stays at the cutoff for as long as the run goes on, a byte counter would wrap and pass a few again
+        }
+        if (trng_rct_count >= TRNG_RCT_CUTOFF){
+            trng_rct_failures++;
+            pass = false;
+        }
+    }
+    else{
+        trng_rct_last = sample;
+        trng_rct_count = 1;
+    }
+
+    if (trng_apt_seen == 0){
+        trng_apt_first = sample;
+        trng_apt_count = 1;
+    }
+    else if (sample == trng_apt_first){
+        trng_apt_count++;
+        if (trng_apt_count >= TRNG_APT_CUTOFF){
+            trng_apt_failures++;
+            pass = false;
+            trng_apt_count = 0; // count the window once, not every byte after the cutoff
+        }
+    }
+    trng_apt_seen++;
+    if (trng_apt_seen == TRNG_APT_WINDOW){
+        trng_apt_seen = 0;
+    }
+
+    return pass;
+}
+
+// both 32 bit halves of a new number, all 8 bytes through the health tests in the order they go out: the pool keeps low before high
+// and "trng raw" sends every word low byte first, the tests are only worth something on consecutive samples
+bool trng_health_number(uint32_t low, uint32_t high){
+    bool pass = true;
+    for (int i = 0; i < 4; i++){
+        pass &= trng_health_byte((uint8_t) (low >> (8*i)));
+    }
+    for (int i = 0; i < 4; i++){
+        pass &= trng_health_byte((uint8_t) (high >> (8*i)));
+    }
+    return pass;
+}
+
+// switch the TRNG to another setting, it has to be off while it's configured, the number it was working on is lost
+void trng_apply(uint8_t setting){
+    bool was_masked = critical_enter(); // the ISR shares the health test state and the interrupt mask
+    TRNGDisable();
+    TRNGConfigure(trng_settings[setting].min_samples, TRNG_MAX_SAMPLES, trng_settings[setting].clocks_per_sample);
+    trng_setting = setting;
+
+    // the tests start over, the old bytes say nothing about the new setting
+    trng_rct_count = 0;
+    trng_apt_seen = 0;
+
+    TRNGIntClear(TRNG_NUMBER_READY);
+    TRNGIntEnable(TRNG_NUMBER_READY); // may have been off for a full pool
+    TRNGEnable();
+    critical_exit(was_masked);
+}
+
+uint32_t trng_pool_count(){
+    return (uint8_t) (trng_pool_head - trng_pool_tail);
+}
+
+// take one word of entropy, returns false if the pool is empty right now (never waits)
+bool trng_pool_take(uint32_t *word){
+    uint8_t tail = trng_pool_tail;
+    if (tail == trng_pool_head){
+        trng_pool_empty++;
+        return false;
+    }
+
+    *word = trng_pool[tail & (TRNG_POOL_SIZE - 1)];
+    trng_pool_tail = tail + 1; // hand the slot back to the ISR
+
+    // the ISR turns its interrupt off when the pool is full, there's room for the next number again
+    if (trng_pool_count() <= TRNG_POOL_SIZE - 2){
+        bool was_masked = critical_enter(); // the mask register is read-modify-write, and the ISR writes it too
+        TRNGIntEnable(TRNG_NUMBER_READY);
+        critical_exit(was_masked);
+    }
+    return true;
+}
+
+// TRNG ISR, a new number is ready (or oscillators were shut down)
+void TRNG_Interrupt_Handler(){
+    uint32_t isr_start = cycles_now(); // profiler, measure the whole ISR
+    uint32_t status = TRNGIntStatus();
+
+    if (status & TRNG_NUMBER_READY){
+        if (trng_calibrating || trng_pool_count() <= TRNG_POOL_SIZE - 2){
+            // both 32 bit halves of the number, read straight from the output registers (TRNGNumberGet would acknowledge after the first one)
+            uint32_t low = HWREG(TRNG_BASE + TRNG_O_OUT0);
+            uint32_t high = HWREG(TRNG_BASE + TRNG_O_OUT1);
+            TRNGIntClear(TRNG_NUMBER_READY); // acknowledge, the TRNG starts on the next number while we check this one
+            trng_numbers++;
+
+            // during the sweep too, a number that passed is as good as any other, only the rate and the failures decide the setting
+            if (trng_health_number(low, high) && trng_pool_count() <= TRNG_POOL_SIZE - 2){
+                uint8_t head = trng_pool_head;
+                trng_pool[head & (TRNG_POOL_SIZE - 1)] = low;
+                trng_pool[(head + 1) & (TRNG_POOL_SIZE - 1)] = high;
+                trng_pool_head = head + 2; // publish them
+            }
+
+            if (!trng_first_done){
+                trng_first_done = true;
+                trng_first_ticks = sw_timer_now() - trng_start_ticks;
+            }
+        }
+        else{
+            TRNGIntDisable(TRNG_NUMBER_READY); // full, trng_pool_take() turns it back on
+        }
+    }
+
+    // some oscillators showed a repeating pattern and were shut down, detune them a little and start them again
+    if (status & TRNG_FRO_SHUTDOWN){
+        uint32_t stopped = HWREG(TRNG_BASE + TRNG_O_ALARMSTOP);
+        HWREG(TRNG_BASE + TRNG_O_FRODETUNE) ^= stopped;
+        HWREG(TRNG_BASE + TRNG_O_ALARMMASK) = 0;
+        HWREG(TRNG_BASE + TRNG_O_ALARMSTOP) = 0;
+        HWREG(TRNG_BASE + TRNG_O_FROEN) |= stopped;
+        trng_fro_shutdowns++;
+        for (; stopped != 0; stopped &= stopped - 1){
+            trng_fro_alarms++;
+        }
+        TRNGIntClear(TRNG_FRO_SHUTDOWN);
+    }
+
+    cycle_stats_add(&trng_isr_stats, isr_start);
+}
+
+// DRBG: the TRNG gives us 64 bits every few thousand cycles, for kilobytes of random data we stretch its output with ChaCha20 (RFC 8439)
+// the TRNG pool seeds the 256 bit key and the 96 bit nonce, and every drbg_reseed_interval bytes fresh TRNG words are mixed in again
+// after every request the key is replaced by more ChaCha20 output ("fast key erasure"), so reading the state later doesn't give away what was generated before
+#define DRBG_SEED_WORDS 12 // 8 key words + 3 nonce words + 1 spare, taken from the pool only if it has all of them
+#define DRBG_RESEED_DEFAULT 4096 // bytes
+
+typedef struct {
+    uint32_t key[8];
+    uint32_t nonce[3];
+    uint32_t counter; // block counter, back to 0 after every new key
+    uint32_t since_reseed; // bytes generated since the last reseed
+    bool seeded;
+} drbg_t;
+
+drbg_t drbg;
+uint32_t drbg_reseed_interval = DRBG_RESEED_DEFAULT; // 0 = reseed before every request
+uint32_t drbg_reseeds = 0;
+cycle_stats_t drbg_block_stats; // one ChaCha20 block (64 bytes), throughput = 64 * 48MHz / avg cycles
+
+#define ROTL32(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+// the ChaCha quarter round, on 4 of the 16 state words
+#define CHACHA_QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8); \
+    c += d; b ^= c; b = ROTL32(b, 7)
+
+// one 64 byte ChaCha20 block (RFC 8439 section 2.3), as 16 little endian words
+void chacha20_block(const uint32_t key[8], uint32_t counter, const uint32_t nonce[3], uint32_t out[16]){
+    uint32_t start = cycles_now();
+
+    // the input state goes straight into out, the rounds work on a copy and it's added back at the end (saves 64 bytes of our small stack)
+    out[0] = 0x61707865; // "expand 32-byte k"
+    out[1] = 0x3320646E;
+    out[2] = 0x79622D32;
+    out[3] = 0x6B206574;
+    for (int i = 0; i < 8; i++){
+        out[4 + i] = key[i];
+    }
+    out[12] = counter;
+    out[13] = nonce[0];
+    out[14] = nonce[1];
+    out[15] = nonce[2];
+
+    uint32_t x[16];
+    for (int i = 0; i < 16; i++){
+        x[i] = out[i];
+    }
+
+    // 20 rounds, as 10 pairs of a column round and a diagonal round
+    for (int i = 0; i < 10; i++){
+        CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++){
+        out[i] += x[i];
+    }
+    cycle_stats_add(&drbg_block_stats, start);
+}
+
+// mix fresh TRNG words into the key and nonce, returns false (and changes nothing) if the pool doesn't have enough yet
+bool drbg_reseed(){
+    if (trng_pool_count() < DRBG_SEED_WORDS){
+        return false;
+    }
+
+    uint32_t word;
+    for (int i = 0; i < 8; i++){
+        trng_pool_take(&word);
+        drbg.key[i] ^= word; // xor, so whatever entropy the old key had isn't thrown away
+    }
+    for (int i = 0; i < 3; i++){
+        trng_pool_take(&word);
+        drbg.nonce[i] ^= word;
+    }
+    trng_pool_take(&word);
+    drbg.counter = word & 0xFF; // a random start inside the first 256 blocks, costs nothing
+
+    drbg.since_reseed = 0;
+    drbg.seeded = true;
+    drbg_reseeds++;
+    return true;
+}
+
+// fill out with length random bytes, returns false if a (re)seed was due and the TRNG pool couldn't provide it
+bool drbg_generate(uint8_t *out, uint32_t length){
+    if (!drbg.seeded || drbg.since_reseed >= drbg_reseed_interval){
+        if (!drbg_reseed()){
+            return false; // no output from a state that's overdue for fresh entropy
+        }
+    }
+
+    uint32_t block[16];
+    uint32_t done = 0;
+    while (done < length){
+        chacha20_block(drbg.key, drbg.counter, drbg.nonce, block);
+        drbg.counter++;
+
+        for (int i = 0; i < 64 && done < length; i++){
+            out[done] = (uint8_t) (block[i/4] >> (8*(i%4)));
+            done++;
+        }
+    }
+
+    // fast key erasure: the next block becomes the key, nothing that produced this output is left
+    chacha20_block(drbg.key, drbg.counter, drbg.nonce, block);
+    for (int i = 0; i < 8; i++){
+        drbg.key[i] = block[i];
+    }
+    drbg.counter = 0;
+    for (int i = 0; i < 16; i++){
+        block[i] = 0;
+    }
+
+    drbg.since_reseed += length;
+    return true;
+}
+
 // set up the TRNG, this is much more of a "true random", especially when compared to using srand or rand in C (which are pseudo random)
 void setup_RNG(){
 
@@ -122,187 +1531,1213 @@ void setup_RNG(){
     // run the TRNG in sleep mode
     PRCMPeripheralSleepEnable(PRCM_PERIPH_TRNG);
 
-    // load the settings
-    PRCMLoadSet();
-    // wait until the settings are done loading
-    while (!PRCMLoadGet());
+    // load the settings
+    PRCMLoadSet();
+    // wait until the settings are done loading
+    while (!PRCMLoadGet());
+
+    /* Technical Reference table 16-3, TRNG initialization sequence (Page 1274)
+     * 1. Execute SW reset
+     * 2. Wait for SW completion by polling
+     * 3. Select number of FRO clock input cycles between 2 samples
+     * 4. Select the number of samples taken to gather enough entropy in the FROs of the module and to generate the first random value
+     * 5. Select the minimum number of samples taken regenerate entropy in the FROs of the module and to generate subsequent random values
+     * 6. Select the maximum number of samples taken regenerate entropy in the FROs of the module and to generate subsequent random values. Also defines timeout period for shutting down the FROs after inactivity
+     * 7. Configure the desired FROs to run 5% faster
+     * 8. Enable all FROs
+     * 9. Select the maximum number of samples after which a detected repeated pattern an alarm event is generated
+     * 10. Enable and start
+     */
+
+    TRNGReset(); // when you reset, it says you have to wait 5 clock cycles
+
+    // CPUDelay(2); // 6 clock cycles pass <- this is an incorrect way of doing it, you are losing 1 clock cycle this way
+
+    // use direct register access mode to poll the bit
+
+    while ((HWREG(TRNG_BASE + TRNG_O_SWRESET) & 0x00000001) != 0); // wait until the last bit isn't equal to 1 anymore (back to 0)
+
+    //configure the TRNG settings, the default is minimum 128 = (2^7) samples per generated random number, maximum 16777216 = (2^24) samples per generated random number, and taking every 2nd sample generated
+    // the first trng command runs the calibration sweep, and we switch to the fastest setting that passes (see task_cal_thread)
+    TRNGConfigure(trng_settings[trng_setting].min_samples, TRNG_MAX_SAMPLES, trng_settings[trng_setting].clocks_per_sample);
+
+    // the first number takes a while (all those samples), we don't wait for it here, the interrupt puts it in the pool when it's ready
+    TRNGIntRegister(TRNG_Interrupt_Handler);
+    TRNGIntEnable(TRNG_NUMBER_READY | TRNG_FRO_SHUTDOWN);
+
+    // enable the TRNG after configuring it, it is always generating at the configured rate
+    trng_start_ticks = sw_timer_now(); // GPT0 is already counting, see main()
+    TRNGEnable();
+}
+
+// receive line buffers: characters are collected in one slot until the user presses enter, then the slot is posted to main() to run as a command
+// the ISR carries on in the next slot, a slot only comes back once main() is done with its command, so nothing gets copied
+#define UART_RX_LINE_SIZE 64 // longest command line (including arguments) we accept
+#define UART_RX_LINES 4 // lines that can wait for main() at the same time
+char uart_rx_lines[UART_RX_LINES][UART_RX_LINE_SIZE];
+volatile bool uart_rx_line_busy[UART_RX_LINES]; // posted and not run yet, set by the ISR and cleared by main()
+uint8_t uart_rx_slot = 0; // the slot being typed into
+uint16_t uart_rx_length = 0; // characters currently in the slot
+bool uart_rx_overflow = false; // the current line didn't fit, throw it away when it ends
+bool uart_rx_dropping = false; // the current line started while its slot was still busy, throw it away when it ends
+uint32_t uart_rx_lines_dropped = 0; // lines thrown away because main() still had every slot
+uint32_t uart_rx_lines_posted = 0; // lines handed to main() as commands
+// with flow control on nothing gets dropped: while the next slot is busy we stop taking bytes, the FIFO fills up and the UART drops RTS
+bool uart_rx_stalled = false; // bytes are waiting in the uDMA buffer and the FIFO until main() frees a slot (uart_rx_resume)
+uint32_t uart_rx_stalls = 0; // times that happened
+
+// command dispatcher: every command is one entry in the const table below (it lives in flash), looked up by its name packed into a uint32_t
+// instead of an if/else chain comparing one character at a time, so adding commands doesn't make the lookup any slower
+
+// pack a command name of up to 4 characters into one 32 bit key, 'l' 'e' 'd' 's' -> 0x7364656C
+#define COMMAND_KEY(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+// what the dispatcher should do with the arguments before calling the handler
+#define ARG_NONE 0 // the handler gets the argument text as is
+#define ARG_NUMBER 1 // an optional decimal number, the handler gets has_number and number, anything else is rejected
+
+typedef void (*command_handler_t)(char *args, bool has_number, uint32_t number);
+
+typedef struct {
+    uint32_t key; // COMMAND_KEY of the name
+    command_handler_t handler;
+    uint8_t modes; // MODE_ bits this command is allowed in, otherwise it's treated like unknown input
+    uint8_t argument; // ARG_NONE or ARG_NUMBER
+} command_t;
+
+// read a decimal number at *text and move *text past it (and the spaces after it), returns false if there isn't one (or it doesn't fit in 32 bits)
+bool read_number(const char **text, uint32_t *number){
+    const char *next = *text;
+    uint32_t value = 0;
+
+    while (*next == ' '){
+        next++;
+    }
+    if (*next < '0' || *next > '9'){
+        return false;
+    }
+    while (*next >= '0' && *next <= '9'){
+        uint32_t digit = *next - '0';
+        if (value > (0xFFFFFFFF - digit)/10){
+            return false;
+        }
+        value = value*10 + digit;
+        next++;
+    }
+    while (*next == ' '){
+        next++;
+    }
+
+    *text = next;
+    *number = value;
+    return true;
+}
+
+// read a decimal number that is the whole text (trailing spaces are fine), returns false if the text isn't one
+bool parse_number(const char *text, uint32_t *number){
+    uint32_t value;
+
+    if (!read_number(&text, &value) || *text != '\0'){
+        return false;
+    }
+
+    *number = value;
+    return true;
+}
+
+// compare an argument word against a keyword
+bool argument_is(const char *args, const char *keyword){
+    while (*args != '\0' && *args == *keyword){
+        args++;
+        keyword++;
+    }
+    return (*keyword == '\0' && (*args == '\0' || *args == ' '));
+}
+
+// "echo" toggles echo mode, "echo on" and "echo off" set it directly
+void command_echo(char *args, bool has_number, uint32_t number){
+    short enable = !echo_enabled;
+    if (argument_is(args, "on")){
+        enable = 1;
+    }
+    else if (argument_is(args, "off")){
+        enable = 0;
+    }
+
+    echo_enabled = enable;
+    if (echo_enabled == 1){
+        uart_send_message(MSG_ECHO_ON);
+    }
+    else{
+        uart_send_message(MSG_ECHO_OFF);
+    }
+}
+
+// "stop" stops every task and goes back to the menu, "stop moni" stops just that one
+void command_stop(char *args, bool has_number, uint32_t number){
+    if (*args == '\0'){
+        for (int i = 0; i < TASK_COUNT; i++){
+            task_stop(&tasks[i]);
+        }
+    }
+    else{
+        task_t *task = NULL;
+        for (int i = 0; i < TASK_COUNT; i++){
+            if (argument_is(args, tasks[i].name)){
+                task = &tasks[i];
+            }
+        }
+        if (task == NULL || !task->running){
+            uart_send_message(MSG_STOP_UNKNOWN);
+            return;
+        }
+        task_stop(task);
+    }
+
+    uart_send_message(MSG_STOP);
+    if (task_modes() == MODE_IDLE){
+        menu_display();
+    }
+}
+
+// read the optional period of "moni 100" or "trng 5000", returns false (and tells the user) if it's out of range
+bool task_period(bool has_number, uint32_t number, uint32_t *period_ms){
+    *period_ms = has_number ? number : 1000; // one line every 1000ms unless asked otherwise
+    if (*period_ms < TASK_PERIOD_MIN_MS || *period_ms > TASK_PERIOD_MAX_MS){
+        uart_send_message(MSG_BAD_PERIOD);
+        return false;
+    }
+    return true;
+}
+
+// "leds" blinker mode
+void command_leds(char *args, bool has_number, uint32_t number){
+    // "leds 2" picks a pattern, "leds fade" and "leds dim 30" use the PWM timers, just "leds" keeps what we have
+    if (argument_is(args, "fade")){
+        led_pwm_on();
+        led_fade = true;
+    }
+    else if (argument_is(args, "dim")){
+        uint32_t level;
+        if (!parse_number(args + 3, &level) || level > LED_LEVEL_MAX){
+            uart_send_message(MSG_LEDS_BAD_LEVEL);
+            return;
+        }
+        led_pwm_on();
+        led_fade = false;
+        led_pwm_level(GPT1_BASE, level);
+        led_pwm_level(GPT2_BASE, level);
+    }
+    else if (*args != '\0'){
+        uint32_t pattern;
+        if (!parse_number(args, &pattern) || pattern < 1 || pattern > LED_PATTERN_COUNT){
+            uart_send_message(MSG_LEDS_UNKNOWN_PATTERN);
+            return;
+        }
+        led_pwm_off();
+        led_select_pattern(pattern - 1);
+    }
+
+    // in this specific case, it's safe to allow multiple inputs of "leds" since we are ONLY setting a flag here, we handle all the actual timing within the blinker task
+    // the point being, only really want to enforce the user manually stopping the LED mode -- you dont want the led light to suddenly toggle on and off too quickly (dangerous)
+    uart_send_message(MSG_LEDS_ON);
+    task_start(&tasks[TASK_LEDS], 0); // the blinker sets its own delay for every step
+}
+
+#define MONI_BATCH_MAX 64 // samples per batch packet
+
+bool moni_binary = false; // "moni bin" or "moni txt"
+bool moni_binary_started = false; // the start packet went out for the current run and format
+uint8_t moni_batch = 1; // samples per binary packet, 1 sends every sample on its own
+
+// change mode ("moni change 1 10"): check the BATMON update flags every MONI_CHANGE_POLL_MS and only report when a value moved past its threshold
+// BATMON measures on its own all the time, a poll that finds nothing new is a few dozen cycles and nothing goes out on the UART
+// a poll takes the latest reading, so a battery average is 16 polls (~13 s), a cell or a board warms up far slower than that, and waking up
+// only a little more often than "moni" once a second does with much less to do each time keeps the CPU asleep longer than plain "moni"
+#define MONI_CHANGE_POLL_MS 800
+#define MONI_CHANGE_TEMP_DEFAULT 1 // degrees C
+#define MONI_CHANGE_MV_DEFAULT 10 // millivolts
+#define MONI_OVERSAMPLE 16 // battery readings averaged per value, 16 readings of a Q8 value add up to Q12
+
+bool moni_change = false;
+uint32_t moni_change_temp_delta = MONI_CHANGE_TEMP_DEFAULT; // degrees C
+uint32_t moni_change_bat_delta; // Q12 volts
+bool moni_change_have_temp; // nothing is reported before the first temperature and the first full battery average
+bool moni_change_have_bat;
+int32_t moni_change_temp; // the values last reported (or measured, for the one that didn't change)
+uint32_t moni_change_bat;
+uint32_t moni_change_sum; // battery readings added up so far, Q8
+uint8_t moni_change_count;
+uint32_t moni_change_reports = 0;
+
+// forget everything measured, the next report has both values fresh
+void moni_change_reset(){
+    moni_change_have_temp = false;
+    moni_change_have_bat = false;
+    moni_change_sum = 0;
+    moni_change_count = 0;
+}
+uint32_t moni_samples = 0;
+uint32_t moni_bytes = 0; // bytes the monitor sent in either format (start packets too), for bytes per sample
+cycle_stats_t moni_encode_stats; // adding one sample to a batch
+cycle_stats_t moni_packet_stats; // CRC, COBS and queueing one binary packet
+
+// "moni" temperature and battery monitor mode, "moni 100" sets the period, "moni bin" and "moni txt" pick the output format (and keep it), like "moni bin 100"
+// "moni batch 32" sends binary packets of 32 samples each (like "moni bin", "moni batch 1" turns batching off)
+// "moni change" only reports changes of at least 1c or 10mV, "moni change 2 5" sets them to 2c and 5mV, "moni change off" (or any other moni command) goes back to every period
+void command_moni(char *args, bool has_number, uint32_t number){
+    bool keep_period = true;
+
+    if (argument_is(args, "change")){
+        const char *text = args + 6;
+        while (*text == ' '){
+            text++;
+        }
+
+        if (argument_is(text, "off")){
+            keep_period = false; // back to once a second, unless a period follows
+            args = (char *) text + 3;
+            while (*args == ' '){
+                args++;
+            }
+        }
+        else{
+            uint32_t temp_delta = MONI_CHANGE_TEMP_DEFAULT;
+            uint32_t mv_delta = MONI_CHANGE_MV_DEFAULT;
+            if (*text != '\0' && !read_number(&text, &temp_delta)){
+                text = "?";
+            }
+            if (*text != '\0' && !read_number(&text, &mv_delta)){
+                text = "?";
+            }
+            if (*text != '\0' || temp_delta < 1 || temp_delta > 100 || mv_delta < 1 || mv_delta > 1000){
+                uart_send_message(MSG_MONI_CHANGE_USAGE);
+                return;
+            }
+
+            moni_change_temp_delta = temp_delta;
+            moni_change_bat_delta = (mv_delta*4096 + 999) / 1000; // mV to Q12 volts, at least one step
+            moni_change = true;
+            moni_change_reset();
+            moni_binary_started = false;
+            uart_send_message(MSG_MONI_ON);
+            task_start(&tasks[TASK_MONI], MONI_CHANGE_POLL_MS);
+            return;
+        }
+    }
+    else if (argument_is(args, "batch")){
+        const char *size_text = args + 5;
+        uint32_t size;
+        if (!read_number(&size_text, &size) || size < 1 || size > MONI_BATCH_MAX){
+            uart_send_message(MSG_MONI_BATCH_USAGE);
+            return;
+        }
+        moni_batch = (uint8_t) size;
+        moni_binary = true;
+        moni_binary_started = false; // start over, a half full batch of the old size is dropped
+        args = (char *) size_text;
+    }
+    else if (argument_is(args, "bin") || argument_is(args, "txt")){
+        bool binary = (*args == 'b');
+        if (binary != moni_binary){
+            moni_binary_started = false; // a new binary stream starts with the start packet
+        }
+        moni_binary = binary;
+        args += 3;
+        while (*args == ' '){
+            args++;
+        }
+    }
+
+    // any other moni command leaves change mode, and its poll period isn't one anybody asked for
+    if (moni_change){
+        moni_change = false;
+        moni_binary_started = false;
+        keep_period = false;
+    }
+
+    if (*args != '\0'){
+        has_number = parse_number(args, &number);
+        if (!has_number){
+            uart_send_message(MSG_INVALID_NUMBER);
+            return;
+        }
+    }
+    else if (tasks[TASK_MONI].running && keep_period){
+        has_number = true; // just switching the format keeps the period
+        number = tasks[TASK_MONI].period_ms;
+    }
+
+    uint32_t period_ms;
+    if (!task_period(has_number, number, &period_ms)){
+        return;
+    }
+    if (period_ms != tasks[TASK_MONI].period_ms || !tasks[TASK_MONI].running){
+        moni_binary_started = false; // the decoder needs the new period
+    }
+    uart_send_message(MSG_MONI_ON);
+    task_start(&tasks[TASK_MONI], period_ms);
+}
+
+// raw TRNG output: "trng raw N" sends N bytes of TRNG output as binary, both 32 bit halves of every number, as fast as the TRNG and the UART go
+// "trng raw N frame" wraps them in frames so a reader can find the boundaries and check them:
+// 0xA5 0x5A, length (1 byte), payload, CRC-16/CCITT (poly 0x1021, init 0xFFFF) over length + payload, high byte first
+#define TRNG_RAW_CHUNK 64 // most payload bytes per write (and per frame)
+#define TRNG_RAW_MAX 1048576 // 1MB, about 18 minutes at 9600 baud
+#define TRNG_FRAME_SYNC1 0xA5
+#define TRNG_FRAME_SYNC2 0x5A
+
+uint32_t trng_raw_remaining = 0; // bytes the raw task still has to send
+bool trng_raw_framed = false;
+uint32_t trng_raw_bytes = 0; // size of the last (or current) request
+uint32_t trng_raw_start_ticks = 0;
+uint32_t trng_raw_ticks = 0; // GPT0 ticks the last request took from start to its last byte queued
+
+// the calibration sweep, one setting after the other for TRNG_CAL_WINDOW_MS each (see task_cal_thread)
+#define TRNG_CAL_WINDOW_MS 500 // a few hundred numbers even for the slowest setting, several APT windows
+bool trng_cal_verbose = false; // the sweep a trng command starts runs quietly, "trng cal" prints every setting
+bool trng_cal_done = false; // the sweep ran to the end once
+
+// the sweep takes TRNG_CAL_WINDOW_MS for every setting, so it only runs once somebody wants TRNG output: the first trng command starts it
+// behind itself, the numbers keep coming from whatever setting is being measured meanwhile
+void trng_cal_start(){
+    if (!trng_cal_done){
+        task_start(&tasks[TASK_CAL], 0); // already running just goes on
+    }
+}
+
+// "trng stat" shows the setting we run at and what the health tests and the TRNG's own alarms caught so far
+void trng_print_stat(){
+    uart_put_string("trng min ");
+    uart_put_number(trng_settings[trng_setting].min_samples);
+    uart_put_string(" clk ");
+    uart_put_number(trng_settings[trng_setting].clocks_per_sample);
+    uart_put_string(" numbers ");
+    uart_put_number(trng_numbers);
+    uart_put_string(" rct ");
+    uart_put_number(trng_rct_failures);
+    uart_put_string(" apt ");
+    uart_put_number(trng_apt_failures);
+    uart_put_string("\r\n");
+
+    uart_put_string("trng fro shutdowns ");
+    uart_put_number(trng_fro_shutdowns);
+    uart_put_string(" alarms ");
+    uart_put_number(trng_fro_alarms);
+    uart_put_string(" off now ");
+    uart_put_number((HWREG(TRNG_BASE + TRNG_O_ALARMCNT) & TRNG_ALARMCNT_SHUTDOWN_CNT_M) >> TRNG_ALARMCNT_SHUTDOWN_CNT_S);
+    uart_put_string("\r\n");
+}
+
+// "trng" random number mode, "trng 5000" sets the period, "trng raw N [frame]" sends raw bytes, "trng cal" and "trng stat" tune and check the TRNG
+void command_trng(char *args, bool has_number, uint32_t number){
+    if (argument_is(args, "stat")){
+        trng_print_stat();
+        return;
+    }
+
+    if (argument_is(args, "cal")){
+        uart_send_message(MSG_TRNG_CAL_ON);
+        trng_cal_verbose = true;
+        task_start(&tasks[TASK_CAL], 0); // already running (started by another trng command) just makes it talk
+        return;
+    }
+
+    if (argument_is(args, "raw")){
+        const char *count_text = args + 3;
+        uint32_t count;
+        if (!read_number(&count_text, &count) || count < 1 || count > TRNG_RAW_MAX){
+            uart_send_message(MSG_TRNG_RAW_USAGE);
+            return;
+        }
+        bool framed = argument_is(count_text, "frame");
+        if (!framed && *count_text != '\0'){
+            uart_send_message(MSG_TRNG_RAW_USAGE);
+            return;
+        }
+
+        trng_raw_remaining = count; // a running request is simply replaced
+        trng_raw_framed = framed;
+        trng_raw_bytes = count;
+        trng_raw_start_ticks = sw_timer_now();
+        trng_raw_ticks = 0;
+        task_start(&tasks[TASK_RAW], 0);
+        trng_cal_start();
+        return;
+    }
+
+    if (*args != '\0'){
+        has_number = parse_number(args, &number);
+        if (!has_number){
+            uart_send_message(MSG_INVALID_NUMBER);
+            return;
+        }
+    }
+    uint32_t period_ms;
+    if (!task_period(has_number, number, &period_ms)){
+        return;
+    }
+    uart_send_message(MSG_TRNG_ON);
+    task_start(&tasks[TASK_TRNG], period_ms);
+    trng_cal_start();
+}
+
+// "drbg 1000" prints 1000 random bytes from the DRBG in hex, "drbg reseed" reseeds it now and "drbg reseed 4096" sets the reseed interval in bytes
+#define DRBG_REQUEST_MAX 65536
+uint32_t drbg_remaining = 0; // bytes the drbg task still has to print
+
+void command_drbg(char *args, bool has_number, uint32_t number){
+    uint32_t value;
+
+    if (argument_is(args, "reseed")){
+        const char *interval = args + 6;
+        while (*interval == ' '){
+            interval++;
+        }
+        if (*interval == '\0'){
+            uart_send_message(drbg_reseed() ? MSG_DRBG_RESEEDED : MSG_TRNG_EMPTY);
+        }
+        else if (parse_number(interval, &value)){
+            drbg_reseed_interval = value;
+            uart_send_message(MSG_DRBG_INTERVAL);
+        }
+        else{
+            uart_send_message(MSG_DRBG_USAGE);
+        }
+        return;
+    }
+
+    if (!parse_number(args, &value) || value < 1 || value > DRBG_REQUEST_MAX){
+        uart_send_message(MSG_DRBG_USAGE);
+        return;
+    }
+    drbg_remaining = value; // a running request is simply replaced
+    task_start(&tasks[TASK_DRBG], 0);
+}
+
+// "ledl r 1000 o 400 g 1000" loads pattern 4: pairs of a colour (r = red, g = green, b = both, o = off) and how many milliseconds it stays on
+// the text is checked completely before anything is stored, a typo never leaves a half loaded pattern behind
+int led_parse_steps(const char *args, bool store){
+    int length = 0;
+
+    while (*args != '\0'){
+        uint32_t dout;
+        switch(*args){
+            case 'r':
+                dout = LED_RED;
+                break;
+            case 'g':
+                dout = LED_GREEN;
+                break;
+            case 'b':
+                dout = LED_BOTH;
+                break;
+            case 'o':
+                dout = LED_OFF;
+                break;
+            default:
+                return -1;
+        }
+        args++;
+
+        uint32_t duration;
+        if (!read_number(&args, &duration) || duration < LED_STEP_MIN_MS || duration > 60000 || length >= LED_USER_STEPS_MAX){
+            return -1;
+        }
+
+        if (store){
+            led_steps_user[length].dout = dout;
+            led_steps_user[length].duration_ms = (uint16_t) duration;
+        }
+        length++;
+    }
+    return length;
+}
+
+void command_ledl(char *args, bool has_number, uint32_t number){
+    int length = led_parse_steps(args, false);
+    if (length <= 0){
+        uart_send_message(MSG_LEDS_BAD_STEPS);
+        return;
+    }
+
+    led_parse_steps(args, true);
+    led_steps_user_length = (uint8_t) length;
+
+    // playing the loaded pattern right now, start it over so the step index can't point past its end
+    if (led_steps == led_steps_user){
+        led_select_pattern(LED_PATTERN_BUILT_IN);
+    }
+    uart_send_message(MSG_LEDS_LOADED);
+}
+
+// baud rate switching: "baud 115200" answers at the old rate, waits until that answer is completely out, and then switches
+// if no command comes in at the new rate within UART_BAUD_FALLBACK_MS (the terminal wasn't switched, or the link can't do it) we go back to 9600
+// the UART clock is 48 MHz and it samples 16 times per bit, so 3 Mbaud is the most it can do
+#define UART_BAUD_DEFAULT 9600
+#define UART_BAUD_FALLBACK_MS 5000
+#define UART_CLOCK 48000000
+
+const uint32_t uart_baud_rates[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000, 1500000, 3000000};
+#define UART_BAUD_RATE_COUNT (sizeof(uart_baud_rates) / sizeof(uart_baud_rates[0]))
+
+uint32_t uart_baud = UART_BAUD_DEFAULT;
+uint32_t uart_baud_next; // the rate the baud task switches to
+bool uart_baud_trial = false; // at a new rate and no command came in at it yet, run_command() clears it
+bool uart_baud_draining = false; // the baud task waits for the last bit to go out, tasks_poll() holds every other task meanwhile
+
+// reconfigure UART0, only while nothing is being sent, the FIFO levels, interrupts and uDMA settings stay as they are
+void uart_set_baud(uint32_t baud){
+    bool was_masked = critical_enter();
+    UARTDisable(UART0_BASE);
+    UARTConfigSetExpClk(UART0_BASE, UART_CLOCK, baud, UART_CONFIG_WLEN_8|UART_CONFIG_STOP_ONE|UART_CONFIG_PAR_NONE);
+    UARTEnable(UART0_BASE);
+    uart_baud = baud;
+    critical_exit(was_masked);
+}
+
+// "baud" shows the rate, "baud 115200" switches to it (see task_baud_thread)
+void command_baud(char *args, bool has_number, uint32_t number){
+    if (!has_number){
+        uart_put_string("baud ");
+        uart_put_number(uart_baud);
+        uart_put_string(", ");
+        uart_put_number(uart_baud / 10); // 8 data bits, a start and a stop bit
+        uart_put_string(" bytes/s\r\n");
+        return;
+    }
+
+    bool supported = false;
+    for (int i = 0; i < UART_BAUD_RATE_COUNT; i++){
+        supported |= (uart_baud_rates[i] == number);
+    }
+    if (!supported){
+        uart_send_message(MSG_BAUD_USAGE);
+        return;
+    }
+
+    uart_send_message(MSG_BAUD_SWITCHING);
+    uart_baud_next = number;
+    task_stop(&tasks[TASK_BAUD]); // a switch still waiting for its confirmation was just confirmed by this command, start over from here
+    task_start(&tasks[TASK_BAUD], 0);
+}
+
+// hardware flow control: with it on the UART drops RTS (IOID_18) while its RX FIFO is full, and holds our transmit while the other end drops CTS (IOID_19)
+// the pins are already routed by IOCPinTypeUart in setup_UART, the UART takes the change on the fly
+bool uart_flow = false;
+
+void uart_rx_resume();
+
+// "flow" toggles hardware flow control, "flow on" and "flow off" set it directly
+void command_flow(char *args, bool has_number, uint32_t number){
+    bool enable = !uart_flow;
+    if (argument_is(args, "on")){
+        enable = true;
+    }
+    else if (argument_is(args, "off")){
+        enable = false;
+    }
+
+    uart_flow = enable;
+    if (uart_flow){
+        UARTHwFlowControlEnable(UART0_BASE);
+        uart_send_message(MSG_FLOW_ON);
+    }
+    else{
+        UARTHwFlowControlDisable(UART0_BASE);
+        uart_rx_resume(); // bytes held back for a free slot go in now, without flow control a busy slot means the line is dropped again
+        uart_send_message(MSG_FLOW_OFF);
+    }
+}
+
+// "stat" shows the link: the rate, flow control and what went wrong on it so far ("prof clear" resets the counters)
+void command_stat(char *args, bool has_number, uint32_t number){
+    uart_put_string("uart ");
+    uart_put_number(uart_baud);
+    uart_put_string(" baud flow ");
+    uart_put_string(uart_flow ? "on" : "off");
+    uart_put_string("\r\n");
+
+    uart_put_string("rx bytes ");
+    uart_put_number(uart_rx_bytes);
+    uart_put_string(" lines ");
+    uart_put_number(uart_rx_lines_posted);
+    uart_put_string(" dropped ");
+    uart_put_number(uart_rx_lines_dropped);
+    uart_put_string(" stalls ");
+    uart_put_number(uart_rx_stalls);
+    uart_put_string("\r\n");
+
+    uart_put_string("rx errors overrun ");
+    uart_put_number(uart_rx_overruns);
+    uart_put_string(" framing ");
+    uart_put_number(uart_rx_framing_errors);
+    uart_put_string(" parity ");
+    uart_put_number(uart_rx_parity_errors);
+    uart_put_string(" break ");
+    uart_put_number(uart_rx_breaks);
+    uart_put_string("\r\n");
+
+    uart_put_string("tx dropped ");
+    uart_put_number(uart_tx_dropped);
+    uart_put_string("\r\n");
+}
+
+void command_prof(char *args, bool has_number, uint32_t number);
+
+/* UART serial input commands (end every command with enter):
+ * 1. "stop" will stop every running mode, "stop leds", "stop moni", "stop trng" and "stop drbg" stop just one
+ * 2. "echo" will enable echo inputs you make to UART serial output, "echo on" and "echo off" set it directly
+ * 3. "leds" - blinker mode, "leds 1" to "leds 4" picks the pattern, "leds fade" and "leds dim N" use PWM
+ * 3b. "ledl" - loads blink pattern 4, "ledl r 1000 o 400 g 1000"
+ * 4. "moni" - monitor mode to display temperature and voltage, "moni 100" every 100ms instead of every second, "moni bin", "moni batch N" and "moni txt" pick the format, "moni change [T MV]" only reports changes
+ * 5. "trng" - generates and provides a random number to you through UART, "trng 5000" every 5 seconds, "trng raw N [frame]" sends N raw bytes, "trng cal" and "trng stat" tune and check it
+ * 6. "prof" - prints the cycle profiler results, "prof clear" resets them
+ * 7. "drbg" - "drbg N" prints N random bytes from the TRNG seeded DRBG, "drbg reseed [N]" reseeds now or sets the interval
+ * 8. "baud" - "baud N" switches the UART to N baud, it goes back to 9600 unless a command comes in at the new rate
+ * 9. "flow" - hardware flow control (RTS/CTS), "flow on" and "flow off" set it directly
+ * 10. "stat" - the UART rate, flow control, and its receive and transmit error counters
+ */
+const command_t commands[] = {
+    {COMMAND_KEY('s','t','o','p'), command_stop, MODE_LEDS | MODE_MONI | MODE_TRNG | MODE_DRBG | MODE_CAL, ARG_NONE},
+    {COMMAND_KEY('e','c','h','o'), command_echo, MODE_ANY, ARG_NONE},
+    {COMMAND_KEY('l','e','d','s'), command_leds, MODE_ANY, ARG_NONE},
+    {COMMAND_KEY('l','e','d','l'), command_ledl, MODE_ANY, ARG_NONE},
+    {COMMAND_KEY('m','o','n','i'), command_moni, MODE_ANY, ARG_NONE}, // parses its own number, it also takes "bin" and "txt"
+    {COMMAND_KEY('t','r','n','g'), command_trng, MODE_ANY, ARG_NONE}, // parses its own number, it also takes "raw"
+    {COMMAND_KEY('p','r','o','f'), command_prof, MODE_ANY, ARG_NONE},
+    {COMMAND_KEY('d','r','b','g'), command_drbg, MODE_ANY, ARG_NONE},
+    {COMMAND_KEY('b','a','u','d'), command_baud, MODE_ANY, ARG_NUMBER},
+    {COMMAND_KEY('f','l','o','w'), command_flow, MODE_ANY, ARG_NONE},
+    {COMMAND_KEY('s','t','a','t'), command_stat, MODE_ANY, ARG_NONE},
+};
+#define COMMAND_COUNT (sizeof(commands)/sizeof(commands[0]))
+
+// hash table from key to table index, filled once by setup_Commands()
+// the multiplicative hash spreads the keys over the slots, with at most half of the slots used a lookup is one or two probes no matter how many commands there are
+// the slot count follows the table: the smallest power of 2 that's at least twice the number of commands, so there's always a free slot to stop a probe
+#define COMMAND_SLOT_BITS(n) ((n) <= 16 ? 4 : (n) <= 32 ? 5 : (n) <= 64 ? 6 : (n) <= 128 ? 7 : (n) <= 256 ? 8 : 9)
+#define COMMAND_BITS COMMAND_SLOT_BITS(2*COMMAND_COUNT)
+#define COMMAND_SLOTS (1u << COMMAND_BITS)
+uint8_t command_slots[COMMAND_SLOTS]; // table index + 1, 0 means empty
+_Static_assert(COMMAND_COUNT < 128, "command_slots keeps the table index + 1 in a byte");
+
+// per command profiler results, same order as the table
+cycle_stats_t command_stats[COMMAND_COUNT];
+cycle_stats_t unknown_command_stats;
+
+// the slot of a key in a table of 2^bits slots
+static inline uint32_t command_hash_slot(uint32_t key, uint32_t bits){
+    // 2^32 divided by the golden ratio (Knuth's multiplicative hashing), the top bits of the product are the best mixed
+    return (key * 0x9E3779B1) >> (32 - bits);
+}
+
+// fill the slots of a hash table for any command table, it takes the table and the slots as arguments so a bigger table
+// (the host lookup benchmark's) goes through the same code, for ours the constants fold in
+static inline void command_table_build(const command_t *table, uint32_t count, uint8_t *slots, uint32_t bits){
+    for (uint32_t i = 0; i < count; i++){
+        uint32_t slot = command_hash_slot(table[i].key, bits);
+        while (slots[slot] != 0){
+            slot = (slot + 1) & ((1u << bits) - 1); // taken, use the next free one
+        }
+        slots[slot] = i + 1;
+    }
+}
+
+// find a command by key in a table built by command_table_build(), returns NULL if there isn't one
+static inline const command_t *command_table_find(const command_t *table, const uint8_t *slots, uint32_t bits, uint32_t key){
+    uint32_t slot = command_hash_slot(key, bits);
 
-    /* Technical Reference table 16-3, TRNG initialization sequence (Page 1274)
-     * 1. Execute SW reset
-     * 2. Wait for SW completion by polling
-     * 3. Select number of FRO clock input cycles between 2 samples
-     * 4. Select the number of samples taken to gather enough entropy in the FROs of the module and to generate the first random value
-     * 5. Select the minimum number of samples taken regenerate entropy in the FROs of the module and to generate subsequent random values
-     * 6. Select the maximum number of samples taken regenerate entropy in the FROs of the module and to generate subsequent random values. Also defines timeout period for shutting down the FROs after inactivity
-     * 7. Configure the desired FROs to run 5% faster
-     * 8. Enable all FROs
-     * 9. Select the maximum number of samples after which a detected repeated pattern an alarm event is generated
-     * 10. Enable and start
-     */
+    while (slots[slot] != 0){
+        const command_t *command = &table[slots[slot] - 1];
+        if (command->key == key){
+            return command;
+        }
+        slot = (slot + 1) & ((1u << bits) - 1);
+    }
+    return NULL;
+}
 
-    TRNGReset(); // when you reset, it says you have to wait 5 clock cycles
+// build the hash table
+void setup_Commands(){
+    command_table_build(commands, COMMAND_COUNT, command_slots, COMMAND_BITS);
+}
 
-    // CPUDelay(2); // 6 clock cycles pass <- this is an incorrect way of doing it, you are losing 1 clock cycle this way
+// find a command by key, returns NULL if there isn't one
+const command_t *command_find(uint32_t key){
+    return command_table_find(commands, command_slots, COMMAND_BITS, key);
+}
 
-    // use direct register access mode to poll the bit
+// input we don't understand (or a command that isn't allowed right now)
+void command_unknown(){
+    if (tasks[TASK_LEDS].running){
+        uart_send_message(MSG_LEDS_ON);
+    }
+    else{
+        uart_send_message(MSG_NEWLINE);
+        menu_display();
+    }
+}
 
-    while ((HWREG(TRNG_BASE + TRNG_O_SWRESET) & 0x00000001) != 0); // wait until the last bit isn't equal to 1 anymore (back to 0)
+// run one complete command line, returns the profiler stats it should be counted in
+cycle_stats_t *run_command(char *line){
 
-    //configure the TRNG settings
-    TRNGConfigure(128, 16777216, 1); // minimum 128 = (2^7) samples per generated random number, maximum 16777216 = (2^24) samples per generated random number, and taking every 2nd sample generated
+    // split the line into the command word and its arguments: "echo on" -> word "echo", args "on"
+    char *word = line;
+    while (*word == ' '){
+        word++;
+    }
+    char *args = word;
+    while (*args != '\0' && *args != ' '){
+        args++;
+    }
+    int length = args - word;
+    while (*args == ' '){
+        args++;
+    }
 
-    // enable the TRNG after configuring it, it is always generating at the configured rate
-    TRNGEnable();
+    // every command name is 1 to 4 characters, pack it into the key
+    const command_t *command = NULL;
+    if (length >= 1 && length <= 4){
+        uint32_t key = 0;
+        for (int i = 0; i < length; i++){
+            key |= (uint32_t) ((uint8_t) word[i]) << (8*i);
+        }
+        command = command_find(key);
+    }
 
-    // wait until a rng is ready to be grabbed
-    while (TRNGStatusGet() != TRNG_NUMBER_READY);
+    if (command == NULL || !(command->modes & task_modes())){
+        command_unknown();
+        return &unknown_command_stats;
+    }
+    uart_baud_trial = false; // a command made it through at this baud rate, keep it
+
+    uint32_t number = 0;
+    bool has_number = false;
+    if (command->argument == ARG_NUMBER && *args != '\0'){
+        if (!parse_number(args, &number)){
+            uart_send_message(MSG_INVALID_NUMBER);
+            return &command_stats[command - commands];
+        }
+        has_number = true;
+    }
 
-    // now actually get the random number
-    random = TRNGNumberGet(TRNG_LOW_WORD);
+    command->handler(args, has_number, number);
+    return &command_stats[command - commands];
 }
 
-// set the UART interrupt handler, for when user inputs commands
-void UART_Interrupt_Handler(){
-
-    // if the UARTIntStatus isn't the status of received an interrupt, we return
-    if (UARTIntStatus(UART0_BASE, true) != UART_INT_RX){
+// the (prof) command, dump everything we measured so far
+void command_prof(char *args, bool has_number, uint32_t number){
+    // "prof clear" starts the measurements over, so a test run isn't mixed up with what happened before it
+    if (argument_is(args, "clear")){
+        bool was_masked = critical_enter();
+        uart_isr_stats = (cycle_stats_t) {0};
+        timer_isr_stats = (cycle_stats_t) {0};
+        trng_isr_stats = (cycle_stats_t) {0};
+        drbg_block_stats = (cycle_stats_t) {0};
+        trng_pool_empty = 0;
+        command_latency_stats = (cycle_stats_t) {0};
+        task_latency_stats = (cycle_stats_t) {0};
+        task_thread_stats = (cycle_stats_t) {0};
+        moni_encode_stats = (cycle_stats_t) {0};
+        moni_packet_stats = (cycle_stats_t) {0};
+        moni_samples = 0;
+        moni_bytes = 0;
+        moni_change_reports = 0;
+        for (int i = 0; i < COMMAND_COUNT; i++){
+            command_stats[i] = (cycle_stats_t) {0};
+        }
+        unknown_command_stats = (cycle_stats_t) {0};
+        sw_timer_late_max = 0;
+        sw_timer_missed = 0;
+        uart_rx_overruns = 0;
+        uart_rx_framing_errors = 0;
+        uart_rx_parity_errors = 0;
+        uart_rx_breaks = 0;
+        uart_rx_lines_dropped = 0;
+        uart_rx_lines_posted = 0;
+        uart_rx_bytes = 0;
+        uart_rx_stalls = 0;
+        uart_tx_dropped = 0;
+        uart_events.dropped = 0;
+        timer_events.dropped = 0;
+        critical_exit(was_masked);
+
+        uart_send_message(MSG_PROF_CLEARED);
         return;
     }
 
-    // clear the raised interrupt or we will loop forever
-    UARTIntClear(UART0_BASE, UART_INT_RX|UART_INT_TX);
+    // the report is well over 1KB, more than the TX buffer holds, so the prof task prints it one line at a time as the buffer drains
+    task_stop(&tasks[TASK_PROF]);
+    task_start(&tasks[TASK_PROF], 0);
+}
 
-    // we need to be able to store the 4 characters when this interrupt is raised
-    int32_t ch1;
-    int32_t ch2;
-    int32_t ch3;
-    int32_t ch4;
+// the cycle_stats lines at the top of the report
+typedef struct {
+    const char *name;
+    const cycle_stats_t *stats;
+} prof_line_t;
+
+const prof_line_t prof_lines[] = {
+    {"uart isr ", &uart_isr_stats},
+    {"timer isr", &timer_isr_stats},
+    {"trng isr ", &trng_isr_stats},
+    {"drbg blk ", &drbg_block_stats}, // 64 bytes per block
+    {"cmd wait ", &command_latency_stats}, // enter key in the ISR to the command starting in main()
+    {"task wait", &task_latency_stats},
+    {"task pt  ", &task_thread_stats}, // one call into a task's protothread and back, RAM per thread is sizeof(pt_t)
+    {"moni enc ", &moni_encode_stats}, // per sample in a batch
+    {"moni pkt ", &moni_packet_stats}, // per binary packet
+};
+#define PROF_LINES (sizeof(prof_lines)/sizeof(prof_lines[0]))
+
+#define PROF_LINE_MAX 80 // the longest line, "cmd xxxx calls N avg N max N cycles" with three 10 digit numbers is 68
+// wait until the next line fits, nothing of the report gets dropped however slow the baud rate is
+#define PROF_WAIT_LINE(task) PT_WAIT_UNTIL(&(task)->pt, uart_tx_room(PROF_LINE_MAX))
+
+uint8_t prof_index; // the line the prof task is at, protothread locals don't survive a wait
+
+// the (prof) report, started by command_prof
+int task_prof_thread(task_t *task){
+    PT_BEGIN(&task->pt);
+
+    for (prof_index = 0; prof_index < PROF_LINES; prof_index++){
+        PROF_WAIT_LINE(task);
+        print_cycle_stats(prof_lines[prof_index].name, prof_lines[prof_index].stats);
+    }
 
-    // different messages depending on the mode you enabled
-    char echo_on[] = "Echo mode on\r\n";
-    char echo_off[] = "Echo mode off\r\n";
-    char stop_msg[] = "Operation stopped - waiting for next input\r\n";
+    for (prof_index = 0; prof_index < COMMAND_COUNT; prof_index++){
+        PROF_WAIT_LINE(task);
 
-    char led_on[] = "LED blinker mode on\r\nPlease use (stop) to safely stop the blinker mode and return to the main menu\r\n(leds) ";
-    char moni_on[] = "Temperature and Battery monitor mode on\r\n";
-    char trng_on[] = "TRNG mode on\r\n";
+        // unpack the key back into the command name
+        char name[5];
+        for (int j = 0; j < 4; j++){
+            name[j] = (char) (commands[prof_index].key >> (8*j));
+        }
+        name[4] = '\0';
 
-    // we have our threshold set to 1/8 (which is 4 characters), so every single time this interrupt is raised, we will have 4 characters to read
+        uart_put_string("cmd ");
+        print_cycle_stats(name, &command_stats[prof_index]);
+    }
+    PROF_WAIT_LINE(task);
+    print_cycle_stats("cmd ????", &unknown_command_stats);
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("tx deferred ");
+    uart_put_number(uart_tx_deferred);
+    uart_put_string(" dropped ");
+    uart_put_number(uart_tx_dropped);
+    uart_put_string(" dma ");
+    uart_put_number(uart_tx_dma_bytes);
+    uart_put_string(" bytes\r\n");
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("timer late max ");
+    uart_put_number(sw_timer_late_max / (MS_TO_TICKS(1) / 1000)); // 3 ticks per microsecond
+    uart_put_string(" us missed ");
+    uart_put_number(sw_timer_missed);
+    uart_put_string("\r\n");
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("stack used ");
+    uart_put_number(stack_used());
+    uart_put_string(" of ");
+    uart_put_number((uint32_t) (&__STACK_END - &__stack) * sizeof(uint32_t));
+    uart_put_string(" bytes\r\n");
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("rx dma ");
+    uart_put_number(uart_rx_dma_bytes);
+    uart_put_string(" bytes overruns ");
+    uart_put_number(uart_rx_overruns);
+    uart_put_string(" lines dropped ");
+    uart_put_number(uart_rx_lines_dropped);
+    uart_put_string("\r\n");
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("events dropped uart ");
+    uart_put_number(uart_events.dropped);
+    uart_put_string(" timer ");
+    uart_put_number(timer_events.dropped);
+    uart_put_string("\r\n");
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("trng first ");
+    uart_put_number(trng_first_ticks / (MS_TO_TICKS(1) / 1000));
+    uart_put_string(" us pool ");
+    uart_put_number(trng_pool_count());
+    uart_put_string(" words empty ");
+    uart_put_number(trng_pool_empty);
+    uart_put_string(" fro shutdowns ");
+    uart_put_number(trng_fro_shutdowns);
+    uart_put_string("\r\n");
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("trng raw ");
+    uart_put_number(trng_raw_bytes - trng_raw_remaining);
+    uart_put_string(" of ");
+    uart_put_number(trng_raw_bytes);
+    uart_put_string(" bytes in ");
+    uart_put_number(trng_raw_ticks / MS_TO_TICKS(1));
+    uart_put_string(" ms\r\n");
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("moni samples ");
+    uart_put_number(moni_samples);
+    uart_put_string(" bytes ");
+    uart_put_number(moni_bytes);
+    uart_put_string(" change reports ");
+    uart_put_number(moni_change_reports);
+    uart_put_string("\r\n");
+
+    PROF_WAIT_LINE(task);
+    uart_put_string("drbg reseeds ");
+    uart_put_number(drbg_reseeds);
+    uart_put_string(" every ");
+    uart_put_number(drbg_reseed_interval);
+    uart_put_string(" bytes\r\n");
+
+    PT_END(&task->pt); // the task stops itself
+}
 
-    if(UARTCharsAvail(UART0_BASE)){
-        // get the 4 characters and store it
+// handle one received character: collect it into the line buffer, and run the line when enter is pressed
+void uart_rx_char(char c){
+    uart_rx_bytes++;
 
-        ch1 = UARTCharGetNonBlocking(UART0_BASE) & 0x000000FF;
-        ch2 = UARTCharGetNonBlocking(UART0_BASE) & 0x000000FF;
-        ch3 = UARTCharGetNonBlocking(UART0_BASE) & 0x000000FF;
-        ch4 = UARTCharGetNonBlocking(UART0_BASE) & 0x000000FF;
-    }
+    // terminals send \r, \n or both for enter, an empty line (the \n after a \r) is simply ignored
+    if (c == '\r' || c == '\n'){
+        if (uart_rx_length == 0 && !uart_rx_overflow && !uart_rx_dropping){
+            return;
+        }
 
-    /* UART serial input commands:
-     * 1. "stop" will stop the current mode's operation
-     * 2. "echo" will enable echo inputs you make to UART serial output
-     * 3. "leds" - blinker mode using one shot timer
-     * 4. "moni" - monitor mode to display temperature and voltage using one shot timer
-     * 5. "trng" - generates and provides a random number to you through UART
-     */
+        // echo user input back if echo mode is enabled
+        if (echo_enabled == 1){
+            uart_put_char('\r');
+            uart_put_char('\n');
+        }
 
-    // echo user input back if echo mode is enabled
-    if (echo_enabled == 1){
-        UARTCharPut(UART0_BASE, (uint8_t) (ch1));
-        UARTCharPut(UART0_BASE, (uint8_t) (ch2));
-        UARTCharPut(UART0_BASE, (uint8_t) (ch3));
-        UARTCharPut(UART0_BASE, (uint8_t) (ch4));
-        UARTCharPut(UART0_BASE, (uint8_t) ('\r'));
-        UARTCharPut(UART0_BASE, (uint8_t) ('\n'));
-    }
-
-    // if input is "echo" then enable echo mode
-    if (ch1 == 'e' && ch2 == 'c' && ch3 == 'h' && ch4 == 'o'){
-        if (echo_enabled == 0){
-            echo_enabled = 1;
-            for (int i = 0; i < sizeof(echo_on)/sizeof(echo_on[0]); i++){
-                UARTCharPut(UART0_BASE, (uint8_t) (echo_on[i]));
-            }
+        if (uart_rx_overflow){
+            uart_send_message(MSG_COMMAND_TOO_LONG);
+        }
+        else if (uart_rx_dropping || uart_rx_line_busy[uart_rx_slot]){
+            uart_rx_lines_dropped++; // main() is that far behind, there was nowhere to type this line into
         }
         else{
-            // if echo is already enabled, turn it off
-            echo_enabled = 0;
-            for (int i = 0; i < sizeof(echo_off)/sizeof(echo_off[0]); i++){
-                UARTCharPut(UART0_BASE, (uint8_t) (echo_off[i]));
+            uart_rx_lines[uart_rx_slot][uart_rx_length] = '\0';
+            uart_rx_line_busy[uart_rx_slot] = true;
+            if (event_post(&uart_events, EVENT_COMMAND, uart_rx_slot)){
+                uart_rx_slot = (uart_rx_slot + 1) & (UART_RX_LINES - 1);
+                uart_rx_lines_posted++;
+            }
+            else{
+                uart_rx_line_busy[uart_rx_slot] = false;
             }
         }
+
+        uart_rx_length = 0;
+        uart_rx_overflow = false;
+        uart_rx_dropping = false;
+        return;
     }
-    // set stopper flag if stopper is input
-    else if(ch1 == 's' && ch2 == 't' && ch3 == 'o' && ch4 == 'p' && stopper == 0 && currently_running == 1){
-        stopper = 1;
-        for (int i = 0; i < sizeof(stop_msg)/sizeof(stop_msg[0]); i++){
-            UARTCharPut(UART0_BASE, (uint8_t) (stop_msg[i]));
+
+    // backspace or delete removes the last character
+    if (c == '\b' || c == 0x7F){
+        if (uart_rx_length > 0){
+            uart_rx_length--;
+            if (echo_enabled == 1){
+                uart_write("\b \b", 3); // move back, blank it out, move back again
+            }
         }
+        return;
     }
 
-    // determine the mode and set flag, then output message to serial
-    else if (ch1 == 'l' && ch2 == 'e' && ch3 == 'd' && ch4 == 's'){
-        // in this specific case, it's safe to allow multiple inputs of "leds" since we are ONLY setting a flag here, we handle all the actual timing within the general purpose timer ISR
-        // the point being, only really want to enforce the user manually stopping the LED mode -- you dont want the led light to suddenly toggle on and off too quickly (dangerous)
-        mode = 'b';
-        for (int i = 0; i < sizeof(led_on)/sizeof(led_on[0]); i++){
-            UARTCharPut(UART0_BASE, (uint8_t) (led_on[i]));
-        }
+    // echo user input back if echo mode is enabled
+    if (echo_enabled == 1){
+        uart_put_char(c);
+    }
 
-        if (currently_running == 0){
-            currently_running = 1;
-            TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*0); // will jump to interrupt immediately when timer runs
-            TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-            TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
-        }
+    // keep one spot for the null terminator, and leave the slot alone while main() still has it
+    if (uart_rx_line_busy[uart_rx_slot]){
+        uart_rx_dropping = true;
+        return;
+    }
+    if (uart_rx_length < UART_RX_LINE_SIZE - 1){
+        uart_rx_lines[uart_rx_slot][uart_rx_length] = c;
+        uart_rx_length++;
+    }
+    else{
+        uart_rx_overflow = true;
+    }
+}
+
+// can uart_rx_char() take the next byte? with flow control on not while the slot it would go into is still busy, we stall instead
+bool uart_rx_ready(){
+    if (uart_flow && uart_rx_line_busy[uart_rx_slot]){
+        uart_rx_stalled = true;
+        uart_rx_stalls++;
+        // hold the uDMA off and stop the timeout, the bytes stay where they are (uDMA buffer, then the FIFO) and the FIFO filling up drops RTS
+        uDMAChannelAttributeEnable(UDMA0_BASE, UDMA_CHAN_UART0_RX, UDMA_ATTR_REQMASK);
+        UARTIntDisable(UART0_BASE, UART_INT_RT);
+        return false;
     }
-    else if (ch1 == 'm' && ch2 == 'o' && ch3 == 'n' && ch4 == 'i' && mode != 'b'){
+    return true;
+}
 
-        mode = 'm';
-        for (int i = 0; i < sizeof(moni_on)/sizeof(moni_on[0]); i++){
-            UARTCharPut(UART0_BASE, (uint8_t) (moni_on[i]));
+// feed the bytes the uDMA wrote into the current half, up to "filled", to the line buffer
+void uart_rx_dma_process(uint16_t filled){
+    while (uart_rx_dma_consumed < filled && !uart_rx_stalled){
+        if (!uart_rx_ready()){
+            return;
         }
+        uart_rx_char((char) (uart_rx_dma_buffer[uart_rx_dma_half][uart_rx_dma_consumed]));
+        uart_rx_dma_consumed++;
+        uart_rx_dma_bytes++;
+    }
+}
 
-        if (currently_running == 0){
-            currently_running = 1;
-            TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*0); // will jump to interrupt immediately when timer runs
-            TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-            TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
+// hand over every half the uDMA filled, oldest first, a half is only armed again once all of it was taken
+void uart_rx_dma_halves(){
+    // a finished half has its mode set back to "stop"
+    while (!uart_rx_stalled && uDMAChannelModeGet(UDMA0_BASE, UDMA_CHAN_UART0_RX | ((uart_rx_dma_half == 0) ? UDMA_PRI_SELECT : UDMA_ALT_SELECT)) == UDMA_MODE_STOP){
+        uart_rx_dma_process(UART_RX_DMA_HALF);
+        if (uart_rx_stalled){
+            return;
         }
+        uart_rx_dma_arm(uart_rx_dma_half);
+        uart_rx_dma_half ^= 1;
+        uart_rx_dma_consumed = 0;
+    }
 
+    // if both halves filled up before we got here the uDMA turned the channel off, the FIFO held on to the new bytes meanwhile
+    if (!uart_rx_stalled && !uDMAChannelIsEnabled(UDMA0_BASE, UDMA_CHAN_UART0_RX)){
+        uDMAChannelEnable(UDMA0_BASE, UDMA_CHAN_UART0_RX);
+    }
+}
+
+// the uDMA done interrupt for the RX channel: one (or if we were held up, both) halves are full
+void uart_rx_dma_done(){
+    uDMAIntClear(UDMA0_BASE, 1 << UDMA_CHAN_UART0_RX);
+    uart_rx_dma_halves();
+}
+
+// the receive timeout: the line went quiet, so hand over what the uDMA wrote so far plus the leftovers in the FIFO
+void uart_rx_dma_timeout(){
+    // hold the uDMA off while the CPU empties the FIFO, otherwise a new burst could jump ahead of the bytes we are reading
+    uDMAChannelAttributeEnable(UDMA0_BASE, UDMA_CHAN_UART0_RX, UDMA_ATTR_REQMASK);
+
+    // the current half might have just filled up, or filled up while we were stalled
+    uart_rx_dma_halves();
+
+    // the control structure counts down the bytes it still has room for
+    if (!uart_rx_stalled){
+        uint32_t remaining = uDMAChannelSizeGet(UDMA0_BASE, UDMA_CHAN_UART0_RX | ((uart_rx_dma_half == 0) ? UDMA_PRI_SELECT : UDMA_ALT_SELECT));
+        uart_rx_dma_process(UART_RX_DMA_HALF - remaining);
     }
-    else if (ch1 == 't' && ch2 == 'r' && ch3 == 'n' && ch4 == 'g' && mode != 'b'){
-        mode = 'r';
-        for (int i = 0; i < sizeof(trng_on)/sizeof(trng_on[0]); i++){
-            UARTCharPut(UART0_BASE, (uint8_t) (trng_on[i]));
-        }
 
-        if (currently_running == 0){
-            currently_running = 1;
-            TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*0); // will jump to interrupt immediately when timer runs
-            TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-            TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
+    while (!uart_rx_stalled && UARTCharsAvail(UART0_BASE) && uart_rx_ready()){
+        uart_rx_char((char) (UARTCharGetNonBlocking(UART0_BASE) & 0x000000FF));
+    }
+
+    // stalled, the uDMA stays held off until uart_rx_resume()
+    if (!uart_rx_stalled){
+        uDMAChannelAttributeDisable(UDMA0_BASE, UDMA_CHAN_UART0_RX, UDMA_ATTR_REQMASK);
+    }
+}
+
+// main() freed a line slot (or flow control went off): take the bytes that waited for it, then let the uDMA and the timeout carry on
+void uart_rx_resume(){
+    bool was_masked = critical_enter();
+    if (uart_rx_stalled){
+        uart_rx_stalled = false;
+        uart_rx_dma_timeout(); // might stall again right away if the line after this one needs another slot
+        if (!uart_rx_stalled){
+            UARTIntEnable(UART0_BASE, UART_INT_RT);
         }
+    }
+    critical_exit(was_masked);
+}
+
+// set the UART interrupt handler, for when user inputs commands
+void UART_Interrupt_Handler(){
+    uint32_t isr_start = cycles_now(); // profiler, measure the whole ISR
+
+    uint32_t status = UARTIntStatus(UART0_BASE, true);
+
+    // clear the raised interrupt or we will loop forever
+    UARTIntClear(UART0_BASE, status);
 
+    // the uDMA finished a transmit buffer
+    if (uDMAIntStatus(UDMA0_BASE) & (1 << UDMA_CHAN_UART0_TX)){
+        uart_tx_dma_done();
     }
-    else{
-        if (mode == 'b'){
-            for (int i = 0; i < sizeof(led_on)/sizeof(led_on[0]); i++){
-                UARTCharPut(UART0_BASE, (uint8_t) (led_on[i]));
-            }
+
+    // the TX FIFO has room again, keep the ring buffer draining
+    if (status & UART_INT_TX){
+        uart_tx_refill();
+    }
+
+    // the uDMA filled one half of the receive buffer
+    if (uDMAIntStatus(UDMA0_BASE) & (1 << UDMA_CHAN_UART0_RX)){
+        uart_rx_dma_done();
+    }
+
+    // RT (receive timeout) means characters are sitting in the FIFO below the threshold and nothing new arrived for a while
+    // take everything that's there right now in one go, commands can be any length and can be split over several interrupts
+    if (status & UART_INT_RT){
+        uart_rx_dma_timeout();
+    }
+
+    // receive errors, each kind has its own interrupt, so several of the same kind before we get here count once
+    // the uDMA reads the data register 8 bits at a time, the per character error bits above them are never seen, so these are all we get
+    if (status & (UART_INT_OE | UART_INT_FE | UART_INT_PE | UART_INT_BE)){
+        if (status & UART_INT_OE){
+            uart_rx_overruns++; // the FIFO overflowed, the character that didn't fit is gone
         }
-        else{
-            UARTCharPut(UART0_BASE, (uint8_t) ('\r'));
-            UARTCharPut(UART0_BASE, (uint8_t) ('\n'));
-            menu_display();
+        if (status & UART_INT_FE){
+            uart_rx_framing_errors++;
+        }
+        if (status & UART_INT_PE){
+            uart_rx_parity_errors++;
         }
+        if (status & UART_INT_BE){
+            uart_rx_breaks++;
+        }
+        UARTRxErrorClear(UART0_BASE);
     }
-    return;
 
+    cycle_stats_add(&uart_isr_stats, isr_start);
+}
 
 
-}
+// set up the uDMA, so the UART can move data to and from memory without the CPU
+void setup_DMA(){
+    // the uDMA lives in the peripheral power domain
+    PRCMPowerDomainOn(PRCM_DOMAIN_PERIPH);
+    while (PRCMPowerDomainStatus(PRCM_DOMAIN_PERIPH) != PRCM_DOMAIN_POWER_ON);
+
+    PRCMPeripheralRunEnable(PRCM_PERIPH_UDMA); // enable uDMA peripheral
+    PRCMPeripheralSleepEnable(PRCM_PERIPH_UDMA); // keep it running while the CPU sleeps, that's the whole point
+    PRCMLoadSet();
+    while (!PRCMLoadGet());
 
+    uDMAEnable(UDMA0_BASE);
+    uDMAControlBaseSet(UDMA0_BASE, udma_control_table);
+
+    // UART0 TX channel: normal priority, use the primary control structure only, and listen to the UART's requests
+    uDMAChannelAttributeDisable(UDMA0_BASE, UDMA_CHAN_UART0_TX, UDMA_ATTR_ALTSELECT | UDMA_ATTR_HIGH_PRIORITY | UDMA_ATTR_REQMASK);
+    // bytes, increment through the source buffer, always write the same data register, and re-arbitrate every 4 bytes (matches the 1/8 TX FIFO level)
+    uDMAChannelControlSet(UDMA0_BASE, UDMA_CHAN_UART0_TX | UDMA_PRI_SELECT, UDMA_SIZE_8 | UDMA_SRC_INC_8 | UDMA_DST_INC_NONE | UDMA_ARB_4);
+
+    // UART0 RX channel: high priority so receiving never waits behind a transmit, only burst requests, both control structures (ping-pong)
+    uDMAChannelAttributeDisable(UDMA0_BASE, UDMA_CHAN_UART0_RX, UDMA_ATTR_ALTSELECT | UDMA_ATTR_REQMASK);
+    uDMAChannelAttributeEnable(UDMA0_BASE, UDMA_CHAN_UART0_RX, UDMA_ATTR_USEBURST | UDMA_ATTR_HIGH_PRIORITY);
+    // bytes, always read the same data register, increment through the buffer, 2 bytes per burst (less than the 1/8 RX FIFO level, see UART_RX_DMA_HALF)
+    uDMAChannelControlSet(UDMA0_BASE, UDMA_CHAN_UART0_RX | UDMA_PRI_SELECT, UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_2);
+    uDMAChannelControlSet(UDMA0_BASE, UDMA_CHAN_UART0_RX | UDMA_ALT_SELECT, UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_2);
+    uart_rx_dma_arm(0);
+    uart_rx_dma_arm(1);
+    uDMAChannelEnable(UDMA0_BASE, UDMA_CHAN_UART0_RX);
+}
 
 // set up the UART for serial output and input
 void setup_UART(){
@@ -318,213 +2753,624 @@ void setup_UART(){
     while (!PRCMLoadGet()); // wait until the settings are loaded
 
     // 19.6 (page 1460) in the technical reference has it such that if you want to use the UART, you must follow these steps:
-        // 1. Enable UART Pins
-        IOCPinTypeUart(UART0_BASE , IOID_2, IOID_3, IOID_19, IOID_18);
+    // 1. Enable UART Pins
+    IOCPinTypeUart(UART0_BASE , IOID_2, IOID_3, IOID_19, IOID_18);
 
-        // 2. Disable UART
-        UARTDisable(UART0_BASE);
+    // 2. Disable UART
+    UARTDisable(UART0_BASE);
 
-        // 3. UART Configuration
-        UARTConfigSetExpClk(UART0_BASE,48000000,9600, UART_CONFIG_WLEN_8|UART_CONFIG_STOP_ONE|UART_CONFIG_PAR_NONE);
-        // disable flow control, we manually do everything
-        UARTHwFlowControlDisable(UART0_BASE);
+    // 3. UART Configuration
+    UARTConfigSetExpClk(UART0_BASE,UART_CLOCK,UART_BAUD_DEFAULT, UART_CONFIG_WLEN_8|UART_CONFIG_STOP_ONE|UART_CONFIG_PAR_NONE); // "baud" changes it later
+    // no flow control until "flow on", a terminal without the RTS/CTS wires would never get a character out of us
+    UARTHwFlowControlDisable(UART0_BASE);
 
-        // 4. Set FIFO Thresholds
-        UARTFIFOLevelSet    (UART0_BASE, UART_FIFO_TX1_8, UART_FIFO_RX1_8); // transmit threshold is 1/8, receive threshold is 1/8, which means every 4 characters (1/8 * 32 = 4)
+    // 4. Set FIFO Thresholds
+    UARTFIFOLevelSet    (UART0_BASE, UART_FIFO_TX1_8, UART_FIFO_RX1_8); // transmit threshold is 1/8, receive threshold is 1/8, which means every 4 characters (1/8 * 32 = 4), that's when the uDMA takes a burst
 
-        // 5. UART interrupt handler assignment
-        UARTIntRegister(UART0_BASE,     UART_Interrupt_Handler);  // setting "UART_Interrupt_Handler" to be the ISR that handles UART0 interrupts
+    // 5. UART interrupt handler assignment
+    UARTIntRegister(UART0_BASE,     UART_Interrupt_Handler);  // setting "UART_Interrupt_Handler" to be the ISR that handles UART0 interrupts
 
-        // 6. Enable Interrupts
-        UARTIntEnable(UART0_BASE , UART_INT_RX);  // after you set the ISR, you still have to enable it
+    // 6. Enable Interrupts
+    UARTIntEnable(UART0_BASE , UART_INT_RT);  // after you set the ISR, you still have to enable it, RT fires when characters sit in the FIFO below the threshold for 32 bit periods
+    UARTIntEnable(UART0_BASE, UART_INT_OE | UART_INT_FE | UART_INT_PE | UART_INT_BE); // receive errors, only counted (see UART_Interrupt_Handler)
+    UARTDMAEnable(UART0_BASE, UART_DMA_RX); // the uDMA takes care of the RX threshold, so no UART_INT_RX
 
-        // 7. Last step
-        UARTEnable(UART0_BASE);
+    // 7. Last step
+    UARTEnable(UART0_BASE);
 
 }
 
-void Timer_Interrupt_Handler(){
-    TimerIntClear(GPT0_BASE, TIMER_TIMA_TIMEOUT); // clear the raised interrupt or it will loop forever
+// blinker mode: step through the LED pattern, or fade, or hold a steady PWM level
+int task_leds_thread(task_t *task){
+    PT_BEGIN(&task->pt);
 
-    // we configured our 1 shot timer with 0 seconds, it will go to this interrupt immediately and display menu message, then return and stay in sleep until command entered
-    if(first_startup == 1){
-        first_startup = 0;
-        menu_display();
-        return;
+    while (1){
+        if (led_fade){
+            led_fade_step();
+            TASK_SLEEP(task, LED_FADE_STEP_MS); // between steps nothing runs, the PWM timers hold the duty cycle
+        }
+        else if (led_pwm){
+            PT_WAIT_UNTIL(&task->pt, led_fade || !led_pwm); // a steady dim level, the PWM timers do everything until a command changes it
+        }
+        else{
+            TASK_SLEEP(task, led_sequencer_step());
+        }
     }
-    else if(stopper == 1){
-        //stop input is made, stop the system and reset everything
-        currently_running = 0;
-        blinker_period = 0;
-        stopper = 0;
 
-        if (mode == 'b'){
-            (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) &=0x00000000); // all lights off
+    PT_END(&task->pt);
+}
+
+// the blinker was stopped, lights off and the pins back to GPIO
+void leds_stopped(){
+    led_step = 0;
+    led_pwm_off(); // back to GPIO if the PWM timers had the pins
+    (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) &=0x00000000); // all lights off
+}
+
+// CRC-16/CCITT, the one most serial tools know, one bit at a time is plenty for 64 byte frames up to 921600 baud
+// (at 3000000 a framed "trng raw" keeps the CPU busy and gets ~80% of the line, see tools/hostsim/bench_trng_raw.c)
+uint16_t crc16_ccitt(uint16_t crc, const uint8_t *data, uint32_t length){
+    for (uint32_t i = 0; i < length; i++){
+        crc ^= (uint16_t) data[i] << 8;
+        for (int bit = 0; bit < 8; bit++){
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
         }
-        mode = ' ';
-        menu_display();
-        return;
     }
+    return crc;
+}
 
+// COBS (consistent overhead byte stuffing): the packet gets one extra byte in front (and one more every 254 bytes) and loses all its zeros,
+// so a single 0x00 after it marks the end, a reader that starts in the middle of the stream finds the next packet at the next zero
+// out needs room for length + length/254 + 1 bytes, returns how many were written (without the 0x00 delimiter)
+uint32_t cobs_encode(const uint8_t *data, uint32_t length, uint8_t *out){
+    uint32_t code_at = 0; // where the current block's code byte goes, it's the distance to the next zero
+    uint32_t written = 1;
+    uint8_t code = 1;
+
+    for (uint32_t i = 0; i < length; i++){
+        if (data[i] != 0){
+            out[written++] = data[i];
+            code++;
+        }
+        if (data[i] == 0 || code == 0xFF){
+            out[code_at] = code;
+            code_at = written++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    return written;
+}
 
-    // it's not the first_startup or stopper, check to see if we'll be blinking, temperature/battery monitor, or TRNG output
-
-    switch(mode){
+// binary monitor packets ("moni bin"), all fields little endian, COBS framed and ended by 0x00:
+// sequence (2 bytes, +1 per packet, gaps are lost packets), type (1 byte), payload, CRC-16/CCITT over everything before it (high byte first)
+// MONI_PACKET_START: the period in ms (4 bytes), sent when binary output starts, in the same period as sample 1, sample n was taken n - 1 periods after it (the timer doesn't drift)
+// MONI_PACKET_SAMPLE: the raw AON_BATMON readings, TEMP INT as a signed degree C (2 bytes) and BAT (2 bytes, volts in Q8), one period after the sample
+// before it, one that comes later than that (the task was held up, by a full TX buffer say) goes out as a batch of one instead, with its number
+// MONI_PACKET_BATCH: the number of its first sample since the start packet (4 bytes, the first one is 1), the sample count (1 byte),
+// sample first + i is the i-th after it, one period apart (a hold-up ends the batch early), the first sample in full like MONI_PACKET_SAMPLE
+// (the keyframe), then every next sample as the change from the one before it:
+// a varint of zigzag(battery change) << 1 | temperature changed, followed by a varint of zigzag(temperature change) if it did
+// varints are 7 bits per byte, low bits first, the top bit says another byte follows, zigzag maps 0, -1, 1, -2... to 0, 1, 2, 3... so small changes either way stay small
+// both readings hardly ever change, so a steady sample is a single 0x00 byte (and COBS takes care of those)
+// MONI_PACKET_CHANGE ("moni change"): the poll it was found at since the start packet (4 bytes, same timing as the sample numbers),
+// the temperature in degrees C from AONBatMonTemperatureGetDegC (2 bytes) and the averaged battery voltage in Q12 (2 bytes)
+#define MONI_PACKET_START 1
+#define MONI_PACKET_SAMPLE 2
+#define MONI_PACKET_BATCH 3
+#define MONI_PACKET_CHANGE 4
+#define MONI_BATCH_HEADER 9 // first sample number, count and the keyframe
+#define MONI_DELTA_MAX 4 // 13 bits of battery change and flag, 10 bits of temperature change, 2 varint bytes each
+#define MONI_PACKET_MAX (3 + MONI_BATCH_HEADER + (MONI_BATCH_MAX - 1)*MONI_DELTA_MAX + 2) // the longest packet before framing
+#define MONI_FRAME_MAX (MONI_PACKET_MAX + MONI_PACKET_MAX/254 + 2) // COBS code byte(s) and the 0x00
+
+uint16_t moni_sequence = 0;
+uint8_t moni_packet[MONI_PACKET_MAX];
+uint8_t moni_frame[MONI_FRAME_MAX];
+uint32_t moni_stream_samples; // samples since the start packet
+uint8_t moni_batch_count = 0; // samples in the batch being built in moni_packet
+uint32_t moni_batch_length; // its payload bytes so far
+int16_t moni_batch_temp; // the sample before, the next one is sent as the change from it
+uint16_t moni_batch_bat;
+
+// add the header, CRC and framing to the payload already in moni_packet[3..] and send it
+void moni_send_packet(uint8_t type, uint32_t payload_length){
+    uint32_t packet_start = cycles_now();
+    moni_packet[0] = (uint8_t) moni_sequence;
+    moni_packet[1] = (uint8_t) (moni_sequence >> 8);
+    moni_packet[2] = type;
+    uint32_t length = 3 + payload_length;
+    uint16_t crc = crc16_ccitt(0xFFFF, moni_packet, length);
+    moni_packet[length++] = (uint8_t) (crc >> 8);
+    moni_packet[length++] = (uint8_t) crc;
+
+    uint32_t frame_length = cobs_encode(moni_packet, length, moni_frame);
+    moni_frame[frame_length++] = 0x00;
+    uart_write((const char *) moni_frame, frame_length);
+
+    moni_sequence++;
+    moni_bytes += frame_length;
+    cycle_stats_add(&moni_packet_stats, packet_start);
+}
 
-    /*        (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) &=0x00000000); // all lights off
-     *        (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) |= 0x01010000); // all lights on
+// append a varint to the batch payload
+void moni_put_varint(uint32_t value){
+    while (value >= 0x80){
+        moni_packet[3 + moni_batch_length++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    moni_packet[3 + moni_batch_length++] = (uint8_t) value;
+}
 
-            //(HWREG(GPIO_BASE + GPIO_O_DOUT7_4) |=0x01000000); //green light on
-            //(HWREG(GPIO_BASE + GPIO_O_DOUT7_4) |=0x00010000); // red light on
-    */
-        case 'b':
+static inline uint32_t zigzag(int32_t value){
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31); // the sign ends up in bit 0
+}
 
-            switch(blinker_period){
-                case 0:
-                    // red light on 1000 ms
-                    blinker_period = 1;
+// add one sample to the batch in moni_packet, the first one of a batch is the keyframe
+void moni_batch_add(int16_t temp, uint16_t bat){
+    uint32_t encode_start = cycles_now();
 
-                    (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) |= 0x00010000); // red light on
+    if (moni_batch_count == 0){
+        for (int i = 0; i < 4; i++){
+            moni_packet[3 + i] = (uint8_t) (moni_stream_samples >> (8*i));
+        }
+        moni_packet[8] = (uint8_t) temp;
+        moni_packet[9] = (uint8_t) ((uint16_t) temp >> 8);
+        moni_packet[10] = (uint8_t) bat;
+        moni_packet[11] = (uint8_t) (bat >> 8);
+        moni_batch_length = MONI_BATCH_HEADER;
+    }
+    else{
+        int32_t temp_change = temp - moni_batch_temp;
+        moni_put_varint((zigzag(bat - moni_batch_bat) << 1) | (temp_change != 0));
+        if (temp_change != 0){
+            moni_put_varint(zigzag(temp_change));
+        }
+    }
 
-                    TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*1000); // 1000ms
-                    TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-                    TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
-                    break;
+    moni_batch_temp = temp;
+    moni_batch_bat = bat;
+    moni_batch_count++;
+    moni_packet[7] = moni_batch_count;
+    cycle_stats_add(&moni_encode_stats, encode_start);
+}
 
-                case 1:
-                    // all lights off 400ms
-                    blinker_period = 2;
+// send the batch as it is, even if it isn't full
+void moni_batch_flush(){
+    moni_send_packet(MONI_PACKET_BATCH, moni_batch_length);
+    moni_batch_count = 0;
+}
 
-                    (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) &=0x00000000); // all lights off
+// change mode: take whatever BATMON measured since the last poll (reading the update flags clears them), returns true if it's time to report
+bool moni_change_poll(){
+    bool report = false;
+
+    if (AONBatMonNewTempMeasureReady()){
+        int32_t temp = AONBatMonTemperatureGetDegC();
+        int32_t change = temp - moni_change_temp;
+        if (!moni_change_have_temp || change >= (int32_t) moni_change_temp_delta || -change >= (int32_t) moni_change_temp_delta){
+            moni_change_temp = temp;
+            moni_change_have_temp = true;
+            report = true;
+        }
+    }
 
-                    TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*400); // 400ms
-                    TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-                    TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
-                    break;
+    // one reading moves in 3.9mV steps, the average of 16 noisy ones resolves about 0.25mV
+    if (AONBatMonNewBatteryMeasureReady()){
+        moni_change_sum += AONBatMonBatteryVoltageGet();
+        moni_change_count++;
+        if (moni_change_count == MONI_OVERSAMPLE){
+            uint32_t bat = moni_change_sum; // already Q12, the sum of 16 is the average times 16
+            moni_change_sum = 0;
+            moni_change_count = 0;
+
+            uint32_t change = (bat > moni_change_bat) ? bat - moni_change_bat : moni_change_bat - bat;
+            if (!moni_change_have_bat || change >= moni_change_bat_delta){
+                moni_change_bat = bat;
+                moni_change_have_bat = true;
+                report = true;
+            }
+        }
+    }
 
-                case 2:
-                    // green light on 1000ms
-                    blinker_period = 3;
+    return report && moni_change_have_temp && moni_change_have_bat;
+}
 
-                    (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) |=0x01000000); //green light on
+// the raw temperature, the signed 9 bit INT field of AON_BATMON TEMP without the voltage correction AONBatMonTemperatureGetDegC does
+int16_t moni_temperature_raw(){
+    uint32_t temp = HWREG(AON_BATMON_BASE + AON_BATMON_O_TEMP) & AON_BATMON_TEMP_INT_M;
+    return (int16_t) (((int32_t) (temp << (32 - 9 - AON_BATMON_TEMP_INT_S))) >> (32 - 9)); // move the sign bit to bit 31 and back down
+}
 
-                    TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*1000); // 1000ms
-                    TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-                    TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
-                    break;
-                case 3:
-                    // all lights off 400 ms
-                    blinker_period = 4;
+// the longest line the monitor and TRNG modes print, we wait for this much TX space instead of dropping half a line
+#define TASK_LINE_MAX 32 // the worst case is "-2147483648c 8388607.99v\n\r", 26 characters
 
-                    (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) &=0x00000000); // all lights off
+// battery monitor mode
+int task_moni_thread(task_t *task){
+    PT_BEGIN(&task->pt);
 
-                    TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*400); // 400ms
-                    TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-                    TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
-                    break;
-                case 4:
-                    // red + green light on 1000ms
-                    blinker_period = 5;
+    while (1){
+        TASK_WAIT_TICK(task); // periodic timer: the next line is due exactly one period after this one was due, however long we took
+        PT_WAIT_UNTIL(&task->pt, uart_tx_room(TASK_LINE_MAX)); // the TX interrupt wakes us up as the buffer drains
+        TASK_TAKE_TICKS(task); // the sample is taken now, its number has to say so
+
+        // change mode: most polls end right here, nothing new or nothing that moved far enough
+        if (moni_change){
+            moni_stream_samples += task->elapsed; // the polls we were held up for count too
+            if (!moni_change_poll()){
+                continue;
+            }
+            moni_change_reports++;
+        }
 
-                    (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) |= 0x01010000); // all lights on
+        if (moni_binary){
+            if (!moni_binary_started){
+                moni_binary_started = true;
+                uart_put_char(0x00); // ends whatever text came before (like the mode message), so it can't run into the start packet
+                uint32_t period_ms = task->period_ms;
+                for (int i = 0; i < 4; i++){
+                    moni_packet[3 + i] = (uint8_t) (period_ms >> (8*i));
+                }
+                moni_send_packet(MONI_PACKET_START, 4);
+                moni_stream_samples = moni_change ? 1 : 0; // in change mode the poll we're in was already counted
+                moni_batch_count = 0; // the start packet just used the buffer
+            }
 
-                    TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*1000); // 1000ms
-                    TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-                    TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
-                    break;
+            if (moni_change){
+                for (int i = 0; i < 4; i++){
+                    moni_packet[3 + i] = (uint8_t) (moni_stream_samples >> (8*i));
+                }
+                moni_packet[7] = (uint8_t) moni_change_temp;
+                moni_packet[8] = (uint8_t) ((uint32_t) moni_change_temp >> 8);
+                moni_packet[9] = (uint8_t) moni_change_bat;
+                moni_packet[10] = (uint8_t) (moni_change_bat >> 8);
+                moni_send_packet(MONI_PACKET_CHANGE, 8);
+                moni_samples++;
+                continue;
+            }
 
-                case 5:
-                    // all lights off 400 ms
-                    blinker_period = 0;
+            // a batch's samples are a period apart from its first, after a hold-up the batch so far goes out and the next one starts with the right number
+            if (moni_batch > 1 && moni_batch_count > 0 && task->elapsed > 1){
+                PT_WAIT_UNTIL(&task->pt, uart_tx_room(MONI_FRAME_MAX));
+                moni_batch_flush();
+                TASK_TAKE_TICKS(task);
+            }
 
-                    (HWREG(GPIO_BASE + GPIO_O_DOUT7_4) &=0x00000000); // all lights off
+            int16_t temp = moni_temperature_raw();
+            uint16_t bat = (uint16_t) AONBatMonBatteryVoltageGet();
+            // the sample's number counts the periods since the start packet, the ones we were held up for too, sample 1 goes with the start packet
+            bool late = moni_stream_samples != 0 && task->elapsed > 1;
+            moni_stream_samples += (moni_stream_samples == 0) ? 1 : task->elapsed;
+            moni_samples++;
+
+            if (moni_batch > 1){
+                moni_batch_add(temp, bat);
+                if (moni_batch_count >= moni_batch){
+                    PT_WAIT_UNTIL(&task->pt, uart_tx_room(MONI_FRAME_MAX)); // a full batch of big changes is a few hundred bytes
+                    moni_batch_flush();
+                }
+                continue;
+            }
 
-                    TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*400); // 400ms
-                    TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-                    TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
-                    break;
+            if (late){
+                moni_batch_add(temp, bat); // a batch of one, a sample packet has no number and the decoder would put it a period after the last
+                moni_batch_flush();
+                continue;
             }
-            // blinker mode done
-            break;
 
+            moni_packet[3] = (uint8_t) temp;
+            moni_packet[4] = (uint8_t) ((uint16_t) temp >> 8);
+            moni_packet[5] = (uint8_t) bat;
+            moni_packet[6] = (uint8_t) (bat >> 8);
+            moni_send_packet(MONI_PACKET_SAMPLE, 4);
+            continue;
+        }
 
-        // battery monitor mode
-        case 'm':
+        char line[TASK_LINE_MAX];
+        int length;
+        if (moni_change){
+            // "25c 3.2817v", the average has 4 more fraction bits, so it gets 2 more places
+            length = format_i32(line, moni_change_temp);
+            line[length++] = 'c';
+            line[length++] = ' ';
+            length += format_fixed(&line[length], (int32_t) moni_change_bat, 12, 4);
+        }
+        else{
             voltage = AONBatMonBatteryVoltageGet();
             temperature = AONBatMonTemperatureGetDegC();
 
-            short first_temp = temperature/10;
-            short second_temp = temperature%10;
+            // "25c 3.28v", the temperature can be negative or 3 digits, and the voltage is Q8 (3 integer bits and 8 fraction bits), rounded to 2 places
+            length = format_i32(line, temperature);
+            line[length++] = 'c';
+            line[length++] = ' ';
+            length += format_fixed(&line[length], (int32_t) voltage, 8, 2);
+        }
+        line[length++] = 'v';
+        line[length++] = '\n';
+        line[length++] = '\r';
+
+        uart_write(line, length);
+        moni_samples++;
+        moni_bytes += length;
+    }
+
+    PT_END(&task->pt);
+}
+
+// switch the baud rate once the acknowledgement is out, and go back to 9600 if nobody talks to us at the new one
+int task_baud_thread(task_t *task){
+    PT_BEGIN(&task->pt);
+
+    // the other tasks hold their output until the switch, a busy monitor would otherwise keep the TX side from ever going idle
+    uart_baud_draining = true;
+    PT_WAIT_UNTIL(&task->pt, uart_tx_flushed()); // the TX interrupts wake us up while the buffers drain
+    PT_POLL_UNTIL(&task->pt, uart_tx_idle()); // no interrupt tells us when the last bit left the shift register, so main() keeps polling, for 33 characters at most
+    uart_set_baud(uart_baud_next);
+    uart_baud_draining = false;
+
+    if (uart_baud != UART_BAUD_DEFAULT){
+        uart_baud_trial = true;
+        uart_send_message(MSG_BAUD_CHANGED);
+
+        sw_timer_start(&task->timer, UART_BAUD_FALLBACK_MS, 0);
+        task->ticks = 0;
+        PT_WAIT_UNTIL(&task->pt, task->ticks != 0 || !uart_baud_trial);
+
+        if (uart_baud_trial){
+            uart_baud_trial = false;
+            uart_baud_draining = true;
+            PT_WAIT_UNTIL(&task->pt, uart_tx_flushed());
+            PT_POLL_UNTIL(&task->pt, uart_tx_idle());
+            uart_set_baud(UART_BAUD_DEFAULT);
+            uart_baud_draining = false;
+            uart_send_message(MSG_BAUD_FALLBACK);
+        }
+    }
+
+    PT_END(&task->pt); // the task stops itself
+}
 
-            short first_volt = voltage >> 8; // integer part of voltage is reserved with 3 bits
-            short second_volt = ((voltage & 0xFF) * 100)/256;  // the fractional part for the voltage is 8 bits, and we want to scale it, then we can output it character by character i.e. (fractional * 100)/256
+// a switch that was stopped (or restarted by another "baud") lets the other tasks carry on
+void baud_stopped(){
+    uart_baud_draining = false;
+}
 
-            short frac_volt1 = second_volt/10;
-            short frac_volt2 = second_volt%10;
+// the monitor was stopped, send the samples of a half full batch if they fit, the next run starts with a start packet again
+void moni_stopped(){
+    if (moni_binary_started && moni_batch_count > 0 && uart_tx_space() >= MONI_FRAME_MAX){
+        moni_batch_flush();
+    }
+    moni_batch_count = 0;
+    moni_binary_started = false;
+    moni_change_reset(); // a restart reports right away again
+}
 
+// TRNG mode
+int task_trng_thread(task_t *task){
+    PT_BEGIN(&task->pt);
 
+    while (1){
+        TASK_WAIT_TICK(task); // periodic timer, same as the monitor mode
 
-            UARTCharPut(UART0_BASE, (uint8_t) (first_temp + '0'));
-            UARTCharPut(UART0_BASE, (uint8_t) (second_temp + '0'));
-            UARTCharPut(UART0_BASE,'c');
+        PT_WAIT_UNTIL(&task->pt, uart_tx_room(TASK_LINE_MAX));
 
-            UARTCharPut(UART0_BASE, ' ');
+        // now actually get the random number, the pool only runs dry if we ask faster than the TRNG makes them
+        if (!trng_pool_take(&random)){
+            uart_send_message(MSG_TRNG_EMPTY);
+            continue;
+        }
 
-            UARTCharPut(UART0_BASE, (uint8_t) (first_volt + '0'));
-            UARTCharPut(UART0_BASE, '.');
-            UARTCharPut(UART0_BASE, (uint8_t) (frac_volt1 + '0'));
-            UARTCharPut(UART0_BASE, (uint8_t) (frac_volt2 + '0'));
-            UARTCharPut(UART0_BASE,'v');
+        char line[TASK_LINE_MAX];
+        int length = format_u32(line, random); // a 0 used to print as an empty line
+        line[length++] = '\n';
+        line[length++] = '\r';
 
-            UARTCharPut(UART0_BASE, '\n');
-            UARTCharPut(UART0_BASE, '\r');
+        uart_write(line, length);
+    }
 
-            TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*1000); // 1000ms
-            TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-            TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
+    PT_END(&task->pt);
+}
 
+// DRBG output: 32 bytes per line in hex, as fast as the UART takes them
+#define DRBG_LINE_BYTES 32
+uint8_t drbg_line_bytes[DRBG_LINE_BYTES]; // not on the stack, the ChaCha20 block below us needs it
+char drbg_line[2*DRBG_LINE_BYTES + 2];
 
+int task_drbg_thread(task_t *task){
+    PT_BEGIN(&task->pt);
 
+    while (drbg_remaining > 0){
+        PT_WAIT_UNTIL(&task->pt, uart_tx_room(2*DRBG_LINE_BYTES + 2));
 
-            break;
+        uint32_t count = (drbg_remaining < DRBG_LINE_BYTES) ? drbg_remaining : DRBG_LINE_BYTES;
+        if (!drbg_generate(drbg_line_bytes, count)){
+            uart_send_message(MSG_TRNG_EMPTY);
+            PT_WAIT_UNTIL(&task->pt, trng_pool_count() >= DRBG_SEED_WORDS); // the TRNG interrupt wakes us up as the pool fills
+            continue;
+        }
 
-        // TRNG mode
-        case 'r':
-            // wait until a rng is ready to be grabbed
-            while (TRNGStatusGet() != TRNG_NUMBER_READY);
+        int length = 0;
+        for (uint32_t i = 0; i < count; i++){
+            length += format_hex(&drbg_line[length], drbg_line_bytes[i], 2);
+        }
+        drbg_line[length++] = '\r';
+        drbg_line[length++] = '\n';
+        uart_write(drbg_line, length);
+
+        drbg_remaining -= count;
+    }
+
+    PT_END(&task->pt); // the task stops itself
+}
+
+uint8_t trng_raw_frame[3 + TRNG_RAW_CHUNK + 2]; // sync, length, payload, CRC, not on the stack
 
-            // now actually get the random number
-            random = TRNGNumberGet(TRNG_LOW_WORD);
+// raw TRNG output: take whatever the pool has (up to a chunk) and send it, the TRNG and TX interrupts wake us up for more
+int task_raw_thread(task_t *task){
+    PT_BEGIN(&task->pt);
 
-            // loop and get every number character by character and store it, but it will be stored backwards
-            int holder = 0;
-            while(random > 0){
-                random_str[holder] = random%10 + '0';
-                random = random/10;
-                holder ++;
+    while (trng_raw_remaining > 0){
+        PT_WAIT_UNTIL(&task->pt, trng_pool_count() > 0 && uart_tx_room(sizeof(trng_raw_frame)));
+
+        uint8_t *payload = &trng_raw_frame[3];
+        uint32_t length = 0;
+        uint32_t word;
+        while (length < TRNG_RAW_CHUNK && length < trng_raw_remaining && trng_pool_take(&word)){
+            // every byte of the word, little endian, the last word of a request may only be partly used
+            for (int i = 0; i < 4 && length < TRNG_RAW_CHUNK && length < trng_raw_remaining; i++){
+                payload[length] = (uint8_t) (word >> (8*i));
+                length++;
             }
+        }
 
+        if (trng_raw_framed){
+            trng_raw_frame[0] = TRNG_FRAME_SYNC1;
+            trng_raw_frame[1] = TRNG_FRAME_SYNC2;
+            trng_raw_frame[2] = (uint8_t) length;
+            uint16_t crc = crc16_ccitt(0xFFFF, &trng_raw_frame[2], length + 1);
+            trng_raw_frame[3 + length] = (uint8_t) (crc >> 8);
+            trng_raw_frame[4 + length] = (uint8_t) crc;
+            uart_write((const char *) trng_raw_frame, length + 5);
+        }
+        else{
+            uart_write((const char *) payload, length);
+        }
+
+        trng_raw_remaining -= length;
+    }
 
+    trng_raw_ticks = sw_timer_now() - trng_raw_start_ticks;
+    PT_END(&task->pt); // the task stops itself
+}
 
-            // now we have the backwards random number, iterate and print it out
-            // key idea !! int holder tells us how much we used of the list !! so we can use it to output the random number to the serial
+// calibration sweep state, the protothread's locals don't survive a wait
+uint8_t trng_cal_index;
+uint8_t trng_cal_best;
+uint32_t trng_cal_best_rate;
+uint32_t trng_cal_start_ticks;
+uint32_t trng_cal_start_numbers;
+uint32_t trng_cal_start_failures;
+uint32_t trng_cal_rate; // numbers per second of the setting just measured
+uint32_t trng_cal_failures;
+
+// the setting being measured, for the verbose lines
+void trng_cal_print_setting(){
+    uart_put_string("trng min ");
+    uart_put_number(trng_settings[trng_cal_index].min_samples);
+    uart_put_string(" clk ");
+    uart_put_number(trng_settings[trng_cal_index].clocks_per_sample);
+}
 
-            for (int j = holder - 1; j >= 0; j--){
-                UARTCharPut(UART0_BASE, (uint8_t) (random_str[j]));
+// TRNG calibration: run every setting for a while, count the numbers per second and the health test failures, then keep the fastest one without failures
+// the pool keeps filling with the numbers that pass while we sweep, so "trng raw" and the DRBG don't wait for it
+int task_cal_thread(task_t *task){
+    PT_BEGIN(&task->pt);
+
+    trng_cal_best = TRNG_SETTING_DEFAULT; // if nothing passes we stay with what always worked
+    trng_cal_best_rate = 0;
+    trng_calibrating = true;
+
+    for (trng_cal_index = 0; trng_cal_index < TRNG_SETTING_COUNT; trng_cal_index++){
+        trng_apply(trng_cal_index);
+
+        // the first number after enabling takes the startup samples too, only count from there
+        // a setting that gives nothing for a whole window has failed, the sweep goes on with the next one
+        trng_cal_start_numbers = trng_numbers;
+        sw_timer_start(&task->timer, TRNG_CAL_WINDOW_MS, 0);
+        task->ticks = 0;
+        PT_WAIT_UNTIL(&task->pt, task->ticks != 0 || trng_numbers != trng_cal_start_numbers);
+        if (trng_numbers == trng_cal_start_numbers){
+            if (trng_cal_verbose){
+                PT_WAIT_UNTIL(&task->pt, uart_tx_room(64));
+                trng_cal_print_setting();
+                uart_put_string(" no numbers\r\n");
             }
-            UARTCharPut(UART0_BASE, '\n');
-            UARTCharPut(UART0_BASE, '\r');
+            continue;
+        }
+        trng_cal_start_ticks = sw_timer_now();
+        trng_cal_start_numbers = trng_numbers;
+        trng_cal_start_failures = trng_rct_failures + trng_apt_failures;
+
+        TASK_SLEEP(task, TRNG_CAL_WINDOW_MS);
+
+        uint32_t elapsed_ms = (sw_timer_now() - trng_cal_start_ticks) / MS_TO_TICKS(1);
+        trng_cal_rate = (trng_numbers - trng_cal_start_numbers) * 1000 / elapsed_ms;
+        trng_cal_failures = trng_rct_failures + trng_apt_failures - trng_cal_start_failures;
+        if (trng_cal_failures == 0 && trng_cal_rate > trng_cal_best_rate){
+            trng_cal_best = trng_cal_index;
+            trng_cal_best_rate = trng_cal_rate;
+        }
 
-            TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*1000); // 1000ms
-            TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT); // enable interrupts for the timer
-            TimerEnable(GPT0_BASE,TIMER_A); // enable the timer, ** STARTS COUNTING FROM NOW
+        if (trng_cal_verbose){
+            PT_WAIT_UNTIL(&task->pt, uart_tx_room(64));
+            trng_cal_print_setting();
+            uart_put_string(" ");
+            uart_put_number(trng_cal_rate);
+            uart_put_string("/s failures ");
+            uart_put_number(trng_cal_failures);
+            uart_put_string("\r\n");
+        }
+    }
 
-            break;
+    trng_calibrating = false;
+    trng_cal_done = true;
+    trng_apply(trng_cal_best);
+    if (trng_cal_verbose){
+        PT_WAIT_UNTIL(&task->pt, uart_tx_room(64));
+        trng_print_stat();
+    }
 
-        default:
-            break;
+    PT_END(&task->pt); // the task stops itself
+}
+
+// the sweep is done (or was stopped), run at the best setting found so far and fill the pool again
+void trng_cal_stopped(){
+    if (trng_calibrating){
+        trng_calibrating = false;
+        trng_apply(trng_cal_best);
+    }
+    trng_cal_verbose = false;
+}
+
+// run every running task's protothread up to its next wait, called by main() every time it wakes up
+// returns PT_POLLING if main() has to call again before it sleeps
+int tasks_poll(){
+
+    // the menu goes out on the first pass, then we stay in sleep until a command is entered
+    if(first_startup == 1){
+        first_startup = 0;
+        menu_display();
     }
 
+    int result = PT_WAITING;
+    for (int i = 0; i < TASK_COUNT; i++){
+        task_t *task = &tasks[i];
+        if (!task->running || (uart_baud_draining && i != TASK_BAUD)){
+            continue; // held while the baud rate changes
+        }
+
+        uint32_t thread_start = cycles_now();
+        int state = task->thread(task);
+        cycle_stats_add(&task_thread_stats, thread_start);
+
+        if (state == PT_POLLING){
+            result = PT_POLLING;
+        }
+        else if (state == PT_ENDED){
+            task_stop(task);
+        }
+    }
+    return result;
+}
+
+// GPT0 timer A ISR, the match register reached the nearest software timer deadline
+void Timer_Interrupt_Handler(){
+    uint32_t isr_start = cycles_now(); // profiler, measure the whole ISR
+
+    TimerIntClear(GPT0_BASE, TIMER_TIMA_MATCH); // clear the raised interrupt or it will loop forever
+    sw_timer_expire();
+
+    cycle_stats_add(&timer_isr_stats, isr_start);
 }
 
 // set up general purpose timer
@@ -550,31 +3396,94 @@ void setup_Timer(){
     while (!PRCMLoadGet());
 
 
-    // configure the new 1-shot timer
-    TimerConfigure(GPT0_BASE,TIMER_CFG_ONE_SHOT);
-    // we want our program to start in sleep mode instantly, so the initially configured 1 shot timer is set to 0 seconds
-    TimerLoadSet(GPT0_BASE,TIMER_A, ONE_MS_32BIT_DIVIDER*0);
+    // configure a free running 32-bit timer counting up, 0 to 0xFFFFFFFF and around again, all software timers are deadlines on this count
+    TimerConfigure(GPT0_BASE,TIMER_CFG_PERIODIC_UP);
+    TimerLoadSet(GPT0_BASE,TIMER_A, 0xFFFFFFFF);
+    // the match interrupt has to be switched on in the mode register, driverlib doesn't have a function for it
+    HWREG(GPT0_BASE + GPT_O_TAMR) |= GPT_TAMR_TAMIE;
 
     // assign timer interrupt handler
     TimerIntRegister(GPT0_BASE, TIMER_A, Timer_Interrupt_Handler);
 
-    // enable the interrupt
-    TimerIntEnable(GPT0_BASE,TIMER_TIMA_TIMEOUT);
-
-
     // enable the timer, ** THIS STARTS COUNTING
     TimerEnable(GPT0_BASE,TIMER_A);
 }
 
 
+// interrupt priorities: lower number = more urgent, the CC1350 has 3 priority bits (INT_PRI_LEVEL0 to 7) and all of them preempt
+// the UART goes first, its 32 byte RX FIFO overruns in ~33ms at 9600 baud if nobody empties it, while a timer deadline being a little late costs nothing
+// so the UART ISR can cut into the GPT0 ISR, but never the other way around
+#define PRIORITY_UART INT_PRI_LEVEL1
+#define PRIORITY_TIMER INT_PRI_LEVEL2
+#define PRIORITY_BUTTONS INT_PRI_LEVEL3
+#define PRIORITY_TRNG INT_PRI_LEVEL3 // the pool only needs filling eventually
+
+// anything shared between two ISRs at different priorities (or an ISR and main) has to be touched inside critical_enter()/critical_exit()
+// the tasks and their settings are only used by main() (commands and tasks_poll), so they don't need it
+void setup_Priorities(){
+    IntPrioritySet(INT_UART0_COMB, PRIORITY_UART); // the uDMA done interrupts for the UART channels come in here too
+    IntPrioritySet(INT_GPT0A, PRIORITY_TIMER);
+    IntPrioritySet(INT_AON_GPIO_EDGE, PRIORITY_BUTTONS);
+    IntPrioritySet(INT_TRNG_IRQ, PRIORITY_TRNG);
+}
+
+// do the work an ISR posted
+void run_event(const event_t *event){
+    switch(event->type){
+        case EVENT_COMMAND: {
+            uint32_t command_start = cycles_now();
+            cycle_stats_add(&command_latency_stats, event->posted);
+
+            cycle_stats_t *stats = run_command(uart_rx_lines[event->data]);
+            cycle_stats_add(stats, command_start);
+            uart_rx_line_busy[event->data] = false; // the ISR can type into this slot again
+            uart_rx_resume(); // and if it was waiting for exactly that, it carries on
+            break;
+        }
+
+        case EVENT_TASK_TIMER:
+            cycle_stats_add(&task_latency_stats, event->posted);
+            if (tasks[event->data].ticks < UINT8_MAX){
+                tasks[event->data].ticks++; // the task's protothread picks it up in tasks_poll()
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
 int main(void)
 {
-    setup_RNG();
+    setup_Profiler(); // start the cycle counter before any interrupt can fire
+    setup_Priorities(); // before anything enables an interrupt
+    setup_Commands();
     setup_GPIO();
+    setup_PWM();
+    setup_DMA();
     setup_UART();
     setup_Timer();
+    setup_RNG(); // after the timer, so the time to the first number can be measured on GPT0
 
     while (1){
-        PRCMSleep();
+        event_t event;
+
+        // the UART queue goes first, typed commands (like stop) shouldn't wait behind a backlog of task steps
+        while ((command_can_run() && event_take(&uart_events, &event)) || event_take(&timer_events, &event)){
+            run_event(&event);
+        }
+
+        // then let every task's protothread run up to its next wait
+        if (tasks_poll() == PT_POLLING){
+            continue;
+        }
+
+        // an ISR could post between the check above and the sleep, and we'd sleep on an event until the next interrupt
+        // so check again with interrupts masked: a pending interrupt still wakes the CPU from PRCMSleep, it just runs after IntMasterEnable
+        IntMasterDisable();
+        if (!events_pending()){
+            PRCMSleep();
+        }
+        IntMasterEnable();
     }
 }
@@ -0,0 +1,125 @@
+// command lookup cost with a big table: the firmware's own commands and 52 more, so the slot count grows to 128, built and searched
+// by the firmware's command_table_build() and command_table_find() (the hash and one or two probes) against walking the table,
+// in modeled cycles per lookup, for every command and for keys that aren't one
+#include "firmware.h"
+#include "check.h"
+
+#define ROUNDS 100
+#define EXTRA_KEY(a, b, c, d) COMMAND_KEY(a, b, c, d),
+static const uint32_t extra_keys[] = {
+    EXTRA_KEY('a','d','c','s') EXTRA_KEY('b','e','e','p') EXTRA_KEY('b','o','o','t') EXTRA_KEY('b','u','z','z')
+    EXTRA_KEY('c','h','a','n') EXTRA_KEY('c','l','o','k') EXTRA_KEY('c','o','n','f') EXTRA_KEY('d','u','m','p')
+    EXTRA_KEY('e','r','a','s') EXTRA_KEY('e','x','i','t') EXTRA_KEY('f','a','d','e') EXTRA_KEY('f','l','s','h')
+    EXTRA_KEY('f','r','e','q') EXTRA_KEY('g','p','i','o') EXTRA_KEY('h','e','l','p') EXTRA_KEY('h','i','s','t')
+    EXTRA_KEY('i','2','c','s') EXTRA_KEY('i','n','f','o') EXTRA_KEY('k','e','y','s') EXTRA_KEY('l','a','s','t')
+    EXTRA_KEY('l','o','c','k') EXTRA_KEY('l','o','g','s') EXTRA_KEY('m','a','r','k') EXTRA_KEY('m','e','m','r')
+    EXTRA_KEY('m','o','d','e') EXTRA_KEY('m','u','t','e') EXTRA_KEY('n','a','m','e') EXTRA_KEY('n','e','x','t')
+    EXTRA_KEY('n','v','i','c') EXTRA_KEY('o','s','c','h') EXTRA_KEY('p','a','c','e') EXTRA_KEY('p','e','e','k')
+    EXTRA_KEY('p','i','n','g') EXTRA_KEY('p','o','k','e') EXTRA_KEY('p','w','r','s') EXTRA_KEY('q','u','i','t')
+    EXTRA_KEY('r','a','n','d') EXTRA_KEY('r','e','a','d') EXTRA_KEY('r','e','g','s') EXTRA_KEY('r','s','e','t')
+    EXTRA_KEY('r','t','c','s') EXTRA_KEY('s','a','v','e') EXTRA_KEY('s','c','a','n') EXTRA_KEY('s','e','n','s')
+    EXTRA_KEY('s','l','e','p') EXTRA_KEY('s','p','i','s') EXTRA_KEY('t','e','m','p') EXTRA_KEY('t','i','c','k')
+    EXTRA_KEY('t','u','n','e') EXTRA_KEY('v','e','r','s') EXTRA_KEY('w','d','o','g') EXTRA_KEY('x','o','s','c')
+};
+#define TABLE_COUNT (COMMAND_COUNT + sizeof(extra_keys)/sizeof(extra_keys[0]))
+#define TABLE_BITS COMMAND_SLOT_BITS(2*TABLE_COUNT)
+#define TABLE_SLOTS (1u << TABLE_BITS)
+
+// the firmware's commands first, then the extra ones, all of them do what "stat" does
+static command_t table[TABLE_COUNT];
+static uint8_t table_slots[TABLE_SLOTS];
+const command_t *found_command; // global, so the compiler can't drop a lookup nobody reads
+
+__attribute__((noipa)) // one call per lookup, the way command_find() is called
+static const command_t *table_find(uint32_t key){
+    return command_table_find(table, table_slots, TABLE_BITS, key);
+}
+
+// what a lookup would cost without the hash table
+__attribute__((noipa)) // or gcc sees it only reads a const table and does one walk for all the rounds
+static const command_t *command_scan(uint32_t key){
+    for (uint32_t i = 0; i < TABLE_COUNT; i++){
+        if (table[i].key == key){
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+// how many slots a lookup looks at for a key, the empty one that ends a miss included
+static uint32_t probes(uint32_t key){
+    uint32_t slot = command_hash_slot(key, TABLE_BITS), count = 1;
+    while (table_slots[slot] != 0 && table[table_slots[slot] - 1].key != key){
+        slot = (slot + 1) & (TABLE_SLOTS - 1);
+        count++;
+    }
+    return count;
+}
+
+// xorshift32, so every run looks up the same missing keys
+static uint32_t state = 2463534242u;
+static uint32_t next_random(void){
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void measure(const char *name, const uint32_t *keys, uint32_t count, bool found){
+    uint32_t probe_sum = 0, probe_max = 0;
+    for (uint32_t i = 0; i < count; i++){
+        CHECK((table_find(keys[i]) != NULL) == found && table_find(keys[i]) == command_scan(keys[i]));
+        uint32_t n = probes(keys[i]);
+        probe_sum += n;
+        probe_max = n > probe_max ? n : probe_max;
+    }
+
+    sim_measure_start();
+    for (int round = 0; round < ROUNDS; round++){
+        for (uint32_t i = 0; i < count; i++){
+            found_command = table_find(keys[i]);
+        }
+    }
+    uint64_t hash_cycles = sim_measure_cycles();
+
+    sim_measure_start();
+    for (int round = 0; round < ROUNDS; round++){
+        for (uint32_t i = 0; i < count; i++){
+            found_command = command_scan(keys[i]);
+        }
+    }
+    uint64_t scan_cycles = sim_measure_cycles();
+
+    double lookups = (double) ROUNDS * count;
+    printf("  %-8s hash lookup %5.1f cycles (%.2f probes avg, %u max)   table walk %6.1f cycles   %.1fx\n", name,
+           hash_cycles / lookups, (double) probe_sum / count, probe_max, scan_cycles / lookups, (double) scan_cycles / hash_cycles);
+    // a miss walks the whole table, a hit half of it on average, the hash doesn't care either way
+    CHECK(hash_cycles * 4 < scan_cycles);
+    // linear probing at half full averages about 1.5 probes for a hit and 2.5 for a miss (Knuth), clustering or not
+    CHECK(probe_sum < (found ? 2 : 3) * count);
+}
+
+int main(void){
+    for (uint32_t i = 0; i < TABLE_COUNT; i++){
+        table[i] = (i < COMMAND_COUNT) ? commands[i] : (command_t) {extra_keys[i - COMMAND_COUNT], command_stat, MODE_ANY, ARG_NONE};
+    }
+    command_table_build(table, TABLE_COUNT, table_slots, TABLE_BITS);
+    printf("modeled cycles per lookup, %u commands in %u slots\n", (unsigned) TABLE_COUNT, (unsigned) TABLE_SLOTS);
+    CHECK(TABLE_COUNT > 50 && TABLE_COUNT < 128 && TABLE_SLOTS >= 2 * TABLE_COUNT);
+
+    uint32_t keys[TABLE_COUNT];
+    for (uint32_t i = 0; i < TABLE_COUNT; i++){
+        keys[i] = table[i].key;
+    }
+    measure("hit", keys, TABLE_COUNT, true);
+
+    // 4 lowercase letters that aren't a command, what a typo looks like
+    for (uint32_t i = 0; i < TABLE_COUNT; i++){
+        do {
+            uint32_t r = next_random();
+            keys[i] = COMMAND_KEY('a' + r % 26, 'a' + (r >> 5) % 26, 'a' + (r >> 10) % 26, 'a' + (r >> 15) % 26);
+        } while (command_scan(keys[i]) != NULL);
+    }
+    measure("miss", keys, TABLE_COUNT, false);
+    return 0;
+}
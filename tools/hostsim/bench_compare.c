@@ -0,0 +1,184 @@
+// the same session against any version of main.c, down to the baseline: it only uses what the simulator sees (the serial line,
+// the interrupts and the clock), never the firmware's own globals, so "make compare REV=..." can put an older revision next to this one
+// one figure per line, a label and a value separated by a tab
+#include "firmware.h"
+#include "check.h"
+
+#define CHAR_CYCLES ((SIM_CLOCK_HZ * 10 + 4800) / 9600)
+
+// the baseline reads commands as 4 characters per RX interrupt, later versions read a line up to enter
+static bool compare_fixed_width;
+// the longest any interrupt ran during the session, whichever it was
+static uint32_t compare_isr_worst;
+
+static void compare_isr_worst_update(void){
+    const sim_isr_stats_t *all[] = {&sim_uart_isr, &sim_timer_isr, &sim_trng_isr};
+    for (int i = 0; i < 3; i++){
+        compare_isr_worst = (all[i]->max_cycles > compare_isr_worst) ? all[i]->max_cycles : compare_isr_worst;
+    }
+}
+
+static void compare_row(const char *name, const char *figure, double value){
+    printf("%s: %s\t%.0f\n", name, figure, value);
+}
+
+// run until nothing was sent for 200 ms
+static void compare_wait_quiet(void){
+    for (int ms = 0; ms < 30000; ms += 200){
+        size_t length = sim_tx_length();
+        sim_run_ms(200);
+        if (sim_tx_length() == length){
+            return;
+        }
+    }
+}
+
+static void compare_send(const char *text){
+    if (compare_fixed_width){
+        sim_uart_send(text, 4);
+    }
+    else{
+        sim_uart_send_line(text);
+    }
+}
+
+// a command's cost: its longest UART interrupt, how long until the first byte of the reply went out, the awake time of the 500 ms after it,
+// and the deepest the stack went below where the main loop sleeps
+static void compare_command(const char *label, const char *text){
+    sim_uart_isr = (sim_isr_stats_t) {0};
+    sim_stack_mark();
+    size_t sent = sim_tx_length();
+    uint64_t awake = sim_awake_cycles();
+    compare_send(text);
+    sim_run_ms(500);
+
+    compare_isr_worst_update();
+    compare_row(label, "uart isr max cycles", sim_uart_isr.max_cycles);
+    double reply = -1;
+    if (sim_tx_length() > sent && sim_tx_time(sent) - CHAR_CYCLES > sim_uart_send_done()){
+        reply = (sim_tx_time(sent) - CHAR_CYCLES - sim_uart_send_done()) / (SIM_CLOCK_HZ / 1e6);
+    }
+    compare_row(label, "reply after us", reply);
+    compare_row(label, "awake cycles in 500 ms", sim_awake_cycles() - awake);
+    compare_row(label, "stack bytes", sim_stack_used());
+}
+
+// how long after the command went in the first line of nothing but digits went out, -1 if none did
+static double compare_first_number(size_t sent){
+    const char *data = sim_tx_data();
+    size_t length = sim_tx_length(), begin = sent;
+    for (size_t i = sent; i < length; i++){
+        if (data[i] != '\n' && data[i] != '\r'){
+            continue;
+        }
+        bool digits = i > begin;
+        for (size_t j = begin; j < i; j++){
+            digits = digits && data[j] >= '0' && data[j] <= '9';
+        }
+        if (digits){
+            return (sim_tx_time(i) - sim_uart_send_done()) / (SIM_CLOCK_HZ / 1e3);
+        }
+        begin = i + 1;
+    }
+    return -1;
+}
+
+// a mode running by itself for 10 s, with the longest the CPU was shut out by one interrupt
+static void compare_mode(const char *name){
+    size_t command = sim_tx_length();
+    compare_command(name, name);
+    sim_timer_isr = sim_trng_isr = (sim_isr_stats_t) {0};
+    uint64_t awake = sim_awake_cycles();
+    size_t sent = sim_tx_length();
+    sim_stack_mark();
+    sim_run_ms(10000);
+
+    compare_isr_worst_update();
+    compare_row(name, "timer isr calls", sim_timer_isr.calls);
+    compare_row(name, "timer isr avg cycles", sim_timer_isr.calls ? sim_timer_isr.cycles / sim_timer_isr.calls : 0);
+    compare_row(name, "timer isr max cycles", sim_timer_isr.max_cycles);
+    compare_row(name, "trng isr max cycles", sim_trng_isr.max_cycles);
+    uint32_t blocking = (sim_timer_isr.max_cycles > sim_trng_isr.max_cycles) ? sim_timer_isr.max_cycles : sim_trng_isr.max_cycles;
+    compare_row(name, "isr blocking us", blocking / (SIM_CLOCK_HZ / 1e6));
+    if (strcmp(name, "trng") == 0){
+        compare_row(name, "first number after ms", compare_first_number(command));
+    }
+    compare_row(name, "awake cycles per s", (sim_awake_cycles() - awake) / 10.0);
+    compare_row(name, "bytes sent per s", (sim_tx_length() - sent) / 10.0);
+    compare_row(name, "stack bytes", sim_stack_used());
+
+    char stop[16];
+    snprintf(stop, sizeof(stop), "stop %s", name);
+    compare_command(stop, "stop");
+    compare_wait_quiet();
+}
+
+// a periodic mode over a simulated day: the lines should come a second apart, however long each one takes to make and send
+// the drift is how far the last one is from where a perfect 1 Hz stream would put it, counting from the first line after 10 s
+// (by then the command's own reply is long gone)
+static void compare_drift(const char *name){
+    sim_tx_clear();
+    compare_send(name);
+    sim_run_ms(24 * 3600 * 1000);
+
+    const char *data = sim_tx_data();
+    size_t length = sim_tx_length();
+    uint64_t settled = sim_tx_time(0) + SIM_MS(10000), first = 0, last = 0;
+    uint32_t periods = 0;
+    for (size_t i = 0; i < length; i++){
+        if (data[i] != '\n' || sim_tx_time(i) < settled){
+            continue;
+        }
+        if (first == 0){
+            first = sim_tx_time(i);
+        }
+        else{
+            periods++;
+        }
+        last = sim_tx_time(i);
+    }
+    char label[24];
+    snprintf(label, sizeof(label), "%s 24 h", name);
+    compare_row(label, "lines", periods + 1);
+    compare_row(label, "drift ms", ((double) last - first - (double) periods * SIM_CLOCK_HZ) / (SIM_CLOCK_HZ / 1e3));
+
+    // the baseline only acts on "stop" at the mode's next tick, give it a whole period
+    compare_send("stop");
+    sim_run_ms(1500);
+    compare_wait_quiet();
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    compare_wait_quiet();
+    compare_row("boot", "awake cycles", sim_awake_cycles());
+    compare_row("boot", "menu done at ms", sim_tx_time(sim_tx_length() - 1) / (SIM_CLOCK_HZ / 1e3));
+    compare_row("boot", "stack bytes", sim_stack_used());
+    compare_row("boot", "first trng number at us", sim_trng_first_taken() / (SIM_CLOCK_HZ / 1e6));
+
+    // "stop" without enter: the baseline answers it (with the menu, nothing runs), a line based version waits for the rest of the line
+    size_t sent = sim_tx_length();
+    sim_uart_send("stop", 4);
+    sim_run_ms(300);
+    compare_fixed_width = sim_tx_length() > sent;
+    if (!compare_fixed_width){
+        sim_uart_send("\r", 1);
+    }
+    compare_wait_quiet();
+    sim_uart_isr = sim_timer_isr = sim_trng_isr = (sim_isr_stats_t) {0};
+    uint64_t start = sim_cycles(), awake = sim_awake_cycles();
+
+    compare_command("echo on", "echo");
+    compare_command("echo off", "echo");
+    compare_wait_quiet();
+    compare_mode("leds");
+    compare_mode("moni");
+    compare_mode("trng");
+    compare_row("session", "worst isr cycles", compare_isr_worst);
+    compare_row("session", "awake permille", 1000.0 * (sim_awake_cycles() - awake) / (sim_cycles() - start));
+
+    compare_drift("moni");
+    compare_drift("trng");
+    CHECK(sim_uart_stats.rx_overruns == 0 && sim_uart_stats.rx_framing == 0);
+    return 0;
+}
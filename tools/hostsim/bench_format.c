@@ -0,0 +1,92 @@
+// number formatting cost: format_u32 (a multiply per two digits and a table) against the loop uart_put_number had
+// before it (a divide and a modulo per digit), in modeled cycles per number for a few kinds of values
+#include "firmware.h"
+#include "check.h"
+
+// the old loop, writing into a buffer instead of the UART so both sides do the same work
+static int format_u32_old(char *out, uint32_t value){
+    char digits[10];
+    int count = 0;
+
+    do {
+        digits[count] = value%10 + '0';
+        value = value/10;
+        count++;
+    } while (value > 0);
+
+    for (int i = 0; i < count; i++){
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+#define VALUE_COUNT 10000
+static uint32_t values[VALUE_COUNT];
+char text[FORMAT_U32_MAX]; // global, so the compiler can't drop the digits nobody reads
+
+// xorshift32, so every run measures the same values
+static uint32_t state = 2463534242u;
+static uint32_t next_random(void){
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void measure(const char *name){
+    uint64_t blocks;
+
+    blocks = sim_blocks();
+    sim_measure_start();
+    for (int i = 0; i < VALUE_COUNT; i++){
+        format_u32_old(text, values[i]);
+    }
+    uint64_t old_cycles = sim_measure_cycles();
+    uint64_t old_blocks = sim_blocks() - blocks;
+
+    blocks = sim_blocks();
+    sim_measure_start();
+    for (int i = 0; i < VALUE_COUNT; i++){
+        format_u32(text, values[i]);
+    }
+    uint64_t new_cycles = sim_measure_cycles();
+    uint64_t new_blocks = sim_blocks() - blocks;
+
+    // both have to print the same thing
+    for (int i = 0; i < VALUE_COUNT; i++){
+        char old_text[FORMAT_U32_MAX];
+        int length = format_u32(text, values[i]);
+        CHECK(format_u32_old(old_text, values[i]) == length && memcmp(text, old_text, length) == 0);
+    }
+
+    printf("  %-16s old %6.1f cycles %5.1f blocks   new %6.1f cycles %5.1f blocks   %.2fx\n", name,
+           (double) old_cycles / VALUE_COUNT, (double) old_blocks / VALUE_COUNT,
+           (double) new_cycles / VALUE_COUNT, (double) new_blocks / VALUE_COUNT, (double) old_cycles / new_cycles);
+}
+
+int main(void){
+    printf("modeled cycles per number (a cycle per instruction, a divide %d)\n", DIV_CYCLES);
+
+    for (int i = 0; i < VALUE_COUNT; i++){
+        values[i] = next_random() % 10;
+    }
+    measure("0 to 9");
+    for (int i = 0; i < VALUE_COUNT; i++){
+        values[i] = next_random() % 1000;
+    }
+    measure("0 to 999");
+    // what the firmware prints most: millivolts, counters in the thousands
+    for (int i = 0; i < VALUE_COUNT; i++){
+        values[i] = 1000 + next_random() % 99000;
+    }
+    measure("1000 to 99999");
+    for (int i = 0; i < VALUE_COUNT; i++){
+        values[i] = next_random();
+    }
+    measure("any uint32_t");
+    for (int i = 0; i < VALUE_COUNT; i++){
+        values[i] = UINT32_MAX - next_random() % 1000;
+    }
+    measure("10 digits");
+    return 0;
+}
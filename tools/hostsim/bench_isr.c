@@ -0,0 +1,58 @@
+// ISR and command cost: a scripted session (every command, with the LEDs, the monitor and the TRNG running behind it),
+// then the modeled cycles per ISR call and per command, both from the firmware's own profiler and from the simulator's side
+#include "firmware.h"
+#include "check.h"
+
+static const char *session[] = {
+    "echo on", "echo off", "stat", "baud", "flow off",
+    "leds", "moni 100", "trng 500", "drbg 256", "drbg reseed", "ledl r 300 g 300", "leds 4", "leds dim 40",
+    "moni bin", "moni batch 8", "moni txt", "moni change", "trng stat", "xyzzy", "stop moni", "stop",
+};
+
+static void print_stats(const char *name, const cycle_stats_t *stats){
+    printf("  %-12s %8u calls %8llu avg %8u max\n", name, stats->calls,
+           (unsigned long long) (stats->calls ? stats->total_cycles / stats->calls : 0), stats->max_cycles);
+}
+
+static void print_sim_stats(const char *name, const sim_isr_stats_t *stats){
+    printf("  %-12s %8u calls %8llu avg %8u max\n", name, stats->calls,
+           (unsigned long long) (stats->calls ? stats->cycles / stats->calls : 0), stats->max_cycles);
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+    // both profilers start over after the boot, the TRNG calibration is part of the session ("trng 500" starts it)
+    sim_uart_send_line("prof clear");
+    CHECK(sim_wait_for("Profiler cleared\r\n", 5000));
+    sim_uart_isr = sim_timer_isr = sim_trng_isr = (sim_isr_stats_t) {0};
+
+    for (size_t i = 0; i < sizeof(session)/sizeof(session[0]); i++){
+        sim_uart_send_line(session[i]);
+        sim_run_ms(1000);
+    }
+    CHECK(sim_uart_stats.rx_overruns == 0);
+
+    printf("modeled cycles at %d MHz (a cycle per instruction, driverlib call %d, register %d, interrupt entry and exit %d)\n",
+           SIM_CLOCK_HZ / 1000000, SIM_CALL_CYCLES, SIM_REG_CYCLES, SIM_ISR_CYCLES);
+    printf("firmware profiler (DWT CYCCNT):\n");
+    print_stats("uart isr", &uart_isr_stats);
+    print_stats("timer isr", &timer_isr_stats);
+    print_stats("trng isr", &trng_isr_stats);
+    print_stats("task pt", &task_thread_stats);
+    for (size_t i = 0; i < COMMAND_COUNT; i++){
+        char name[9] = "cmd ";
+        memcpy(&name[4], &commands[i].key, 4);
+        print_stats(name, &command_stats[i]);
+    }
+    print_stats("cmd ????", &unknown_command_stats);
+
+    printf("simulator, entry to return with nested interrupts:\n");
+    print_sim_stats("uart", &sim_uart_isr);
+    print_sim_stats("timer", &sim_timer_isr);
+    print_sim_stats("trng", &sim_trng_isr);
+
+    printf("awake %.2f%% of %.1f s, %llu basic blocks, %zu bytes sent\n", 100.0 * sim_awake_cycles() / sim_cycles(),
+           sim_cycles() / (double) SIM_CLOCK_HZ, (unsigned long long) sim_blocks(), sim_tx_length());
+    return 0;
+}
@@ -0,0 +1,67 @@
+// protothread cost: one switch into a waiting task's thread and back (what tasks_poll() pays per task on every pass of the main loop),
+// with the blinker, the monitor and the TRNG running at once, and the RAM a task takes (its pt_t is the whole context, there's no stack per task)
+#include "firmware.h"
+#include "check.h"
+
+#define CALLS 1000
+
+// a thread that's waiting for its tick: it jumps to its wait point, finds nothing to do and returns
+static uint64_t switch_cycles(task_t *task){
+    CHECK(task->running && task->ticks == 0);
+    uint16_t line = task->pt.line;
+
+    int state = PT_WAITING;
+    sim_measure_start();
+    for (int i = 0; i < CALLS; i++){
+        state |= task->thread(task);
+    }
+    uint64_t cycles = sim_measure_cycles() / CALLS;
+    CHECK(state == PT_WAITING && task->pt.line == line); // still waiting at the same place
+    return cycles;
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    // the main loop's stack with nothing running, then with all three
+    sim_stack_mark();
+    sim_run_ms(2000);
+    uint32_t idle_stack = sim_stack_used();
+
+    sim_uart_send_line("leds");
+    sim_run_ms(200);
+    sim_uart_send_line("moni");
+    sim_run_ms(200);
+    sim_uart_send_line("trng");
+    sim_run_ms(500);
+    sim_stack_mark();
+    sim_run_ms(5000);
+    uint32_t tasks_stack = sim_stack_used();
+
+    printf("modeled cycles to switch into a waiting thread and back\n");
+    uint64_t worst = 0;
+    const int running[] = {TASK_LEDS, TASK_MONI, TASK_TRNG};
+    for (int i = 0; i < 3; i++){
+        task_t *task = &tasks[running[i]];
+        uint64_t cycles = switch_cycles(task);
+        worst = (cycles > worst) ? cycles : worst;
+        printf("  %-6s %3llu cycles\n", task->name, (unsigned long long) cycles);
+    }
+
+    // a whole pass of the main loop's scheduler: 8 tasks looked at, the 3 running ones called and profiled
+    sim_measure_start();
+    for (int i = 0; i < CALLS; i++){
+        tasks_poll();
+    }
+    uint64_t poll = sim_measure_cycles() / CALLS;
+    printf("  tasks_poll() with 3 of %d running %llu cycles\n", TASK_COUNT, (unsigned long long) poll);
+
+    printf("RAM per task: pt_t %zu bytes, task_t %zu bytes (with its timer, 8 byte pointers here)\n", sizeof(pt_t), sizeof(task_t));
+    printf("stack: %u bytes idle, %u bytes with 3 tasks running, they share the main loop's\n", idle_stack, tasks_stack);
+
+    // a switch is a call, a jump table and a return, a thread needs nothing but its 2 byte line number
+    CHECK(worst < 60);
+    CHECK(sizeof(pt_t) == 2);
+    return 0;
+}
@@ -0,0 +1,99 @@
+// "trng raw N": entropy bytes per second on the wire against the line rate, plain and framed, from 9600 baud to the fastest rate
+// two seconds of line time per request, timed from the first byte's start bit to the last byte's stop bit; the frames are parsed and
+// their CRCs checked on the way, so a fast but broken stream doesn't count
+// up to 921600 baud the line is the limit, at the fastest rate it's the CPU: the TRNG interrupt for every number at the fastest
+// setting plus the bitwise CRC of every frame keep it awake all the time, plain bytes still fill the line, framed ones don't
+#include "firmware.h"
+#include "check.h"
+
+static bool calibrated(void){
+    return !tasks[TASK_CAL].running;
+}
+
+// something went out and the task is done with it
+static bool raw_done(void){
+    return sim_tx_length() > 0 && !tasks[TASK_RAW].running && uart_tx_idle();
+}
+
+// the payload bytes in what went out, the frames have to follow each other with nothing in between and every CRC has to match
+static uint32_t frame_payload(const uint8_t *data, size_t length){
+    uint32_t payload = 0;
+    size_t i = 0;
+    while (i < length){
+        CHECK(i + 5 <= length && data[i] == TRNG_FRAME_SYNC1 && data[i + 1] == TRNG_FRAME_SYNC2);
+        uint8_t size = data[i + 2];
+        CHECK(size >= 1 && size <= TRNG_RAW_CHUNK && i + 5 + size <= length);
+        uint16_t crc = crc16_ccitt(0xFFFF, &data[i + 2], size + 1u);
+        CHECK(data[i + 3 + size] == (uint8_t) (crc >> 8) && data[i + 4 + size] == (uint8_t) crc);
+        payload += size;
+        i += 5 + size;
+    }
+    return payload;
+}
+
+// entropy bytes per second for one request, and how much of that time the CPU was awake
+static double stream(uint32_t baud, bool framed, double *awake_percent){
+    uint32_t count = baud / 10 * 2;
+    count = (count > TRNG_RAW_MAX) ? TRNG_RAW_MAX : count;
+    CHECK(sim_run_until(uart_tx_idle, 5000));
+    sim_run_ms(100); // and the pool full again
+    sim_tx_clear();
+
+    char line[40];
+    snprintf(line, sizeof(line), framed ? "trng raw %u frame" : "trng raw %u", count);
+    uint64_t awake = sim_awake_cycles(), start = sim_cycles();
+    sim_uart_send_line(line);
+    CHECK(sim_run_until(raw_done, 60000));
+    *awake_percent = 100.0 * (sim_awake_cycles() - awake) / (sim_cycles() - start);
+
+    size_t length = sim_tx_length();
+    const uint8_t *data = (const uint8_t *) sim_tx_data();
+    CHECK((framed ? frame_payload(data, length) : length) == count);
+    uint64_t char_cycles = (SIM_CLOCK_HZ * 10ull + baud / 2) / baud;
+    uint64_t span = sim_tx_time(length - 1) - (sim_tx_time(0) - char_cycles);
+    return count / ((double) span / SIM_CLOCK_HZ);
+}
+
+static void rate(uint32_t baud){
+    if (baud != uart_baud){
+        char line[32];
+        snprintf(line, sizeof(line), "baud %u", baud);
+        sim_uart_send_line(line);
+        CHECK(sim_wait_for("send any command to keep it\r\n", 1000));
+        sim_uart_host_baud(baud);
+        sim_uart_send_line("stat");
+        CHECK(sim_wait_for(" baud flow ", 1000));
+    }
+
+    double line_rate = baud / 10.0;
+    double plain_awake, framed_awake;
+    double plain = stream(baud, false, &plain_awake);
+    double framed = stream(baud, true, &framed_awake);
+    printf("%7u baud, line rate %6.0f bytes/s: raw %6.0f entropy bytes/s (%5.1f%%, %5.1f%% awake), framed %6.0f (%5.1f%%, %5.1f%% awake)\n",
+           baud, line_rate, plain, 100 * plain / line_rate, plain_awake, framed, 100 * framed / line_rate, framed_awake);
+    // the wire is never faster than the line, and up to 921600 baud nothing else holds it up: the TRNG keeps ahead and the frames cost 5 bytes in 69
+    CHECK(plain <= line_rate * 1.001 && framed <= plain * 1.001);
+    if (baud <= 921600){
+        CHECK(plain > line_rate * 0.99);
+        CHECK(framed > line_rate * TRNG_RAW_CHUNK / (TRNG_RAW_CHUNK + 5) * 0.99);
+    }
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+    // tuned first, the first raw request would start the sweep itself and wait for it once the pool is empty
+    sim_uart_send_line("trng cal");
+    CHECK(sim_wait_for("TRNG calibration", 100));
+    CHECK(sim_run_until(calibrated, 5000));
+
+    uint32_t fastest = 0;
+    for (int i = 0; i < UART_BAUD_RATE_COUNT; i++){
+        fastest = (uart_baud_rates[i] > fastest) ? uart_baud_rates[i] : fastest;
+    }
+    rate(9600);
+    rate(115200);
+    rate(921600);
+    rate(fastest);
+    return 0;
+}
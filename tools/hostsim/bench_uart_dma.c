@@ -0,0 +1,70 @@
+// uDMA transmit against the ring buffer: CPU awake cycles per kilobyte sent, from the write to the last byte on the wire
+// the ring buffer costs a TX interrupt per 28 bytes, the uDMA one done interrupt per transfer, spinning on UARTCharPut (the baseline) costs the whole wire time
+#include "firmware.h"
+#include "check.h"
+
+static char kilobyte[1024];
+
+static bool ring_has_room(void){
+    return uart_tx_space() >= 256;
+}
+
+// awake cycles to send the kilobyte: the writes themselves (called from here, measured apart) and everything the firmware did until it was out
+static uint64_t send_kilobyte(bool dma){
+    CHECK(sim_run_until(uart_tx_idle, 5000));
+    sim_tx_clear();
+    sim_uart_isr = (sim_isr_stats_t) {0};
+    uint64_t awake = sim_awake_cycles();
+    uint64_t writes = 0;
+
+    if (dma){
+        sim_measure_start();
+        uart_write_dma(kilobyte, sizeof(kilobyte));
+        writes += sim_measure_cycles();
+    }
+    else{
+        for (size_t sent = 0; sent < sizeof(kilobyte); sent += 256){
+            CHECK(sim_run_until(ring_has_room, 5000));
+            sim_measure_start();
+            uart_write(&kilobyte[sent], 256);
+            writes += sim_measure_cycles();
+        }
+    }
+    CHECK(sim_run_until(uart_tx_idle, 5000));
+    CHECK(sim_tx_length() == sizeof(kilobyte) && memcmp(sim_tx_data(), kilobyte, sizeof(kilobyte)) == 0);
+    return writes + sim_awake_cycles() - awake;
+}
+
+static void rate(uint32_t baud){
+    if (baud != uart_baud){
+        char line[32];
+        snprintf(line, sizeof(line), "baud %u", baud);
+        sim_uart_send_line(line);
+        CHECK(sim_wait_for("send any command to keep it\r\n", 1000));
+        sim_uart_host_baud(baud);
+        sim_uart_send_line("stat");
+        CHECK(sim_wait_for(" baud flow ", 1000));
+    }
+
+    uint64_t ring = send_kilobyte(false);
+    uint32_t ring_calls = sim_uart_isr.calls;
+    uint64_t dma = send_kilobyte(true);
+    uint32_t dma_calls = sim_uart_isr.calls;
+    uint64_t wire = (uint64_t) sizeof(kilobyte) * ((SIM_CLOCK_HZ * 10ull + baud / 2) / baud);
+    printf("%7u baud, awake cycles per KB: ring buffer %6llu (%2u interrupts), uDMA %5llu (%u), UARTCharPut spinning %9llu\n", baud,
+           (unsigned long long) ring, ring_calls, (unsigned long long) dma, dma_calls, (unsigned long long) wire);
+    CHECK(dma * 4 < ring);
+}
+
+int main(void){
+    for (size_t i = 0; i < sizeof(kilobyte); i++){
+        kilobyte[i] = (char) ('A' + i % 26);
+    }
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    rate(9600);
+    rate(115200);
+    rate(921600);
+    return 0;
+}
@@ -0,0 +1,47 @@
+# the cost of every instrumented basic block, from "objdump -d --no-show-raw-insn" of a test or bench:
+# one line per block, the return address of its __sanitizer_cov_trace_pc call and the cycles of the instructions up to the next one
+# every instruction is a cycle, a divide is DIV_CYCLES (the Cortex-M3 UDIV takes 2 to 12), the few instructions in front of a
+# function's first block (its prologue) are counted in that block
+
+function flush(){
+    if (block != ""){
+        printf "%s %d\n", block, cycles + prologue
+        prologue = 0
+    }
+    block = ""
+    cycles = 0
+}
+
+/^[0-9a-f]+ <.*>:$/ {
+    flush()
+    prologue = 0
+    next
+}
+
+/^ *[0-9a-f]+:\t/ {
+    split($0, fields, "\t")
+    instruction = fields[2]
+    if (instruction ~ /<__sanitizer_cov_trace_pc>/){
+        flush()
+        pending = (instruction ~ /^call/) # a tail call (jmp) returns to our caller, sim.c charges that one a cycle
+        next
+    }
+    if (pending){
+        address = fields[1]
+        sub(/^ */, "", address)
+        sub(/:$/, "", address)
+        block = address
+        pending = 0
+    }
+    cost = (instruction ~ /^i?div/) ? DIV_CYCLES : 1
+    if (block == ""){
+        prologue += cost
+    }
+    else{
+        cycles += cost
+    }
+}
+
+END {
+    flush()
+}
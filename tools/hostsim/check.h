@@ -0,0 +1,27 @@
+// the little the tests need: CHECK stops the test with the line that failed, the firmware is included as firmware_main
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostsim.h"
+
+#define CHECK(condition) do { \
+        if (!(condition)){ \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+// run until the firmware sent text (or max_ms went by)
+static const char *check_wait_text;
+static inline bool check_text_sent(void){
+    return sim_tx_contains(check_wait_text);
+}
+static inline bool sim_wait_for(const char *text, uint32_t max_ms){
+    check_wait_text = text;
+    return sim_run_until(check_text_sent, max_ms);
+}
+
+#endif
@@ -0,0 +1,13 @@
+// main.c as a library for one test: its main() becomes firmware_main for sim_boot(), and its global "random" is renamed
+// because the C library's random() is declared by stdlib.h, which main.c on the target never includes
+// its C library calls go to the simulator, which charges for them like for the firmware's own code
+#include <string.h>
+#define main firmware_main
+#define random firmware_random
+#define memcpy sim_memcpy
+#define strlen sim_strlen
+#include "main.c"
+#undef strlen
+#undef memcpy
+#undef random
+#undef main
@@ -0,0 +1,2 @@
+// simulated driverlib, see hostsim.h
+#include "hostsim.h"
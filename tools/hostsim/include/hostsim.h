@@ -0,0 +1,376 @@
+/**
+ * Host simulator for the CC1350 firmware: every driverlib header main.c includes forwards here, so main.c builds unchanged with gcc
+ * and runs on the PC against a model of the hardware it uses (UART0 with its FIFOs, RTS/CTS and uDMA, GPT0, TRNG, AON_BATMON, GPIO, PRCM, the NVIC)
+ *
+ * time is virtual: a 48 MHz cycle count that moves forward only by the model below, so a run is the same every time
+ * - every basic block of firmware code costs a cycle per instruction in it (gcc -fsanitize-coverage=trace-pc calls us once per block,
+ *   blocks.awk counts the instructions in the disassembly), a divide costs more, see the Makefile
+ *   these are x86 instructions, close enough to Thumb-2 for comparing two versions of the same code, not for the exact count
+ * - every driverlib call costs SIM_CALL_CYCLES and every HWREG access SIM_REG_CYCLES
+ * - taking an interrupt costs SIM_ISR_CYCLES, PRCMSleep jumps straight to the next thing that wakes the CPU
+ * the DWT cycle counter (CYCCNT) reads the awake cycles of this clock, so the firmware's own profiler ("prof") reports modeled cycles
+ */
+#ifndef HOSTSIM_H
+#define HOSTSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// the cost model, in CPU cycles
+#define SIM_CLOCK_HZ 48000000
+#define SIM_BLOCK_CYCLES 5 // a basic block missing from the table (or without one), a Cortex-M3 block is ~4 instructions
+#define SIM_CALL_CYCLES 10 // call and return plus a peripheral register access or two
+#define SIM_REG_CYCLES 2 // one load or store on the peripheral bus
+#define SIM_ISR_CYCLES 22 // 12 cycles to stack the registers and fetch the vector, 10 to return
+
+// the C library isn't built with the firmware, main.c's calls to it are renamed to these (see firmware.h) and cost a call plus a cycle per byte,
+// about what a word at a time copy loop on the Cortex-M3 takes
+void *sim_memcpy(void *destination, const void *source, size_t length);
+size_t sim_strlen(const char *text);
+
+// direct register access: HWREG(address) is a word in the simulated register file, registers that change by themselves are brought up to date on every access
+volatile uint32_t *sim_reg(uint32_t address);
+#define HWREG(x) (*sim_reg((uint32_t) (x)))
+
+// memory map and register offsets (inc/hw_*.h)
+#define UART0_BASE 0x40001000
+#define GPT0_BASE 0x40010000
+#define GPT1_BASE 0x40011000
+#define GPT2_BASE 0x40012000
+#define GPT3_BASE 0x40013000
+#define UDMA0_BASE 0x40020000
+#define GPIO_BASE 0x40022000
+#define TRNG_BASE 0x40028000
+#define AON_BATMON_BASE 0x40095000
+#define CPU_DWT_BASE 0xE0001000
+#define CPU_SCS_BASE 0xE000E000
+
+#define UART_O_DR 0x00000000
+#define UART_O_FR 0x00000018
+#define GPIO_O_DOUT7_4 0x00000004
+#define GPT_O_TAMR 0x00000004
+#define GPT_TAMR_TAMIE 0x00000020
+#define TRNG_O_OUT0 0x00000000
+#define TRNG_O_OUT1 0x00000004
+#define TRNG_O_ALARMCNT 0x0000001C
+#define TRNG_O_FROEN 0x00000020
+#define TRNG_O_FRODETUNE 0x00000024
+#define TRNG_O_ALARMMASK 0x00000028
+#define TRNG_O_ALARMSTOP 0x0000002C
+#define TRNG_O_SWRESET 0x00001FF0
+#define TRNG_ALARMCNT_SHUTDOWN_CNT_M 0x3F000000
+#define TRNG_ALARMCNT_SHUTDOWN_CNT_S 24
+#define AON_BATMON_O_TEMP 0x00000030
+#define AON_BATMON_TEMP_INT_M 0x0001FF00
+#define AON_BATMON_TEMP_INT_S 8
+#define CPU_DWT_O_CTRL 0x00000000
+#define CPU_DWT_O_CYCCNT 0x00000004
+#define CPU_DWT_CTRL_CYCCNTENA 0x00000001
+#define CPU_SCS_O_DEMCR 0x00000DFC
+#define CPU_SCS_DEMCR_TRCENA 0x01000000
+
+// interrupts (inc/hw_ints.h, driverlib/interrupt.h)
+#define INT_AON_GPIO_EDGE 16
+#define INT_UART0_COMB 21
+#define INT_GPT0A 31
+#define INT_TRNG_IRQ 48
+#define INT_PRI_LEVEL0 0x00
+#define INT_PRI_LEVEL1 0x20
+#define INT_PRI_LEVEL2 0x40
+#define INT_PRI_LEVEL3 0x60
+#define INT_PRI_LEVEL4 0x80
+#define INT_PRI_LEVEL5 0xA0
+#define INT_PRI_LEVEL6 0xC0
+#define INT_PRI_LEVEL7 0xE0
+
+bool IntMasterEnable(void);
+bool IntMasterDisable(void);
+void IntPrioritySet(uint32_t interrupt, uint8_t priority);
+void IntPendSet(uint32_t interrupt);
+
+// IOC
+#define IOID_2 2
+#define IOID_3 3
+#define IOID_6 6
+#define IOID_7 7
+#define IOID_13 13
+#define IOID_14 14
+#define IOID_18 18
+#define IOID_19 19
+#define IOC_IOPULL_UP 0x00004000
+#define IOC_HYST_ENABLE 0x40000000
+#define IOC_INT_ENABLE 0x00040000
+#define IOC_FALLING_EDGE 0x00010000
+#define IOC_PORT_GPIO 0x00000000
+#define IOC_PORT_MCU_PORT_EVENT2 0x00000019
+#define IOC_PORT_MCU_PORT_EVENT4 0x0000001B
+#define IOC_STD_OUTPUT 0x00002000
+
+void IOCPinTypeGpioOutput(uint32_t io);
+void IOCPinTypeGpioInput(uint32_t io);
+void IOCPinTypeUart(uint32_t base, uint32_t rx, uint32_t tx, uint32_t cts, uint32_t rts);
+void IOCPortConfigureSet(uint32_t io, uint32_t port, uint32_t config);
+void IOCIOPortPullSet(uint32_t io, uint32_t pull);
+void IOCIOHystSet(uint32_t io, uint32_t hysteresis);
+void IOCIOIntSet(uint32_t io, uint32_t enable, uint32_t edge);
+void IOCIntClear(uint32_t io);
+uint32_t IOCIntStatus(uint32_t io);
+void IOCIntRegister(void (*handler)(void));
+
+// PRCM
+#define PRCM_DOMAIN_PERIPH 0x00000004
+#define PRCM_DOMAIN_SERIAL 0x00000002
+#define PRCM_DOMAIN_POWER_ON 0x00000001
+#define PRCM_PERIPH_TIMER0 0x00000000
+#define PRCM_PERIPH_TIMER1 0x00000001
+#define PRCM_PERIPH_TIMER2 0x00000002
+#define PRCM_PERIPH_UDMA 0x00000108
+#define PRCM_PERIPH_TRNG 0x00000105
+#define PRCM_PERIPH_UART0 0x00000400
+#define PRCM_PERIPH_GPIO 0x00000501
+#define PRCM_CLOCK_DIV_16 0x00000004
+
+void PRCMPowerDomainOn(uint32_t domains);
+uint32_t PRCMPowerDomainStatus(uint32_t domains);
+void PRCMPeripheralRunEnable(uint32_t peripheral);
+void PRCMPeripheralSleepEnable(uint32_t peripheral);
+void PRCMLoadSet(void);
+bool PRCMLoadGet(void);
+void PRCMGPTimerClockDivisionSet(uint32_t divider);
+void PRCMSleep(void);
+
+// GPT
+#define TIMER_A 0x000000FF
+#define TIMER_B 0x0000FF00
+#define TIMER_CFG_ONE_SHOT 0x00000021
+#define TIMER_CFG_PERIODIC_UP 0x00000012
+#define TIMER_CFG_SPLIT_PAIR 0x04000000
+#define TIMER_CFG_A_PWM 0x0000000A
+#define TIMER_TIMA_TIMEOUT 0x00000001
+#define TIMER_TIMA_MATCH 0x00000010
+
+void TimerConfigure(uint32_t base, uint32_t config);
+void TimerLoadSet(uint32_t base, uint32_t timer, uint32_t value);
+void TimerMatchSet(uint32_t base, uint32_t timer, uint32_t value);
+uint32_t TimerValueGet(uint32_t base, uint32_t timer);
+void TimerEnable(uint32_t base, uint32_t timer);
+void TimerDisable(uint32_t base, uint32_t timer);
+void TimerIntEnable(uint32_t base, uint32_t flags);
+void TimerIntDisable(uint32_t base, uint32_t flags);
+void TimerIntClear(uint32_t base, uint32_t flags);
+void TimerIntRegister(uint32_t base, uint32_t timer, void (*handler)(void));
+
+// UART
+#define UART_INT_OE 0x400
+#define UART_INT_BE 0x200
+#define UART_INT_PE 0x100
+#define UART_INT_FE 0x080
+#define UART_INT_RT 0x040
+#define UART_INT_TX 0x020
+#define UART_INT_RX 0x010
+#define UART_CONFIG_WLEN_8 0x00000060
+#define UART_CONFIG_STOP_ONE 0x00000000
+#define UART_CONFIG_PAR_NONE 0x00000000
+#define UART_FIFO_TX1_8 0x00000000
+#define UART_FIFO_TX2_8 0x00000001
+#define UART_FIFO_TX4_8 0x00000002
+#define UART_FIFO_TX6_8 0x00000003
+#define UART_FIFO_TX7_8 0x00000004
+#define UART_FIFO_RX1_8 0x00000000
+#define UART_FIFO_RX2_8 0x00000008
+#define UART_FIFO_RX4_8 0x00000010
+#define UART_FIFO_RX6_8 0x00000018
+#define UART_FIFO_RX7_8 0x00000020
+#define UART_RXERROR_OVERRUN 0x00000008
+#define UART_RXERROR_BREAK 0x00000004
+#define UART_RXERROR_PARITY 0x00000002
+#define UART_RXERROR_FRAMING 0x00000001
+#define UART_DMA_RX 0x00000001
+#define UART_DMA_TX 0x00000002
+
+void UARTEnable(uint32_t base);
+void UARTDisable(uint32_t base);
+void UARTConfigSetExpClk(uint32_t base, uint32_t clock, uint32_t baud, uint32_t config);
+void UARTFIFOLevelSet(uint32_t base, uint32_t tx_level, uint32_t rx_level);
+void UARTHwFlowControlEnable(uint32_t base);
+void UARTHwFlowControlDisable(uint32_t base);
+bool UARTCharsAvail(uint32_t base);
+bool UARTSpaceAvail(uint32_t base);
+int32_t UARTCharGetNonBlocking(uint32_t base);
+bool UARTCharPutNonBlocking(uint32_t base, uint8_t data);
+void UARTCharPut(uint32_t base, uint8_t data); // spins until the TX FIFO has room, awake
+bool UARTBusy(uint32_t base);
+void UARTIntRegister(uint32_t base, void (*handler)(void));
+void UARTIntEnable(uint32_t base, uint32_t flags);
+void UARTIntDisable(uint32_t base, uint32_t flags);
+uint32_t UARTIntStatus(uint32_t base, bool masked);
+void UARTIntClear(uint32_t base, uint32_t flags);
+void UARTDMAEnable(uint32_t base, uint32_t flags);
+void UARTDMADisable(uint32_t base, uint32_t flags);
+uint32_t UARTRxErrorGet(uint32_t base);
+void UARTRxErrorClear(uint32_t base);
+
+// uDMA
+#define UDMA_CHAN_UART0_RX 1
+#define UDMA_CHAN_UART0_TX 2
+#define UDMA_PRI_SELECT 0x00000000
+#define UDMA_ALT_SELECT 0x00000020
+#define UDMA_ATTR_USEBURST 0x00000001
+#define UDMA_ATTR_ALTSELECT 0x00000002
+#define UDMA_ATTR_HIGH_PRIORITY 0x00000004
+#define UDMA_ATTR_REQMASK 0x00000008
+#define UDMA_SIZE_8 0x00000000
+#define UDMA_SRC_INC_8 0x00000000
+#define UDMA_SRC_INC_NONE 0x0C000000
+#define UDMA_DST_INC_8 0x00000000
+#define UDMA_DST_INC_NONE 0xC0000000
+#define UDMA_ARB_2 0x00004000
+#define UDMA_ARB_4 0x00008000
+#define UDMA_ARB_M 0x0003C000
+#define UDMA_ARB_S 14
+#define UDMA_MODE_STOP 0x00000000
+#define UDMA_MODE_BASIC 0x00000001
+#define UDMA_MODE_PINGPONG 0x00000003
+
+typedef struct {
+    volatile void *pvSrcEndAddr;
+    volatile void *pvDstEndAddr;
+    volatile uint32_t ui32Control;
+    volatile uint32_t ui32Spare;
+} tDMAControlTable;
+
+void uDMAEnable(uint32_t base);
+void uDMAControlBaseSet(uint32_t base, void *table);
+void uDMAChannelAttributeEnable(uint32_t base, uint32_t channel, uint32_t attributes);
+void uDMAChannelAttributeDisable(uint32_t base, uint32_t channel, uint32_t attributes);
+void uDMAChannelControlSet(uint32_t base, uint32_t channel_structure, uint32_t control);
+void uDMAChannelTransferSet(uint32_t base, uint32_t channel_structure, uint32_t mode, void *source, void *destination, uint32_t count);
+void uDMAChannelEnable(uint32_t base, uint32_t channel);
+bool uDMAChannelIsEnabled(uint32_t base, uint32_t channel);
+uint32_t uDMAChannelModeGet(uint32_t base, uint32_t channel_structure);
+uint32_t uDMAChannelSizeGet(uint32_t base, uint32_t channel_structure);
+uint32_t uDMAIntStatus(uint32_t base);
+void uDMAIntClear(uint32_t base, uint32_t channels);
+
+// TRNG
+#define TRNG_NUMBER_READY 0x00000001
+#define TRNG_FRO_SHUTDOWN 0x00000002
+#define TRNG_HI_WORD 0x00000001
+#define TRNG_LOW_WORD 0x00000002
+
+void TRNGReset(void);
+void TRNGConfigure(uint32_t min_samples, uint32_t max_samples, uint32_t clocks_per_sample);
+void TRNGEnable(void);
+void TRNGDisable(void);
+uint32_t TRNGIntStatus(void);
+void TRNGIntEnable(uint32_t flags);
+void TRNGIntDisable(uint32_t flags);
+void TRNGIntClear(uint32_t flags);
+void TRNGIntRegister(void (*handler)(void));
+uint32_t TRNGStatusGet(void);
+uint32_t TRNGNumberGet(uint32_t word); // and acknowledges the number, like TRNGIntClear(TRNG_NUMBER_READY)
+
+// AON_BATMON
+void AONBatMonEnable(void);
+uint32_t AONBatMonBatteryVoltageGet(void);
+int32_t AONBatMonTemperatureGetDegC(void);
+bool AONBatMonNewBatteryMeasureReady(void);
+bool AONBatMonNewTempMeasureReady(void);
+
+
+// everything below is for the tests and benchmarks, the firmware doesn't see it
+
+#define SIM_MS(ms) ((uint64_t) (ms) * (SIM_CLOCK_HZ / 1000))
+
+// boot the firmware: reset every peripheral model and start the firmware's main() (built as firmware_main) from the top
+// once per process, the firmware's own globals keep their values, so a test that needs a fresh board is its own program
+// it runs in its own coroutine on the stack the linker symbols __stack and __STACK_END point at, like on the target
+void sim_boot(int (*firmware_main)(void));
+
+// let the firmware run for that much virtual time, the call comes back once the clock got there and the CPU is in thread mode
+void sim_run(uint64_t cycles);
+void sim_run_ms(uint32_t ms);
+// run in 1 ms steps until done() returns true or max_ms went by, returns done()
+bool sim_run_until(bool (*done)(void), uint32_t max_ms);
+
+uint64_t sim_cycles(void); // virtual time since boot
+uint64_t sim_awake_cycles(void); // the part of it the CPU wasn't in PRCMSleep
+uint64_t sim_blocks(void); // basic blocks run, counted for the firmware and for direct calls from a test alike
+
+// the most firmware stack used since boot or the last sim_stack_mark(), in bytes: the stack is painted below where the firmware stopped
+// and whatever got overwritten since has been used, interrupts included (x86 frames, they're bigger than the Cortex-M3's)
+uint32_t sim_stack_used(void);
+void sim_stack_mark(void);
+
+// the modeled cycles of firmware code a test calls directly (the clock only moves for the firmware's own main()), no boot needed
+void sim_measure_start(void);
+uint64_t sim_measure_cycles(void); // since sim_measure_start(), and stops measuring
+
+// the PC end of the serial line: what the firmware sent, and bytes to send it
+// the PC sends at its own baud rate (9600 at boot), a byte sent at the wrong rate arrives as a framing error and garbage
+void sim_uart_send(const void *data, size_t length);
+void sim_uart_send_line(const char *text); // the text and "\r", like pressing enter in a terminal
+size_t sim_uart_send_pending(void); // bytes not on the wire yet
+uint64_t sim_uart_send_done(void); // when the last byte the PC sent arrived
+void sim_uart_host_baud(uint32_t baud);
+// RTS/CTS on the PC side: with it on the PC only starts a byte while our RTS is asserted, but like a USB serial adapter it
+// notices RTS dropping late and sends up to "late_bytes" more, and it holds our transmit while "ready" is false
+void sim_uart_host_flow(bool rtscts, uint32_t late_bytes);
+void sim_uart_host_ready(bool ready);
+
+const char *sim_tx_data(void); // everything the firmware sent since the last sim_tx_clear(), null terminated for the text parts
+size_t sim_tx_length(void);
+uint64_t sim_tx_time(size_t index); // when byte "index" left the shift register
+bool sim_tx_contains(const char *text);
+size_t sim_tx_count(const char *text); // how many times text is in the output
+void sim_tx_clear(void);
+
+// UART counters the firmware can't see
+typedef struct {
+    uint64_t rx_bytes; // bytes that reached the RX FIFO
+    uint64_t rx_overruns; // bytes lost because the RX FIFO was full
+    uint64_t rx_framing; // bytes that arrived at the wrong baud rate
+    uint64_t rts_low_cycles; // time RTS was deasserted with flow control on
+    uint32_t rx_fifo_max; // the highest the RX FIFO ever got
+} sim_uart_stats_t;
+extern sim_uart_stats_t sim_uart_stats;
+
+// AON_BATMON: temperature and battery voltage as functions of time, measured every SIM_BATMON_PERIOD_MS
+// "noise" is the peak noise in battery LSBs (1/256 V), the voltage reading is rounded after adding it, like the real converter dithers
+#define SIM_BATMON_PERIOD_MS 50
+typedef void (*sim_batmon_waveform_t)(double seconds, double *temperature_c, double *volts);
+void sim_batmon(sim_batmon_waveform_t waveform, double noise);
+uint32_t sim_batmon_measurements(void);
+
+// when the firmware acknowledged its first TRNG number since boot, 0 if it hasn't yet
+uint64_t sim_trng_first_taken(void);
+// a broken noise source from the next number on, for the health tests: every number all zeros (what the repetition count test
+// catches), or the same number over and over (only the adaptive proportion test sees that one), or no number at all
+typedef enum {
+    SIM_TRNG_OK,
+    SIM_TRNG_STUCK,
+    SIM_TRNG_REPEAT,
+    SIM_TRNG_SILENT,
+} sim_trng_fault_t;
+void sim_trng_fault(sim_trng_fault_t fault);
+
+// GPIO and the PWM timers, for the LED tests
+uint32_t sim_gpio_dout(void); // GPIO DOUT7_4
+// how much of the time the LED on a DIO is lit: 0 or 1 from DOUT while GPIO has the pin, the duty cycle while a PWM timer drives it
+double sim_led_duty(uint32_t io);
+uint32_t sim_led_pwm_hz(uint32_t io); // the PWM frequency driving it, 0 if it's on GPIO or the timer is stopped
+
+// interrupts taken so far and the cycles spent in them, per handler
+typedef struct {
+    uint32_t calls;
+    uint64_t cycles; // from entry to return, nested higher priority interrupts included
+    uint32_t max_cycles;
+    uint32_t max_latency_cycles; // from the interrupt being asserted to its handler starting, behind PRIMASK or a more urgent handler
+    uint32_t nested; // calls that cut into another handler
+} sim_isr_stats_t;
+extern sim_isr_stats_t sim_uart_isr, sim_timer_isr, sim_trng_isr, sim_ioc_isr;
+// make every call of a handler take that many cycles more, as if it did that much work before its own code, more urgent ones can cut in
+void sim_isr_stretch(uint32_t interrupt, uint32_t cycles);
+
+#endif
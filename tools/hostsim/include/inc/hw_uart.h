@@ -0,0 +1,2 @@
+// simulated register map, see hostsim.h
+#include "hostsim.h"
@@ -0,0 +1,1575 @@
+// the hardware model behind hostsim.h: a virtual clock, the NVIC, and every peripheral main.c touches
+// peripherals only do something at an event (a character finished on the wire, the timer reached its match, the TRNG has a number),
+// so the clock can jump from one event to the next while the firmware sleeps, and a minute of an idle board takes microseconds to run
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "hostsim.h"
+
+#define NEVER UINT64_MAX
+
+// the firmware's stack, what the linker gives it on the target: __stack is the bottom and __STACK_END the top
+// the firmware (and every interrupt it takes) runs on it in a coroutine, so its stack_used() measures the real thing (in x86 frames)
+#define SIM_STACK_SIZE (256*1024)
+__asm__(".bss\n"
+        ".balign 16\n"
+        ".globl __stack\n"
+        "__stack:\n"
+        ".space " "262144" "\n"
+        ".globl __STACK_END\n"
+        "__STACK_END:\n"
+        ".text\n");
+extern uint32_t __stack;
+extern uint32_t __STACK_END;
+
+// time
+static uint64_t now; // 48 MHz cycles since boot
+static uint64_t sleep_cycles; // of those, spent in PRCMSleep
+static uint64_t next_event = NEVER; // the earliest time any peripheral has something to do
+static uint64_t run_until; // sim_run() hands control back once we get here
+static uint64_t block_count;
+
+// the firmware coroutine
+static ucontext_t host_context;
+static ucontext_t firmware_context;
+static int (*firmware_entry)(void);
+static bool in_firmware; // only the firmware's code moves the clock, a test calling a firmware function directly doesn't
+static uintptr_t firmware_sp; // about where the firmware's stack pointer was when it last handed control back
+
+static void schedule(void);
+static void run_events(void);
+static void check_interrupts(void);
+static void hook(uint32_t cycles);
+
+
+// NVIC: every interrupt is level triggered from its peripheral's state, plus a pending bit for IntPendSet
+// an interrupt runs when PRIMASK is clear and its priority is more urgent than whatever runs now, nested ones can cut in
+typedef struct {
+    uint32_t number;
+    void (*handler)(void);
+    uint8_t priority;
+    bool pended;
+    sim_isr_stats_t *stats;
+    uint64_t waiting_since; // when it was first asserted (or pended) without its handler running yet, NEVER if it isn't
+    uint32_t stretch; // extra cycles every call takes, from sim_isr_stretch()
+} sim_irq_t;
+
+#define IRQ_UART 0
+#define IRQ_GPT0 1
+#define IRQ_TRNG 2
+#define IRQ_IOC 3
+#define IRQ_COUNT 4
+
+sim_isr_stats_t sim_uart_isr, sim_timer_isr, sim_trng_isr, sim_ioc_isr;
+
+static sim_irq_t irqs[IRQ_COUNT];
+static bool primask;
+static int running_priority = 0x100; // thread mode is less urgent than any interrupt
+
+static bool irq_asserted(int irq);
+
+static sim_irq_t *irq_by_number(uint32_t number){
+    for (int i = 0; i < IRQ_COUNT; i++){
+        if (irqs[i].number == number){
+            return &irqs[i];
+        }
+    }
+    return NULL;
+}
+
+// the most urgent interrupt that wants to run, -1 for none, "masked" ignores PRIMASK and the running priority (what wakes the CPU from sleep)
+static int irq_next(bool masked){
+    int best = -1;
+    for (int i = 0; i < IRQ_COUNT; i++){
+        if (irqs[i].handler == NULL || !(irqs[i].pended || irq_asserted(i))){
+            continue;
+        }
+        if (!masked && irqs[i].priority >= running_priority){
+            continue;
+        }
+        if (best < 0 || irqs[i].priority < irqs[best].priority){
+            best = i;
+        }
+    }
+    return best;
+}
+
+// note when each interrupt started wanting to run, its latency is counted from there (masked or behind a more urgent handler alike)
+// peripheral events note it at the event's own time, the firmware's register writes where the clock is
+static void irq_note_waiting(uint64_t at){
+    for (int i = 0; i < IRQ_COUNT; i++){
+        bool waiting = irqs[i].handler != NULL && (irqs[i].pended || irq_asserted(i));
+        if (!waiting){
+            irqs[i].waiting_since = NEVER;
+        }
+        else if (irqs[i].waiting_since == NEVER){
+            irqs[i].waiting_since = at;
+        }
+    }
+}
+
+// take every interrupt that can run right now, called between any two things the firmware does
+static void check_interrupts(void){
+    if (!in_firmware){
+        return;
+    }
+    irq_note_waiting(now);
+    while (!primask){
+        int irq = irq_next(false);
+        if (irq < 0){
+            return;
+        }
+
+        sim_irq_t *entry = &irqs[irq];
+        int interrupted = running_priority;
+        uint64_t start = now;
+        if (now - entry->waiting_since > entry->stats->max_latency_cycles){
+            entry->stats->max_latency_cycles = (uint32_t) (now - entry->waiting_since);
+        }
+        entry->waiting_since = NEVER;
+        entry->stats->nested += (interrupted != 0x100);
+        entry->pended = false;
+        running_priority = entry->priority;
+        now += SIM_ISR_CYCLES / 2;
+        // a stretched handler works that long first, anything more urgent can still cut in
+        for (uint32_t cycles = 0; cycles < entry->stretch; cycles += SIM_CALL_CYCLES){
+            hook(SIM_CALL_CYCLES);
+        }
+        entry->handler();
+        now += SIM_ISR_CYCLES - SIM_ISR_CYCLES / 2;
+        running_priority = interrupted;
+
+        uint64_t spent = now - start;
+        entry->stats->calls++;
+        entry->stats->cycles += spent;
+        if (spent > entry->stats->max_cycles){
+            entry->stats->max_cycles = (uint32_t) spent;
+        }
+        if (now >= next_event){
+            run_events();
+        }
+    }
+}
+
+// hand control to the test, from the firmware's side
+static void firmware_yield(void){
+    uint32_t here; // our own local variable is about where the stack pointer is
+    firmware_sp = (uintptr_t) &here;
+    in_firmware = false;
+    swapcontext(&firmware_context, &host_context);
+    in_firmware = true;
+}
+
+// hand control back to the test, only from thread mode so the firmware is never stopped in the middle of an interrupt
+static void yield_if_done(void){
+    if (in_firmware && running_priority == 0x100 && now >= run_until){
+        firmware_yield();
+    }
+}
+
+// every driverlib call and register access goes through here: it takes time, and anything that became due on the way happens first
+static uint64_t measured; // what a test's direct calls cost between sim_measure_start() and sim_measure_cycles()
+static bool measuring;
+
+static void hook(uint32_t cycles){
+    if (!in_firmware){
+        measured += measuring ? cycles : 0;
+        return;
+    }
+    now += cycles;
+    if (now >= next_event){
+        run_events();
+    }
+    check_interrupts();
+    yield_if_done();
+}
+
+void *sim_memcpy(void *destination, const void *source, size_t length){
+    hook(SIM_CALL_CYCLES + length);
+    return memcpy(destination, source, length);
+}
+
+size_t sim_strlen(const char *text){
+    size_t length = strlen(text);
+    hook(SIM_CALL_CYCLES + length);
+    return length;
+}
+
+// the firmware spins on a status flag: the CPU stays awake while the clock runs to the next thing that can change it
+static void spin(void){
+    uint64_t until = next_event;
+    if (running_priority == 0x100 && run_until > now && run_until < until){
+        until = run_until; // thread mode can hand back to the test on the way
+    }
+    if (until == NEVER){
+        fprintf(stderr, "hostsim: the firmware waits for something that never happens\n");
+        exit(2);
+    }
+    now = (until > now) ? until : now;
+    hook(0);
+}
+
+// the cost of every basic block, made by blocks.awk from the disassembly of our own program next to it ("build/test_x.blocks"),
+// keyed by the block's return address from __sanitizer_cov_trace_pc relative to where the program was loaded
+extern char __executable_start;
+
+typedef struct {
+    uint32_t address;
+    uint32_t cycles;
+} block_cost_t;
+
+static block_cost_t *block_costs;
+static uint32_t block_cost_mask;
+
+static uint32_t block_hash(uint32_t address){
+    return (address * 0x9E3779B1u) >> 7;
+}
+
+static void block_costs_load(void){
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 8);
+    if (length <= 0){
+        return;
+    }
+    strcpy(&path[length], ".blocks");
+    FILE *file = fopen(path, "r");
+    if (file == NULL){
+        fprintf(stderr, "hostsim: no %s, every basic block costs %d cycles\n", path, SIM_BLOCK_CYCLES);
+        return;
+    }
+
+    uint32_t count = 0;
+    unsigned address, cycles;
+    while (fscanf(file, "%x %u", &address, &cycles) == 2){
+        count++;
+    }
+    uint32_t size = 1;
+    while (size < 2*count){
+        size *= 2;
+    }
+    block_costs = calloc(size, sizeof(block_cost_t));
+    block_cost_mask = size - 1;
+
+    rewind(file);
+    while (fscanf(file, "%x %u", &address, &cycles) == 2){
+        uint32_t slot = block_hash(address) & block_cost_mask;
+        while (block_costs[slot].address != 0){
+            slot = (slot + 1) & block_cost_mask;
+        }
+        block_costs[slot] = (block_cost_t) {address, cycles};
+    }
+    fclose(file);
+}
+
+static uint32_t block_cost(uintptr_t return_address){
+    if (block_costs == NULL){
+        return SIM_BLOCK_CYCLES;
+    }
+    uint32_t address = (uint32_t) (return_address - (uintptr_t) &__executable_start);
+    for (uint32_t slot = block_hash(address) & block_cost_mask; block_costs[slot].address != 0; slot = (slot + 1) & block_cost_mask){
+        if (block_costs[slot].address == address){
+            return block_costs[slot].cycles;
+        }
+    }
+    return 1; // a block that ends the function jumps to __sanitizer_cov_trace_pc, we return for it, all it had left was a return
+}
+// gcc calls this at the start of every basic block of code built with -fsanitize-coverage=trace-pc
+void __sanitizer_cov_trace_pc(void){
+    block_count++;
+    if (in_firmware){
+        now += block_cost((uintptr_t) __builtin_return_address(0));
+        if (now >= next_event){
+            run_events();
+            check_interrupts();
+        }
+    }
+    else if (measuring){
+        measured += block_cost((uintptr_t) __builtin_return_address(0));
+    }
+}
+
+bool IntMasterDisable(void){
+    hook(SIM_CALL_CYCLES);
+    bool was_masked = primask;
+    primask = true;
+    return was_masked;
+}
+
+bool IntMasterEnable(void){
+    bool was_masked = primask;
+    primask = false;
+    hook(SIM_CALL_CYCLES); // anything that became pending while masked runs now
+    return was_masked;
+}
+
+void IntPrioritySet(uint32_t interrupt, uint8_t priority){
+    hook(SIM_CALL_CYCLES);
+    sim_irq_t *irq = irq_by_number(interrupt);
+    if (irq != NULL){
+        irq->priority = priority;
+    }
+}
+
+void sim_isr_stretch(uint32_t interrupt, uint32_t cycles){
+    sim_irq_t *irq = irq_by_number(interrupt);
+    if (irq != NULL){
+        irq->stretch = cycles;
+    }
+}
+
+void IntPendSet(uint32_t interrupt){
+    sim_irq_t *irq = irq_by_number(interrupt);
+    if (irq != NULL){
+        irq->pended = true;
+    }
+    hook(SIM_CALL_CYCLES);
+}
+
+
+// UART0: a 32 byte FIFO each way, one character takes 10 bit times on the wire
+// the TX interrupt fires when the TX FIFO drains through its trigger level, RX while the RX FIFO is at or above its own,
+// RT when RX bytes sat in the FIFO for 32 bit times with nothing new
+// with flow control RTS is deasserted once the RX FIFO reaches its trigger level, and nothing is sent while the PC holds CTS off
+#define FIFO_SIZE 32
+#define FIFO_RESET_LEVEL 16 // both trigger levels are 1/2 after reset
+
+typedef struct {
+    uint8_t data[FIFO_SIZE];
+    uint8_t head;
+    uint8_t count;
+} fifo_t;
+
+static void fifo_push(fifo_t *fifo, uint8_t byte){
+    fifo->data[(fifo->head + fifo->count) % FIFO_SIZE] = byte;
+    fifo->count++;
+}
+
+static uint8_t fifo_pop(fifo_t *fifo){
+    uint8_t byte = fifo->data[fifo->head];
+    fifo->head = (fifo->head + 1) % FIFO_SIZE;
+    fifo->count--;
+    return byte;
+}
+
+static struct {
+    bool enabled;
+    uint32_t baud;
+    uint64_t char_cycles;
+    bool flow;
+    uint32_t ris; // raw interrupt status
+    uint32_t im; // interrupt mask
+    uint32_t dma; // UART_DMA_ bits
+    uint32_t rsr; // UART_RXERROR_ bits
+    uint8_t tx_level; // bytes, from UARTFIFOLevelSet()
+    uint8_t rx_level;
+    fifo_t tx;
+    bool tx_shifting;
+    uint8_t tx_shift; // the character on the wire
+    uint64_t tx_done; // when the character in the shift register is out
+    fifo_t rx;
+    uint64_t rt_at; // receive timeout
+    uint64_t rts_low_since;
+} uart;
+
+// the PC end
+static struct {
+    uint8_t *data;
+    size_t length;
+    size_t sent;
+    size_t capacity;
+    uint32_t baud;
+    bool rtscts;
+    uint32_t late_bytes;
+    uint32_t late_sent; // bytes started after RTS went low
+    bool ready; // the PC's RTS, our CTS
+    uint64_t arrive; // the byte on the wire arrives then, NEVER while nothing is being sent
+    uint64_t arrived; // when the last one did
+} host;
+
+// what the firmware sent
+static struct {
+    char *data;
+    uint64_t *time;
+    size_t length;
+    size_t capacity;
+} capture;
+
+sim_uart_stats_t sim_uart_stats;
+
+static uint64_t char_cycles(uint32_t baud){
+    return ((uint64_t) SIM_CLOCK_HZ * 10 + baud / 2) / baud;
+}
+
+static bool uart_rts(void){
+    return !uart.flow || uart.rx.count < uart.rx_level;
+}
+
+// RX is raised by a byte that fills the FIFO up to the trigger level, and cleared by reading it back below (or UARTIntClear)
+static void uart_rx_pushed(void){
+    if (uart.rx.count >= uart.rx_level){
+        uart.ris |= UART_INT_RX;
+    }
+}
+
+static void uart_rx_popped(void){
+    if (uart.rx.count < uart.rx_level){
+        uart.ris &= ~UART_INT_RX;
+    }
+    if (uart.rx.count == 0){
+        uart.ris &= ~UART_INT_RT;
+    }
+}
+
+static void capture_byte(uint8_t byte, uint64_t time){
+    if (capture.length + 1 >= capture.capacity){
+        capture.capacity = capture.capacity ? 2*capture.capacity : 4096;
+        capture.data = realloc(capture.data, capture.capacity);
+        capture.time = realloc(capture.time, capture.capacity * sizeof(uint64_t));
+    }
+    capture.data[capture.length] = (char) byte;
+    capture.time[capture.length] = time;
+    capture.length++;
+    capture.data[capture.length] = '\0';
+}
+
+// uDMA: just the two UART0 channels, each with a primary and an alternate control structure
+typedef struct {
+    uint32_t mode;
+    uint8_t *pointer; // the memory side, source for TX and destination for RX
+    uint32_t remaining;
+    uint32_t burst; // items per arbitration, from UDMA_ARB_
+} sim_dma_structure_t;
+
+typedef struct {
+    bool enabled;
+    uint32_t attributes;
+    bool alternate; // which structure is active
+    sim_dma_structure_t structure[2];
+} sim_dma_channel_t;
+
+static sim_dma_channel_t dma_channels[3]; // indexed by UDMA_CHAN_
+static uint32_t dma_done; // REQDONE, one bit per channel
+
+static sim_dma_channel_t *dma_channel(uint32_t channel){
+    return &dma_channels[(channel & 0x1F) < 3 ? (channel & 0x1F) : 0];
+}
+
+static bool dma_ready(uint32_t channel){
+    sim_dma_channel_t *dma = &dma_channels[channel];
+    return dma->enabled && !(dma->attributes & UDMA_ATTR_REQMASK);
+}
+
+// a structure is done, ping-pong carries on with the other one unless it was never armed again
+static void dma_structure_done(uint32_t channel){
+    sim_dma_channel_t *dma = &dma_channels[channel];
+    sim_dma_structure_t *structure = &dma->structure[dma->alternate];
+    structure->mode = UDMA_MODE_STOP;
+    dma_done |= 1u << channel;
+
+    sim_dma_structure_t *other = &dma->structure[!dma->alternate];
+    if (other->mode == UDMA_MODE_PINGPONG && structure->pointer != NULL){
+        dma->alternate = !dma->alternate;
+    }
+    else{
+        dma->enabled = false;
+    }
+}
+
+static void uart_tx_start(uint64_t time);
+
+// the uDMA keeps the TX FIFO full while it has bytes
+static void dma_tx_service(uint64_t time){
+    sim_dma_channel_t *dma = &dma_channels[UDMA_CHAN_UART0_TX];
+    while ((uart.dma & UART_DMA_TX) && dma_ready(UDMA_CHAN_UART0_TX) && uart.tx.count < FIFO_SIZE){
+        sim_dma_structure_t *structure = &dma->structure[dma->alternate];
+        if (structure->mode == UDMA_MODE_STOP || structure->remaining == 0){
+            break;
+        }
+        fifo_push(&uart.tx, *structure->pointer++);
+        structure->remaining--;
+        if (structure->remaining == 0){
+            dma_structure_done(UDMA_CHAN_UART0_TX);
+        }
+    }
+    uart_tx_start(time);
+}
+
+static void host_send_next(uint64_t time);
+
+// the UART asks for a burst while the RX FIFO is at its trigger level, burst requests are the only ones main.c lets through (UDMA_ATTR_USEBURST),
+// and every burst moves the arbitration size, what stays in the FIFO after that is the CPU's to read once RT fires
+static void dma_rx_service(void){
+    sim_dma_channel_t *dma = &dma_channels[UDMA_CHAN_UART0_RX];
+    bool took = false;
+    while ((uart.dma & UART_DMA_RX) && dma_ready(UDMA_CHAN_UART0_RX) && uart.rx.count >= uart.rx_level){
+        sim_dma_structure_t *structure = &dma->structure[dma->alternate];
+        if (structure->mode == UDMA_MODE_STOP || structure->remaining == 0){
+            break;
+        }
+        for (uint32_t i = 0; i < structure->burst && structure->remaining > 0; i++){
+            *structure->pointer++ = fifo_pop(&uart.rx);
+            structure->remaining--;
+        }
+        took = true;
+        if (structure->remaining == 0){
+            dma_structure_done(UDMA_CHAN_UART0_RX);
+        }
+    }
+    if (took){
+        uart_rx_popped();
+        host_send_next(now); // RTS may be back
+    }
+}
+
+// move the next TX FIFO byte into the shift register
+static void uart_tx_start(uint64_t time){
+    if (uart.tx_shifting || uart.tx.count == 0 || !uart.enabled || (uart.flow && !host.ready)){
+        return;
+    }
+    uint8_t before = uart.tx.count;
+    uart.tx_shifting = true;
+    uart.tx_done = time + uart.char_cycles;
+    uart.tx_shift = fifo_pop(&uart.tx);
+    if (before > uart.tx_level && uart.tx.count <= uart.tx_level){
+        uart.ris |= UART_INT_TX; // drained through the trigger level
+    }
+    schedule();
+}
+
+static void uart_tx_done(void){
+    uint64_t time = uart.tx_done;
+    capture_byte(uart.tx_shift, time);
+    uart.tx_shifting = false;
+    uart.tx_done = NEVER;
+    dma_tx_service(time); // the next character starts when this one ended, however late we got to it
+
+}
+
+// a byte from the PC arrived completely
+static void uart_rx_arrive(void){
+    uint64_t time = host.arrive;
+    uint8_t byte = host.data[host.sent++];
+    host.arrive = NEVER;
+    host.arrived = time;
+    sim_uart_stats.rx_bytes++;
+
+    // a byte sent at another rate is sampled at the wrong places, the stop bit is usually where a data bit is
+    uint32_t difference = (host.baud > uart.baud) ? host.baud - uart.baud : uart.baud - host.baud;
+    if (!uart.enabled || difference * 50 > uart.baud){
+        byte = (uint8_t) (byte * 7 + 0x5A);
+        uart.ris |= UART_INT_FE;
+        uart.rsr |= UART_RXERROR_FRAMING;
+        sim_uart_stats.rx_framing++;
+    }
+
+    if (uart.rx.count == FIFO_SIZE){
+        uart.ris |= UART_INT_OE;
+        uart.rsr |= UART_RXERROR_OVERRUN;
+        sim_uart_stats.rx_overruns++;
+    }
+    else{
+        fifo_push(&uart.rx, byte);
+        uart_rx_pushed();
+        if (uart.rx.count > sim_uart_stats.rx_fifo_max){
+            sim_uart_stats.rx_fifo_max = uart.rx.count;
+        }
+    }
+    uart.rt_at = time + uart.char_cycles * 32 / 10;
+    dma_rx_service();
+
+    if (uart.flow && !uart_rts() && uart.rts_low_since == NEVER){
+        uart.rts_low_since = time;
+    }
+    host_send_next(time);
+}
+
+// the PC starts its next byte if it has one and (with flow control) RTS lets it
+static void host_send_next(uint64_t time){
+    if (host.arrive != NEVER || host.sent >= host.length){
+        return;
+    }
+    if (uart_rts()){
+        host.late_sent = 0;
+        if (uart.rts_low_since != NEVER){
+            sim_uart_stats.rts_low_cycles += time - uart.rts_low_since;
+            uart.rts_low_since = NEVER;
+        }
+    }
+    else if (host.rtscts){
+        if (host.late_sent >= host.late_bytes){
+            return; // held off, an RX FIFO read brings us back here
+        }
+        host.late_sent++;
+    }
+    host.arrive = time + char_cycles(host.baud);
+    schedule();
+}
+
+void UARTEnable(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    uart.enabled = true;
+    uart_tx_start(now);
+}
+
+void UARTDisable(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    uart.enabled = false; // the character being sent still finishes
+}
+
+void UARTConfigSetExpClk(uint32_t base, uint32_t clock, uint32_t baud, uint32_t config){
+    hook(SIM_CALL_CYCLES);
+    uart.baud = baud;
+    uart.char_cycles = char_cycles(baud);
+}
+
+// 1/8, 2/8, 4/8, 6/8 and 7/8 of the FIFO
+static uint8_t fifo_level(uint32_t setting){
+    static const uint8_t levels[5] = {4, 8, 16, 24, 28};
+    return levels[(setting < 5) ? setting : 2];
+}
+
+void UARTFIFOLevelSet(uint32_t base, uint32_t tx_level, uint32_t rx_level){
+    hook(SIM_CALL_CYCLES);
+    uart.tx_level = fifo_level(tx_level);
+    uart.rx_level = fifo_level(rx_level >> 3);
+    dma_rx_service();
+}
+
+void UARTHwFlowControlEnable(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    uart.flow = true;
+    uart_tx_start(now);
+}
+
+void UARTHwFlowControlDisable(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    uart.flow = false;
+    uart_tx_start(now);
+    host_send_next(now);
+}
+
+bool UARTCharsAvail(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    return uart.rx.count > 0;
+}
+
+bool UARTSpaceAvail(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    return uart.tx.count < FIFO_SIZE;
+}
+
+int32_t UARTCharGetNonBlocking(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    if (uart.rx.count == 0){
+        return -1;
+    }
+    int32_t byte = fifo_pop(&uart.rx);
+    uart_rx_popped();
+    host_send_next(now);
+    return byte;
+}
+
+bool UARTCharPutNonBlocking(uint32_t base, uint8_t data){
+    hook(SIM_CALL_CYCLES);
+    if (uart.tx.count == FIFO_SIZE){
+        return false;
+    }
+    fifo_push(&uart.tx, data);
+    if (uart.tx.count > uart.tx_level){
+        uart.ris &= ~UART_INT_TX;
+    }
+    uart_tx_start(now);
+    return true;
+}
+
+void UARTCharPut(uint32_t base, uint8_t data){
+    while (!UARTCharPutNonBlocking(base, data)){
+        spin();
+    }
+}
+
+bool UARTBusy(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    return uart.tx_shifting || uart.tx.count > 0;
+}
+
+void UARTIntRegister(uint32_t base, void (*handler)(void)){
+    hook(SIM_CALL_CYCLES);
+    irqs[IRQ_UART].handler = handler;
+}
+
+void UARTIntEnable(uint32_t base, uint32_t flags){
+    uart.im |= flags;
+    hook(SIM_CALL_CYCLES);
+}
+
+void UARTIntDisable(uint32_t base, uint32_t flags){
+    hook(SIM_CALL_CYCLES);
+    uart.im &= ~flags;
+}
+
+uint32_t UARTIntStatus(uint32_t base, bool masked){
+    hook(SIM_CALL_CYCLES);
+    return masked ? (uart.ris & uart.im) : uart.ris;
+}
+
+void UARTIntClear(uint32_t base, uint32_t flags){
+    hook(SIM_CALL_CYCLES);
+    uart.ris &= ~flags;
+}
+
+void UARTDMAEnable(uint32_t base, uint32_t flags){
+    hook(SIM_CALL_CYCLES);
+    uart.dma |= flags;
+    dma_tx_service(now);
+    dma_rx_service();
+}
+
+void UARTDMADisable(uint32_t base, uint32_t flags){
+    hook(SIM_CALL_CYCLES);
+    uart.dma &= ~flags;
+}
+
+uint32_t UARTRxErrorGet(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    return uart.rsr;
+}
+
+void UARTRxErrorClear(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    uart.rsr = 0;
+}
+
+void uDMAEnable(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+}
+
+void uDMAControlBaseSet(uint32_t base, void *table){
+    hook(SIM_CALL_CYCLES);
+}
+
+void uDMAChannelAttributeEnable(uint32_t base, uint32_t channel, uint32_t attributes){
+    hook(SIM_CALL_CYCLES);
+    dma_channel(channel)->attributes |= attributes;
+    if (attributes & UDMA_ATTR_ALTSELECT){
+        dma_channel(channel)->alternate = true;
+    }
+}
+
+void uDMAChannelAttributeDisable(uint32_t base, uint32_t channel, uint32_t attributes){
+    hook(SIM_CALL_CYCLES);
+    dma_channel(channel)->attributes &= ~attributes;
+    if (attributes & UDMA_ATTR_ALTSELECT){
+        dma_channel(channel)->alternate = false;
+    }
+    dma_tx_service(now);
+    dma_rx_service(); // a request held off by REQMASK goes through now
+}
+
+void uDMAChannelControlSet(uint32_t base, uint32_t channel_structure, uint32_t control){
+    hook(SIM_CALL_CYCLES); // always bytes in main.c, only the burst size matters
+    dma_channel(channel_structure)->structure[(channel_structure & UDMA_ALT_SELECT) ? 1 : 0].burst = 1u << ((control & UDMA_ARB_M) >> UDMA_ARB_S);
+}
+
+void uDMAChannelTransferSet(uint32_t base, uint32_t channel_structure, uint32_t mode, void *source, void *destination, uint32_t count){
+    hook(SIM_CALL_CYCLES);
+    sim_dma_channel_t *dma = dma_channel(channel_structure);
+    sim_dma_structure_t *structure = &dma->structure[(channel_structure & UDMA_ALT_SELECT) ? 1 : 0];
+    structure->mode = mode;
+    structure->remaining = count;
+    // the UART data register is one end, the memory buffer the other
+    structure->pointer = ((channel_structure & 0x1F) == UDMA_CHAN_UART0_TX) ? (uint8_t *) source : (uint8_t *) destination;
+}
+
+void uDMAChannelEnable(uint32_t base, uint32_t channel){
+    hook(SIM_CALL_CYCLES);
+    dma_channel(channel)->enabled = true;
+    dma_tx_service(now);
+    dma_rx_service();
+}
+
+bool uDMAChannelIsEnabled(uint32_t base, uint32_t channel){
+    hook(SIM_CALL_CYCLES);
+    return dma_channel(channel)->enabled;
+}
+
+uint32_t uDMAChannelModeGet(uint32_t base, uint32_t channel_structure){
+    hook(SIM_CALL_CYCLES);
+    return dma_channel(channel_structure)->structure[(channel_structure & UDMA_ALT_SELECT) ? 1 : 0].mode;
+}
+
+uint32_t uDMAChannelSizeGet(uint32_t base, uint32_t channel_structure){
+    hook(SIM_CALL_CYCLES);
+    sim_dma_structure_t *structure = &dma_channel(channel_structure)->structure[(channel_structure & UDMA_ALT_SELECT) ? 1 : 0];
+    return (structure->mode == UDMA_MODE_STOP) ? 0 : structure->remaining;
+}
+
+uint32_t uDMAIntStatus(uint32_t base){
+    hook(SIM_CALL_CYCLES);
+    return dma_done;
+}
+
+void uDMAIntClear(uint32_t base, uint32_t channels){
+    hook(SIM_CALL_CYCLES);
+    dma_done &= ~channels;
+}
+
+
+// GPT0 counts at 48 MHz / 16 from the moment it's enabled, in one of two modes:
+// - TIMER_CFG_PERIODIC_UP counts up through the whole 32 bits and fires its match interrupt when the count equals the match value
+// - TIMER_CFG_ONE_SHOT counts down from the load value, fires its timeout interrupt at 0 and stops (what the first versions of main.c use)
+// GPT1 and GPT2 timer A are PWMs (TIMER_CFG_A_PWM): counting down from the load value, the output is high from the reload until the count
+// reaches the match value, so the duty cycle is (load - match) / load. they don't interrupt, only their settings are kept
+#define TIMER_DIVIDER 16
+
+static struct {
+    bool enabled;
+    bool one_shot;
+    uint64_t started;
+    uint32_t load;
+    uint32_t match;
+    uint32_t imr;
+    uint32_t ris;
+    uint64_t match_at;
+    uint64_t timeout_at;
+    uint32_t tamr; // GPT_O_TAMR, main.c sets TAMIE through HWREG
+} gpt0;
+
+static struct {
+    bool pwm;
+    bool enabled;
+    uint32_t load;
+    uint32_t match;
+} gpt_pwm[2]; // GPT1 and GPT2
+
+static int gpt_pwm_index(uint32_t base){
+    return (base == GPT1_BASE) ? 0 : (base == GPT2_BASE) ? 1 : -1;
+}
+
+static uint32_t gpt0_value(void){
+    if (!gpt0.enabled){
+        return 0;
+    }
+    uint64_t ticks = (now - gpt0.started) / TIMER_DIVIDER;
+    if (gpt0.one_shot){
+        return (ticks < gpt0.load) ? gpt0.load - (uint32_t) ticks : 0;
+    }
+    return (uint32_t) ticks;
+}
+
+static void gpt0_schedule(void){
+    gpt0.match_at = NEVER;
+    gpt0.timeout_at = NEVER;
+    if (gpt0.enabled && gpt0.one_shot){
+        gpt0.timeout_at = gpt0.started + (uint64_t) gpt0.load * TIMER_DIVIDER;
+    }
+    else if (gpt0.enabled){
+        uint64_t ticks = (now - gpt0.started) / TIMER_DIVIDER;
+        uint32_t ahead = gpt0.match - (uint32_t) ticks;
+        uint64_t at_ticks = ticks + (ahead ? ahead : 0x100000000ull); // equal right now already happened, the next time is a wrap away
+        gpt0.match_at = gpt0.started + at_ticks * TIMER_DIVIDER;
+    }
+    schedule();
+}
+
+static void gpt0_match(void){
+    if (gpt0.tamr & GPT_TAMR_TAMIE){
+        gpt0.ris |= TIMER_TIMA_MATCH;
+    }
+    gpt0.match_at = NEVER;
+    gpt0_schedule();
+}
+
+static void gpt0_timeout(void){
+    gpt0.ris |= TIMER_TIMA_TIMEOUT;
+    gpt0.enabled = false;
+    gpt0_schedule();
+}
+
+void TimerConfigure(uint32_t base, uint32_t config){
+    hook(SIM_CALL_CYCLES);
+    if (base == GPT0_BASE){
+        gpt0.enabled = false; // driverlib stops the timer first
+        gpt0.one_shot = (config == TIMER_CFG_ONE_SHOT);
+        gpt0_schedule();
+    }
+    else if (gpt_pwm_index(base) >= 0){
+        gpt_pwm[gpt_pwm_index(base)].enabled = false;
+        gpt_pwm[gpt_pwm_index(base)].pwm = (config & 0xFF) == TIMER_CFG_A_PWM;
+    }
+}
+
+void TimerLoadSet(uint32_t base, uint32_t timer, uint32_t value){
+    hook(SIM_CALL_CYCLES); // the up counter always runs through the whole 32 bits in main.c
+    if (base == GPT0_BASE){
+        gpt0.load = value;
+        if (gpt0.one_shot && gpt0.enabled){
+            gpt0.started = now; // a one-shot that's counting starts over from the new value
+            gpt0_schedule();
+        }
+    }
+    else if (gpt_pwm_index(base) >= 0){
+        gpt_pwm[gpt_pwm_index(base)].load = value;
+    }
+}
+
+void TimerMatchSet(uint32_t base, uint32_t timer, uint32_t value){
+    hook(SIM_CALL_CYCLES);
+    if (base == GPT0_BASE){
+        gpt0.match = value;
+        gpt0_schedule();
+    }
+    else if (gpt_pwm_index(base) >= 0){
+        gpt_pwm[gpt_pwm_index(base)].match = value;
+    }
+}
+
+uint32_t TimerValueGet(uint32_t base, uint32_t timer){
+    hook(SIM_CALL_CYCLES);
+    return (base == GPT0_BASE) ? gpt0_value() : 0;
+}
+
+void TimerEnable(uint32_t base, uint32_t timer){
+    hook(SIM_CALL_CYCLES);
+    if (base == GPT0_BASE && !gpt0.enabled){
+        gpt0.enabled = true;
+        gpt0.started = now;
+        gpt0_schedule();
+    }    else if (gpt_pwm_index(base) >= 0){
+        gpt_pwm[gpt_pwm_index(base)].enabled = true;
+    }
+}
+
+void TimerDisable(uint32_t base, uint32_t timer){
+    hook(SIM_CALL_CYCLES);
+    if (base == GPT0_BASE){
+        gpt0.enabled = false;
+        gpt0_schedule();
+    }    else if (gpt_pwm_index(base) >= 0){
+        gpt_pwm[gpt_pwm_index(base)].enabled = false;
+    }
+}
+
+void TimerIntEnable(uint32_t base, uint32_t flags){
+    if (base == GPT0_BASE){
+        gpt0.imr |= flags;
+    }
+    hook(SIM_CALL_CYCLES);
+}
+
+void TimerIntDisable(uint32_t base, uint32_t flags){
+    hook(SIM_CALL_CYCLES);
+    if (base == GPT0_BASE){
+        gpt0.imr &= ~flags;
+    }
+}
+
+void TimerIntClear(uint32_t base, uint32_t flags){
+    hook(SIM_CALL_CYCLES);
+    if (base == GPT0_BASE){
+        gpt0.ris &= ~flags;
+    }
+}
+
+void TimerIntRegister(uint32_t base, uint32_t timer, void (*handler)(void)){
+    hook(SIM_CALL_CYCLES);
+    if (base == GPT0_BASE){
+        irqs[IRQ_GPT0].handler = handler;
+    }
+}
+
+
+// TRNG: a new 64 bit number every min_samples * (clocks_per_sample + 1) * 16 cycles, the first one after enabling takes 4 times that
+// it waits with the next number until the last one was acknowledged (TRNGIntClear), the output comes from a fixed seed xorshift, so runs repeat
+// unless sim_trng_fault() broke it (or silenced it)
+#define TRNG_SAMPLE_CYCLES 16
+
+static struct {
+    bool enabled;
+    uint32_t min_samples;
+    uint32_t clocks_per_sample;
+    uint32_t status;
+    uint32_t mask;
+    uint64_t ready_at;
+    uint32_t out[2];
+    uint64_t state;
+    uint64_t first_taken;
+    sim_trng_fault_t fault;
+} trng;
+
+static uint64_t trng_number_cycles(void){
+    return (uint64_t) trng.min_samples * (trng.clocks_per_sample + 1) * TRNG_SAMPLE_CYCLES;
+}
+
+static void trng_ready(void){
+    if (trng.fault == SIM_TRNG_SILENT){
+        trng.ready_at = now + trng_number_cycles(); // nothing this time either, it picks up again once the fault is gone
+        schedule();
+        return;
+    }
+    if (trng.fault == SIM_TRNG_STUCK){
+        trng.out[0] = trng.out[1] = 0;
+    }
+    else if (trng.fault == SIM_TRNG_OK){
+        trng.state ^= trng.state << 13;
+        trng.state ^= trng.state >> 7;
+        trng.state ^= trng.state << 17;
+        trng.out[0] = (uint32_t) trng.state;
+        trng.out[1] = (uint32_t) (trng.state >> 32);
+    }
+    trng.status |= TRNG_NUMBER_READY;
+    trng.ready_at = NEVER;
+    schedule();
+}
+
+void TRNGReset(void){
+    hook(SIM_CALL_CYCLES);
+    trng.enabled = false;
+    trng.status = 0;
+    trng.ready_at = NEVER;
+    schedule();
+}
+
+void TRNGConfigure(uint32_t min_samples, uint32_t max_samples, uint32_t clocks_per_sample){
+    hook(SIM_CALL_CYCLES);
+    trng.min_samples = min_samples;
+    trng.clocks_per_sample = clocks_per_sample;
+}
+
+void TRNGEnable(void){
+    hook(SIM_CALL_CYCLES);
+    trng.enabled = true;
+    trng.status &= ~TRNG_NUMBER_READY;
+    trng.ready_at = now + 4*trng_number_cycles();
+    schedule();
+}
+
+void TRNGDisable(void){
+    hook(SIM_CALL_CYCLES);
+    trng.enabled = false;
+    trng.ready_at = NEVER;
+    schedule();
+}
+
+uint32_t TRNGIntStatus(void){
+    hook(SIM_CALL_CYCLES);
+    return trng.status;
+}
+
+uint32_t TRNGStatusGet(void){
+    hook(SIM_CALL_CYCLES);
+    return trng.status;
+}
+
+uint32_t TRNGNumberGet(uint32_t word){
+    uint32_t number = (word == TRNG_HI_WORD) ? trng.out[1] : trng.out[0];
+    TRNGIntClear(TRNG_NUMBER_READY);
+    return number;
+}
+
+void TRNGIntEnable(uint32_t flags){
+    trng.mask |= flags;
+    hook(SIM_CALL_CYCLES);
+}
+
+void TRNGIntDisable(uint32_t flags){
+    hook(SIM_CALL_CYCLES);
+    trng.mask &= ~flags;
+}
+
+void TRNGIntClear(uint32_t flags){
+    hook(SIM_CALL_CYCLES);
+    if ((flags & TRNG_NUMBER_READY) && (trng.status & TRNG_NUMBER_READY)){
+        trng.status &= ~TRNG_NUMBER_READY;
+        trng.first_taken = trng.first_taken ? trng.first_taken : now;
+        if (trng.enabled){
+            trng.ready_at = now + trng_number_cycles();
+            schedule();
+        }
+    }
+    trng.status &= ~(flags & TRNG_FRO_SHUTDOWN);
+}
+
+void TRNGIntRegister(void (*handler)(void)){
+    hook(SIM_CALL_CYCLES);
+    irqs[IRQ_TRNG].handler = handler;
+}
+
+uint64_t sim_trng_first_taken(void){
+    return trng.first_taken;
+}
+
+void sim_trng_fault(sim_trng_fault_t fault){
+    trng.fault = fault;
+}
+
+
+// AON_BATMON measures both values every SIM_BATMON_PERIOD_MS on its own, there's no interrupt, so nothing has to be scheduled:
+// a read works out which measurement is the latest, and the update flags say if there was a new one since the flag was read last
+static struct {
+    sim_batmon_waveform_t waveform;
+    double noise;
+    uint64_t read_battery; // the last measurement the update flags were read at
+    uint64_t read_temperature;
+} batmon;
+
+static void batmon_constant(double seconds, double *temperature_c, double *volts){
+    *temperature_c = 25.0;
+    *volts = 3.28;
+}
+
+static uint64_t batmon_index(void){
+    return now / SIM_MS(SIM_BATMON_PERIOD_MS);
+}
+
+// a fixed pseudo random number per measurement, -1 to 1
+static double batmon_noise(uint64_t index){
+    uint64_t x = index * 0x9E3779B97F4A7C15ull;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 29;
+    return (double) (x >> 11) / (double) (1ull << 52) - 1.0;
+}
+
+static void batmon_measure(double *temperature_c, uint32_t *battery){
+    uint64_t index = batmon_index();
+    double volts;
+    batmon.waveform((double) (index * SIM_BATMON_PERIOD_MS) / 1000.0, temperature_c, &volts);
+    double lsb = volts * 256.0 + batmon.noise * batmon_noise(index);
+    *battery = (lsb <= 0) ? 0 : (uint32_t) lrint(lsb) & 0x7FF; // 3 integer bits and 8 fraction bits
+}
+
+void AONBatMonEnable(void){
+    hook(SIM_CALL_CYCLES);
+}
+
+uint32_t AONBatMonBatteryVoltageGet(void){
+    hook(SIM_CALL_CYCLES);
+    double temperature;
+    uint32_t battery;
+    batmon_measure(&temperature, &battery);
+    return battery;
+}
+
+int32_t AONBatMonTemperatureGetDegC(void){
+    hook(SIM_CALL_CYCLES);
+    double temperature;
+    uint32_t battery;
+    batmon_measure(&temperature, &battery);
+    return (int32_t) lrint(temperature);
+}
+
+bool AONBatMonNewBatteryMeasureReady(void){
+    hook(SIM_CALL_CYCLES);
+    uint64_t index = batmon_index();
+    bool ready = index != batmon.read_battery;
+    batmon.read_battery = index; // reading the flag clears it
+    return ready;
+}
+
+bool AONBatMonNewTempMeasureReady(void){
+    hook(SIM_CALL_CYCLES);
+    uint64_t index = batmon_index();
+    bool ready = index != batmon.read_temperature;
+    batmon.read_temperature = index;
+    return ready;
+}
+
+void sim_batmon(sim_batmon_waveform_t waveform, double noise){
+    batmon.waveform = (waveform != NULL) ? waveform : batmon_constant;
+    batmon.noise = noise;
+}
+
+uint32_t sim_batmon_measurements(void){
+    return (uint32_t) batmon_index();
+}
+
+
+// IOC and PRCM: the buttons never get pressed, and every power domain and clock is on the moment it's asked for
+// which peripheral drives each DIO, only the LED pins matter: GPIO, or a timer's output through an MCU port event
+static uint32_t ioc_port[32];
+
+void IOCPinTypeGpioOutput(uint32_t io){ hook(SIM_CALL_CYCLES); ioc_port[io] = IOC_PORT_GPIO; }
+void IOCPinTypeGpioInput(uint32_t io){ hook(SIM_CALL_CYCLES); }
+void IOCPinTypeUart(uint32_t base, uint32_t rx, uint32_t tx, uint32_t cts, uint32_t rts){ hook(SIM_CALL_CYCLES); }
+void IOCPortConfigureSet(uint32_t io, uint32_t port, uint32_t config){ hook(SIM_CALL_CYCLES); ioc_port[io] = port; }
+void IOCIOPortPullSet(uint32_t io, uint32_t pull){ hook(SIM_CALL_CYCLES); }
+void IOCIOHystSet(uint32_t io, uint32_t hysteresis){ hook(SIM_CALL_CYCLES); }
+void IOCIOIntSet(uint32_t io, uint32_t enable, uint32_t edge){ hook(SIM_CALL_CYCLES); }
+void IOCIntClear(uint32_t io){ hook(SIM_CALL_CYCLES); }
+uint32_t IOCIntStatus(uint32_t io){ hook(SIM_CALL_CYCLES); return 0; }
+
+void IOCIntRegister(void (*handler)(void)){
+    hook(SIM_CALL_CYCLES);
+    irqs[IRQ_IOC].handler = handler;
+}
+
+void PRCMPowerDomainOn(uint32_t domains){ hook(SIM_CALL_CYCLES); }
+uint32_t PRCMPowerDomainStatus(uint32_t domains){ hook(SIM_CALL_CYCLES); return PRCM_DOMAIN_POWER_ON; }
+void PRCMPeripheralRunEnable(uint32_t peripheral){ hook(SIM_CALL_CYCLES); }
+void PRCMPeripheralSleepEnable(uint32_t peripheral){ hook(SIM_CALL_CYCLES); }
+void PRCMLoadSet(void){ hook(SIM_CALL_CYCLES); }
+bool PRCMLoadGet(void){ hook(SIM_CALL_CYCLES); return true; }
+void PRCMGPTimerClockDivisionSet(uint32_t divider){ hook(SIM_CALL_CYCLES); }
+
+// WFI: wakes up for any interrupt that's asserted, even with PRIMASK set (it then runs after IntMasterEnable)
+void PRCMSleep(void){
+    hook(SIM_CALL_CYCLES);
+    while (irq_next(true) < 0){
+        if (now >= run_until){
+            firmware_yield();
+            continue;
+        }
+        uint64_t wake = (next_event < run_until) ? next_event : run_until;
+        sleep_cycles += wake - now;
+        now = wake;
+        run_events();
+    }
+}
+
+
+// the register file behind HWREG: the registers main.c reads that change by themselves are refreshed before the access
+#define REG_SLOTS 64
+
+static struct {
+    uint32_t address;
+    uint32_t value;
+} regs[REG_SLOTS];
+
+static volatile uint32_t *reg_slot(uint32_t address){
+    for (int i = 0; i < REG_SLOTS; i++){
+        if (regs[i].address == address){
+            return &regs[i].value;
+        }
+        if (regs[i].address == 0){
+            regs[i].address = address;
+            regs[i].value = 0;
+            return &regs[i].value;
+        }
+    }
+    fprintf(stderr, "hostsim: out of register slots at 0x%08X\n", address);
+    exit(2);
+}
+
+volatile uint32_t *sim_reg(uint32_t address){
+    hook(SIM_REG_CYCLES);
+
+    volatile uint32_t *value = reg_slot(address);
+    switch (address){
+        case CPU_DWT_BASE + CPU_DWT_O_CYCCNT:
+            *value = (uint32_t) (now - sleep_cycles); // the DWT stops while the CPU sleeps
+            break;
+        case TRNG_BASE + TRNG_O_OUT0:
+            *value = trng.out[0];
+            break;
+        case TRNG_BASE + TRNG_O_OUT1:
+            *value = trng.out[1];
+            break;
+        case AON_BATMON_BASE + AON_BATMON_O_TEMP: {
+            double temperature;
+            uint32_t battery;
+            batmon_measure(&temperature, &battery);
+            *value = ((uint32_t) (int32_t) floor(temperature) << AON_BATMON_TEMP_INT_S) & AON_BATMON_TEMP_INT_M;
+            break;
+        }
+        case GPT0_BASE + GPT_O_TAMR:
+            // main.c only ever sets TAMIE with |=, the match interrupt looks at the register itself when it fires
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+uint32_t sim_gpio_dout(void){
+    return *reg_slot(GPIO_BASE + GPIO_O_DOUT7_4);
+}
+
+// port events 2 and 4 are GPT1A and GPT2A, what main.c routes to the LEDs
+static int led_pwm_timer(uint32_t io){
+    return (ioc_port[io] == IOC_PORT_MCU_PORT_EVENT2) ? 0 : (ioc_port[io] == IOC_PORT_MCU_PORT_EVENT4) ? 1 : -1;
+}
+
+double sim_led_duty(uint32_t io){
+    int timer = led_pwm_timer(io);
+    if (timer < 0){
+        return (io >= 4 && io <= 7 && ioc_port[io] == IOC_PORT_GPIO && (sim_gpio_dout() >> (8 * (io - 4))) & 1) ? 1.0 : 0.0;
+    }
+    if (!gpt_pwm[timer].enabled || !gpt_pwm[timer].pwm || gpt_pwm[timer].load == 0 || gpt_pwm[timer].match >= gpt_pwm[timer].load){
+        return 0.0;
+    }
+    return (double) (gpt_pwm[timer].load - gpt_pwm[timer].match) / gpt_pwm[timer].load;
+}
+
+uint32_t sim_led_pwm_hz(uint32_t io){
+    int timer = led_pwm_timer(io);
+    if (timer < 0 || !gpt_pwm[timer].enabled || !gpt_pwm[timer].pwm || gpt_pwm[timer].load == 0){
+        return 0;
+    }
+    return SIM_CLOCK_HZ / TIMER_DIVIDER / gpt_pwm[timer].load;
+}
+
+
+// events
+static bool irq_asserted(int irq){
+    switch (irq){
+        case IRQ_UART:
+            return (uart.ris & uart.im) != 0 || (dma_done & ((1u << UDMA_CHAN_UART0_RX) | (1u << UDMA_CHAN_UART0_TX))) != 0;
+        case IRQ_GPT0:
+            return (gpt0.ris & gpt0.imr) != 0;
+        case IRQ_TRNG:
+            return (trng.status & trng.mask) != 0;
+        default:
+            return false;
+    }
+}
+
+static void schedule(void){
+    next_event = NEVER;
+    uint64_t times[6] = {uart.tx_done, host.arrive, uart.rt_at, gpt0.match_at, gpt0.timeout_at, trng.ready_at};
+    for (int i = 0; i < 6; i++){
+        if (times[i] < next_event){
+            next_event = times[i];
+        }
+    }
+}
+
+// handle everything that was due by now, in the order it happened
+static void run_events(void){
+    gpt0.tamr = *reg_slot(GPT0_BASE + GPT_O_TAMR);
+
+    while (1){
+        schedule();
+        if (next_event > now){
+            return;
+        }
+        uint64_t at = next_event;
+        if (next_event == uart.tx_done){
+            uart_tx_done();
+        }
+        else if (next_event == host.arrive){
+            uart_rx_arrive();
+        }
+        else if (next_event == uart.rt_at){
+            uart.rt_at = NEVER;
+            if (uart.rx.count > 0){
+                uart.ris |= UART_INT_RT;
+            }
+        }
+        else if (next_event == gpt0.match_at){
+            gpt0_match();
+        }
+        else if (next_event == gpt0.timeout_at){
+            gpt0_timeout();
+        }
+        else{
+            trng_ready();
+        }
+        irq_note_waiting(at);
+    }
+}
+
+
+// the test's side
+static void firmware_start(void){
+    in_firmware = true;
+    firmware_entry();
+    fprintf(stderr, "hostsim: the firmware's main() returned\n");
+    exit(2);
+}
+
+void sim_boot(int (*firmware_main)(void)){
+    if (block_costs == NULL){
+        block_costs_load();
+    }
+    now = 0;
+    sleep_cycles = 0;
+    block_count = 0;
+    primask = false;
+    running_priority = 0x100;
+    memset(irqs, 0, sizeof(irqs));
+    irqs[IRQ_UART] = (sim_irq_t) {INT_UART0_COMB, NULL, 0, false, &sim_uart_isr, NEVER, 0};
+    irqs[IRQ_GPT0] = (sim_irq_t) {INT_GPT0A, NULL, 0, false, &sim_timer_isr, NEVER, 0};
+    irqs[IRQ_TRNG] = (sim_irq_t) {INT_TRNG_IRQ, NULL, 0, false, &sim_trng_isr, NEVER, 0};
+    irqs[IRQ_IOC] = (sim_irq_t) {INT_AON_GPIO_EDGE, NULL, 0, false, &sim_ioc_isr, NEVER, 0};
+    sim_uart_isr = sim_timer_isr = sim_trng_isr = sim_ioc_isr = (sim_isr_stats_t) {0};
+
+    memset(&uart, 0, sizeof(uart));
+    uart.baud = 9600;
+    uart.char_cycles = char_cycles(uart.baud);
+    uart.tx_done = NEVER;
+    uart.rt_at = NEVER;
+    uart.rts_low_since = NEVER;
+    uart.tx_level = FIFO_RESET_LEVEL;
+    uart.rx_level = FIFO_RESET_LEVEL;
+    free(host.data);
+    memset(&host, 0, sizeof(host));
+    host.baud = 9600;
+    host.ready = true;
+    host.arrive = NEVER;
+    sim_tx_clear();
+    sim_uart_stats = (sim_uart_stats_t) {0};
+    memset(dma_channels, 0, sizeof(dma_channels));
+    dma_done = 0;
+
+    memset(&gpt0, 0, sizeof(gpt0));
+    memset(gpt_pwm, 0, sizeof(gpt_pwm));
+    memset(ioc_port, 0, sizeof(ioc_port));
+    gpt0.match_at = NEVER;
+    gpt0.timeout_at = NEVER;
+    memset(&trng, 0, sizeof(trng));
+    trng.ready_at = NEVER;
+    trng.state = 0x2545F4914F6CDD1Dull;
+    memset(&batmon, 0, sizeof(batmon));
+    sim_batmon(NULL, 0.0);
+    memset(regs, 0, sizeof(regs));
+    schedule();
+
+    firmware_sp = (uintptr_t) &__STACK_END;
+    sim_stack_mark();
+    firmware_entry = firmware_main;
+    getcontext(&firmware_context);
+    firmware_context.uc_stack.ss_sp = &__stack;
+    firmware_context.uc_stack.ss_size = (size_t) ((uint8_t *) &__STACK_END - (uint8_t *) &__stack);
+    firmware_context.uc_link = NULL;
+    makecontext(&firmware_context, firmware_start, 0);
+    run_until = 0; // the first sim_run() starts it
+}
+
+void sim_run(uint64_t cycles){
+    run_until = now + cycles;
+    swapcontext(&host_context, &firmware_context);
+}
+
+void sim_run_ms(uint32_t ms){
+    sim_run(SIM_MS(ms));
+}
+
+// the same paint as main.c's stack_paint(), so it works for a revision that doesn't have one and agrees with the one that does
+#define STACK_PAINT 0xDEADBEEF
+
+void sim_stack_mark(void){
+    for (uint32_t *word = &__stack; (uintptr_t) word < firmware_sp - 64; word++){
+        *word = STACK_PAINT;
+    }
+}
+
+uint32_t sim_stack_used(void){
+    uint32_t *word = &__stack;
+    while (word < &__STACK_END && *word == STACK_PAINT){
+        word++;
+    }
+    return (uint32_t) ((uint8_t *) &__STACK_END - (uint8_t *) word);
+}
+
+bool sim_run_until(bool (*done)(void), uint32_t max_ms){
+    for (uint32_t ms = 0; ms < max_ms && !done(); ms++){
+        sim_run_ms(1);
+    }
+    return done();
+}
+
+uint64_t sim_cycles(void){
+    return now;
+}
+
+uint64_t sim_awake_cycles(void){
+    return now - sleep_cycles;
+}
+
+uint64_t sim_blocks(void){
+    return block_count;
+}
+
+void sim_measure_start(void){
+    if (block_costs == NULL){
+        block_costs_load();
+    }
+    measured = 0;
+    measuring = true;
+}
+
+uint64_t sim_measure_cycles(void){
+    measuring = false;
+    return measured;
+}
+
+void sim_uart_send(const void *data, size_t length){
+    // bytes already sent are dropped from the front, a long stress test would pile them up otherwise
+    if (host.sent > 0 && host.sent == host.length){
+        host.sent = 0;
+        host.length = 0;
+    }
+    if (host.length + length > host.capacity){
+        host.capacity = (host.length + length) * 2;
+        host.data = realloc(host.data, host.capacity);
+    }
+    memcpy(host.data + host.length, data, length);
+    host.length += length;
+    host_send_next(now);
+}
+
+void sim_uart_send_line(const char *text){
+    sim_uart_send(text, strlen(text));
+    sim_uart_send("\r", 1);
+}
+
+size_t sim_uart_send_pending(void){
+    return host.length - host.sent;
+}
+
+uint64_t sim_uart_send_done(void){
+    return host.arrived;
+}
+
+void sim_uart_host_baud(uint32_t baud){
+    host.baud = baud;
+}
+
+void sim_uart_host_flow(bool rtscts, uint32_t late_bytes){
+    host.rtscts = rtscts;
+    host.late_bytes = late_bytes;
+}
+
+void sim_uart_host_ready(bool ready){
+    host.ready = ready;
+    uart_tx_start(now);
+}
+
+const char *sim_tx_data(void){
+    return (capture.data != NULL) ? capture.data : "";
+}
+
+size_t sim_tx_length(void){
+    return capture.length;
+}
+
+uint64_t sim_tx_time(size_t index){
+    return capture.time[index];
+}
+
+size_t sim_tx_count(const char *text){
+    size_t count = 0;
+    size_t length = strlen(text);
+    for (size_t i = 0; i + length <= capture.length; i++){
+        if (memcmp(capture.data + i, text, length) == 0){
+            count++;
+        }
+    }
+    return count;
+}
+
+bool sim_tx_contains(const char *text){
+    return sim_tx_count(text) > 0;
+}
+
+void sim_tx_clear(void){
+    capture.length = 0;
+    if (capture.data != NULL){
+        capture.data[0] = '\0';
+    }
+}
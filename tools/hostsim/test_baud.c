@@ -0,0 +1,104 @@
+// "baud" with the monitor printing faster than 9600 can send: the switch still happens, and quickly, because the other tasks hold
+// their output while the baud task drains the TX side, then the throughput of every rate and the fallback from each when the PC doesn't follow
+#include "firmware.h"
+#include "check.h"
+
+static bool switched(void){
+    return !tasks[TASK_BAUD].running || uart_baud_trial;
+}
+
+static bool drbg_running(void){
+    return tasks[TASK_DRBG].running;
+}
+
+static bool drbg_done(void){
+    return !tasks[TASK_DRBG].running && uart_tx_idle();
+}
+
+// switch to baud and confirm it from the PC, returns the ms from the command to the new rate
+static double switch_to(uint32_t baud){
+    char line[32];
+    snprintf(line, sizeof(line), "baud %u", baud);
+    sim_tx_clear();
+    sim_uart_send_line(line);
+    CHECK(sim_wait_for("Switching, change your terminal", 2000));
+    uint64_t start = sim_cycles();
+    CHECK(sim_run_until(switched, 5000));
+    CHECK(uart_baud == baud);
+    double ms = (sim_cycles() - start) / 48000.0;
+
+    sim_uart_host_baud(baud);
+    sim_uart_send_line("stat");
+    CHECK(sim_wait_for("uart ", 1000));
+    CHECK(!uart_baud_trial && !tasks[TASK_BAUD].running);
+    return ms;
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    // a monitor line every 10ms is ~3KB/s, three times what 9600 baud carries, the TX buffer never empties on its own
+    sim_uart_send_line("moni 10");
+    sim_run_ms(2000);
+    CHECK(uart_tx_space() < UART_TX_BUFFER_SIZE / 2);
+    double ms = switch_to(115200);
+    printf("9600 -> 115200 with moni 10 running: %.1f ms\n", ms);
+    CHECK(ms < 1000); // a full 512 byte buffer is ~530ms at 9600
+    CHECK(tasks[TASK_MONI].running);
+    sim_uart_send_line("stop");
+    CHECK(sim_wait_for("Operation stopped", 1000));
+    sim_run_ms(200);
+
+    // 4096 DRBG bytes are 8192 hex digits, how long they take at each rate
+    for (int i = 0; i < UART_BAUD_RATE_COUNT; i++){
+        uint32_t baud = uart_baud_rates[i];
+        if (uart_baud != baud){
+            switch_to(baud);
+        }
+        sim_run_ms(10);
+        sim_tx_clear();
+        uint64_t start = sim_cycles();
+        sim_uart_send_line("drbg 4096");
+        CHECK(sim_run_until(drbg_running, 1000));
+        CHECK(sim_run_until(drbg_done, 10000));
+        double seconds = (sim_cycles() - start) / 48e6;
+        double line = 100.0 * sim_tx_length() / seconds / (baud / 10.0);
+        printf("drbg 4096 at %7u baud: %zu bytes in %7.1f ms, %6.0f bytes/s, %3.0f%% of the line\n", baud, sim_tx_length(),
+               seconds * 1000, sim_tx_length() / seconds, line);
+        CHECK(sim_tx_length() > 8192 && line > 95 && line < 100.5); // the generator keeps ahead of the line even at 3 Mbaud
+    }
+
+    // the PC doesn't follow: back to 9600 after 5 seconds from every rate, with the monitor running again
+    switch_to(9600);
+    sim_uart_send_line("moni 10");
+    sim_run_ms(500);
+    for (int i = 0; i < UART_BAUD_RATE_COUNT; i++){
+        uint32_t baud = uart_baud_rates[i];
+        char line[32];
+        snprintf(line, sizeof(line), "baud %u", baud);
+        sim_tx_clear();
+        sim_uart_send_line(line);
+        CHECK(sim_wait_for("Switching, change your terminal", 2000));
+        if (baud == UART_BAUD_DEFAULT){
+            // already there, nothing to confirm and nothing to fall back from
+            CHECK(sim_run_until(switched, 5000));
+            CHECK(!uart_baud_trial && uart_baud == baud);
+            continue;
+        }
+        CHECK(sim_run_until(switched, 5000));
+        uint64_t start = sim_cycles();
+        CHECK(uart_baud == baud && uart_baud_trial);
+        CHECK(sim_wait_for("No command at the new baud rate, back to 9600\r\n", UART_BAUD_FALLBACK_MS + 2000));
+        double ms = (sim_cycles() - start) / 48000.0;
+        CHECK(uart_baud == 9600 && !uart_baud_draining && !uart_baud_trial && !tasks[TASK_BAUD].running);
+        CHECK(ms >= UART_BAUD_FALLBACK_MS && ms < UART_BAUD_FALLBACK_MS + 1000);
+        sim_uart_send_line("stat");
+        CHECK(sim_wait_for("uart 9600 baud", 2000));
+        CHECK(tasks[TASK_MONI].running);
+        printf("%7u baud, the PC stays at 9600: back after %.0f ms\n", baud, ms);
+    }
+
+    printf("test_baud: ok\n");
+    return 0;
+}
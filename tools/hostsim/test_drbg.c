@@ -0,0 +1,46 @@
+// the ChaCha20 block function against the RFC 8439 test vector, and a running DRBG can be stopped
+#include "firmware.h"
+#include "check.h"
+
+// RFC 8439 section 2.3.2: key 00 01 .. 1f, nonce 00 00 00 09 00 00 00 4a 00 00 00 00, block counter 1
+static const uint32_t rfc_key[8] = {0x03020100, 0x07060504, 0x0B0A0908, 0x0F0E0D0C, 0x13121110, 0x17161514, 0x1B1A1918, 0x1F1E1D1C};
+static const uint32_t rfc_nonce[3] = {0x09000000, 0x4A000000, 0x00000000};
+static const uint32_t rfc_block[16] = {
+    0xE4E7F110, 0x15593BD1, 0x1FDD0F50, 0xC47120A3, 0xC7F4D1C7, 0x0368C033, 0x9AAA2204, 0x4E6CD4C3,
+    0x466482D2, 0x09AA9F07, 0x05D7C214, 0xA2028BD9, 0xD19C12B5, 0xB94E16DE, 0xE883D0CB, 0x4E3C50A2,
+};
+
+static bool drbg_running(void){
+    return tasks[TASK_DRBG].running;
+}
+
+int main(void){
+    uint32_t block[16];
+    chacha20_block(rfc_key, 1, rfc_nonce, block);
+    CHECK(memcmp(block, rfc_block, sizeof(block)) == 0);
+
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    // 65536 bytes take over two minutes at 9600, only the DRBG is running while it prints: "stop" has to take it
+    sim_uart_send_line("drbg 65536");
+    CHECK(sim_run_until(drbg_running, 2000));
+    sim_run_ms(500);
+    sim_tx_clear();
+    sim_uart_send_line("stop");
+    CHECK(sim_wait_for("Operation stopped - waiting for next input\r\n", 2000));
+    CHECK(!drbg_running());
+    CHECK(sim_wait_for("(stat) - shows the UART rate and its error counters\r\n", 3000)); // and the menu, nothing runs any more
+
+    // and "stop drbg" stops just it
+    sim_uart_send_line("drbg 65536");
+    CHECK(sim_run_until(drbg_running, 2000));
+    sim_tx_clear();
+    sim_uart_send_line("stop drbg");
+    CHECK(sim_wait_for("Operation stopped - waiting for next input\r\n", 2000));
+    CHECK(!drbg_running());
+
+    printf("test_drbg: ok, %llu cycles per 64 byte block\n",
+           (unsigned long long) (drbg_block_stats.total_cycles / drbg_block_stats.calls));
+    return 0;
+}
@@ -0,0 +1,61 @@
+// RTS/CTS at 3 Mbaud: a burst of commands faster than main() can run them loses nothing with flow control on,
+// the firmware stops taking bytes while every line slot is busy and RTS holds the PC off, without it lines get dropped
+#include "firmware.h"
+#include "check.h"
+
+#define BURST_LINES 500
+
+// every command of the burst ran and its output is out
+static bool burst_done(void){
+    return sim_uart_send_pending() == 0 && uart_events.head == uart_events.tail && uart_tx_idle();
+}
+
+static void burst(void){
+    sim_tx_clear();
+    sim_uart_send_line("prof clear");
+    CHECK(sim_wait_for("Profiler cleared\r\n", 1000));
+    sim_uart_stats = (sim_uart_stats_t) {0};
+
+    // "stat" costs about as much CPU as 100 characters take to arrive at 3 Mbaud, main() falls behind right away
+    for (int i = 0; i < BURST_LINES; i++){
+        sim_uart_send("stat\r", 5);
+    }
+    CHECK(sim_run_until(burst_done, 60000));
+    sim_run_ms(10);
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    sim_uart_send_line("flow on");
+    CHECK(sim_wait_for("Hardware flow control on (RTS/CTS)\r\n", 1000));
+    sim_uart_host_flow(true, 3); // a USB serial adapter sends a few more bytes after RTS drops
+    sim_uart_send_line("baud 3000000");
+    CHECK(sim_wait_for("New baud rate, send any command to keep it\r\n", 1000));
+    sim_uart_host_baud(3000000);
+
+    burst();
+    printf("flow on:  %u lines posted, %u dropped, %u stalls, %llu overruns, RTS low %.1f ms, RX FIFO at most %u\n",
+           uart_rx_lines_posted, uart_rx_lines_dropped, uart_rx_stalls, (unsigned long long) sim_uart_stats.rx_overruns,
+           sim_uart_stats.rts_low_cycles / 48000.0, sim_uart_stats.rx_fifo_max);
+    CHECK(uart_rx_lines_posted == BURST_LINES);
+    CHECK(uart_rx_bytes == BURST_LINES * 5);
+    CHECK(uart_rx_lines_dropped == 0);
+    CHECK(uart_rx_overruns == 0 && sim_uart_stats.rx_overruns == 0);
+    CHECK(uart_rx_stalls > 0 && sim_uart_stats.rts_low_cycles > 0);
+    CHECK(sim_tx_count("rx bytes ") == BURST_LINES);
+
+    // the same burst without flow control, the firmware drops lines it has no slot for
+    sim_uart_send_line("flow off");
+    CHECK(sim_wait_for("Hardware flow control off\r\n", 1000));
+    sim_uart_host_flow(false, 0);
+    burst();
+    printf("flow off: %u lines posted, %u dropped, %u stalls, %llu overruns\n",
+           uart_rx_lines_posted, uart_rx_lines_dropped, uart_rx_stalls, (unsigned long long) sim_uart_stats.rx_overruns);
+    CHECK(uart_rx_lines_dropped > 0);
+    CHECK(uart_rx_stalls == 0);
+
+    printf("test_flow: ok\n");
+    return 0;
+}
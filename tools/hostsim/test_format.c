@@ -0,0 +1,100 @@
+// the number formatting against the C library: divide_by_100 for every uint32_t, format_u32/i32/hex over a sweep
+// that covers every length and every edge, format_fixed for every Q8 value the BATMON can report at 0 to 4 decimals
+// built without instrumentation (see the Makefile), nothing here boots the firmware
+#include "firmware.h"
+
+#include "check.h"
+
+static char expected[64];
+static char got[64];
+
+static void check_u32(uint32_t value){
+    int length = format_u32(got, value);
+    CHECK(length == snprintf(expected, sizeof(expected), "%u", value));
+    CHECK(memcmp(got, expected, length) == 0);
+}
+
+static void check_i32(int32_t value){
+    int length = format_i32(got, value);
+    CHECK(length == snprintf(expected, sizeof(expected), "%d", value));
+    CHECK(memcmp(got, expected, length) == 0);
+}
+
+static void check_hex(uint32_t value){
+    snprintf(expected, sizeof(expected), "%08X", value);
+    for (int digits = 1; digits <= 8; digits++){
+        CHECK(format_hex(got, value, digits) == digits);
+        CHECK(memcmp(got, &expected[8 - digits], digits) == 0); // the low "digits" digits
+    }
+}
+
+static void check_number(uint32_t value){
+    check_u32(value);
+    check_i32((int32_t) value);
+    check_hex(value);
+}
+
+int main(void){
+    // all 2^32 inputs, the multiply has to agree with the divide everywhere
+    uint32_t value = 0;
+    do {
+        if (divide_by_100(value) != value / 100){
+            fprintf(stderr, "divide_by_100(%u) = %u\n", value, divide_by_100(value));
+            CHECK(0);
+        }
+        value++;
+    } while (value != 0);
+
+    // every value below 2^20, then a million spread over the rest of the range, 4097 apart so the low digits keep changing
+    for (value = 0; value < (1u << 20); value++){
+        check_number(value);
+    }
+    for (uint64_t step = 0; step < (1ull << 32); step += (1u << 12) + 1){
+        check_number((uint32_t) step);
+    }
+    // around every power of 10 (where the length changes) and every power of 2, and the ends of the range
+    for (uint64_t power = 1; power <= 0xFFFFFFFFull; power *= 10){
+        for (int64_t offset = -2; offset <= 2; offset++){
+            if (power + offset <= 0xFFFFFFFFull && (int64_t) power + offset >= 0){
+                check_number((uint32_t) (power + offset));
+            }
+        }
+    }
+    for (int bit = 0; bit < 32; bit++){
+        check_number(1u << bit);
+        check_number((1u << bit) - 1);
+        check_number(0u - (1u << bit));
+    }
+    check_number(UINT32_MAX);
+    check_i32(INT32_MIN);
+    check_i32(INT32_MAX);
+
+    // Q8 from -70000 to 70000 (-273 to 273 degrees) at 0 to 4 decimals, printf gives the exact value rounded
+    // printf rounds an exact half to even where format_fixed rounds it away from zero, those are skipped,
+    // and printf keeps the sign of a negative value that rounds to zero ("-0.00"), format_fixed leaves it off on purpose
+    static const uint32_t scales[5] = {1, 10, 100, 1000, 10000};
+    uint32_t ties = 0;
+    for (int32_t q8 = -70000; q8 <= 70000; q8++){
+        for (int decimals = 0; decimals <= 4; decimals++){
+            uint32_t fraction = ((q8 < 0) ? 0u - (uint32_t) q8 : (uint32_t) q8) & 0xFF;
+            if (fraction*scales[decimals] % 256 == 128){
+                ties++;
+                continue;
+            }
+            int length = format_fixed(got, q8, 8, decimals);
+            snprintf(expected, sizeof(expected), "%.*f", decimals, q8 / 256.0);
+            const char *text = expected;
+            if (text[0] == '-' && strspn(&text[1], "0.") == strlen(&text[1])){
+                text++;
+            }
+            if (length != (int) strlen(text) || memcmp(got, text, length) != 0){
+                fprintf(stderr, "format_fixed(%d, 8, %d) = \"%.*s\", printf \"%s\"\n", q8, decimals, length, got, text);
+                CHECK(0);
+            }
+        }
+    }
+    CHECK(ties > 0);
+
+    printf("test_format: ok\n");
+    return 0;
+}
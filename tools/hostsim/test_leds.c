@@ -0,0 +1,148 @@
+// the LED blink sequencer's waveform: DOUT7_4 sampled every 100 us of virtual time, each step has to show up with the pattern's
+// colour for exactly its duration, for the built-in patterns and a loaded one, and "stop" leaves the LEDs off
+// then the PWM modes: "leds dim N" puts the square of N percent on both LEDs and nothing runs while it holds, "leds fade" moves
+// one level per step in opposite directions
+#include "firmware.h"
+#include "check.h"
+
+#define SAMPLE_CYCLES (SIM_CLOCK_HZ / 10000)
+#define EDGES_MAX 64
+
+typedef struct {
+    uint32_t dout;
+    uint32_t duration_ms;
+} level_t;
+
+// what DOUT7_4 did for "ms": every level it held between two changes and for how long (the first and last one are cut off, so they're dropped)
+static int record(uint32_t ms, level_t *levels){
+    uint32_t dout = sim_gpio_dout();
+    uint64_t since = 0;
+    int count = -1;
+
+    for (uint64_t end = sim_cycles() + SIM_MS(ms); sim_cycles() < end;){
+        sim_run(SAMPLE_CYCLES);
+        uint32_t now = sim_gpio_dout();
+        if (now == dout){
+            continue;
+        }
+        if (count >= 0 && count < EDGES_MAX){
+            uint64_t held = sim_cycles() - since;
+            levels[count] = (level_t) {dout, (uint32_t) ((held + SIM_MS(1) / 2) / SIM_MS(1))};
+        }
+        count++;
+        dout = now;
+        since = sim_cycles();
+    }
+    return count < EDGES_MAX ? count : EDGES_MAX;
+}
+
+// the levels have to be the pattern's steps in order (starting anywhere in it), each to the ms, at least twice round
+static void check_pattern(const char *command, const led_step_t *steps, int length){
+    sim_uart_send_line(command);
+    CHECK(sim_wait_for("LED blinker mode on\r\n", 500));
+    // a new pattern starts once the old one's current step is over, that's a second at most
+    sim_run_ms(1000);
+
+    uint32_t cycle_ms = 0;
+    for (int i = 0; i < length; i++){
+        cycle_ms += steps[i].duration_ms;
+    }
+    level_t levels[EDGES_MAX];
+    int count = record(3 * cycle_ms, levels);
+    CHECK(count >= 2 * length);
+
+    int start = -1;
+    for (int i = 0; i < length && start < 0; i++){
+        if (steps[i].dout == levels[0].dout && steps[i].duration_ms == levels[0].duration_ms){
+            start = i;
+        }
+    }
+    CHECK(start >= 0);
+    for (int i = 0; i < count; i++){
+        const led_step_t *step = &steps[(start + i) % length];
+        CHECK(levels[i].dout == step->dout);
+        CHECK(levels[i].duration_ms == step->duration_ms);
+    }
+    printf("%-28s %2d steps held to the ms\n", command, count);
+}
+
+// the duty cycle led_pwm_level() sets for a brightness, in whole timer ticks like the match register
+static double level_duty(uint32_t level){
+    return (LED_PWM_PERIOD * level * level / (LED_LEVEL_MAX * LED_LEVEL_MAX)) / (double) LED_PWM_PERIOD;
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+    CHECK(sim_gpio_dout() == LED_OFF);
+
+    check_pattern("leds", led_steps_cycle, sizeof(led_steps_cycle)/sizeof(led_steps_cycle[0]));
+    check_pattern("leds 2", led_steps_alternate, sizeof(led_steps_alternate)/sizeof(led_steps_alternate[0]));
+    check_pattern("leds 3", led_steps_heartbeat, sizeof(led_steps_heartbeat)/sizeof(led_steps_heartbeat[0]));
+
+    sim_uart_send_line("ledl r 200 g 300 b 100 o 250");
+    CHECK(sim_wait_for("Pattern loaded", 500));
+    static const led_step_t loaded[] = {{LED_RED, 200}, {LED_GREEN, 300}, {LED_BOTH, 100}, {LED_OFF, 250}};
+    check_pattern("leds 4", loaded, 4);
+
+    // a steady level: (N%)^2 of the 1 kHz period on both, with the timers doing all of it, the CPU doesn't wake up for it
+    static const uint32_t dims[] = {0, 30, 71, 100};
+    for (int i = 0; i < 4; i++){
+        char command[16];
+        snprintf(command, sizeof(command), "leds dim %u", dims[i]);
+        sim_uart_send_line(command);
+        CHECK(sim_wait_for("LED blinker mode on\r\n", 500));
+        sim_run_ms(1000); // the step that was running when it came in still ends with a timer tick
+        sim_timer_isr = (sim_isr_stats_t) {0};
+        uint64_t awake = sim_awake_cycles();
+        sim_run_ms(2000);
+
+        CHECK(sim_led_duty(IOID_6) == level_duty(dims[i]) && sim_led_duty(IOID_7) == level_duty(dims[i]));
+        CHECK(sim_led_pwm_hz(IOID_6) == 1000 && sim_led_pwm_hz(IOID_7) == 1000);
+        CHECK(sim_timer_isr.calls == 0 && sim_awake_cycles() == awake);
+        printf("%-28s red %5.1f%% green %5.1f%%, %llu cycles awake in 2 s\n", command, 100 * sim_led_duty(IOID_6),
+               100 * sim_led_duty(IOID_7), (unsigned long long) (sim_awake_cycles() - awake));
+    }
+
+    // fading: red's level goes one step per LED_FADE_STEP_MS while green's goes the other way, and they turn round at the ends
+    sim_uart_send_line("leds fade");
+    CHECK(sim_wait_for("LED blinker mode on\r\n", 500));
+    sim_run_ms(LED_FADE_STEP_MS / 2);
+    int last = -1, turns = 0, direction = 0;
+    for (int step = 0; step < 2 * LED_LEVEL_MAX + 20; step++){
+        sim_run_ms(LED_FADE_STEP_MS);
+        int red = -1;
+        for (int level = 0; level <= LED_LEVEL_MAX; level++){
+            if (sim_led_duty(IOID_6) == level_duty(level) && sim_led_duty(IOID_7) == level_duty(LED_LEVEL_MAX - level)){
+                red = level;
+            }
+        }
+        CHECK(red >= 0);
+        if (last >= 0){
+            CHECK(red - last == 1 || red - last == -1);
+            turns += (direction != 0 && red - last != direction);
+            direction = red - last;
+        }
+        last = red;
+    }
+    CHECK(turns == 2);
+    printf("%-28s %d steps of one level, turned round %d times\n", "leds fade", 2 * LED_LEVEL_MAX + 19, turns);
+
+    // back to a pattern: the pins go back to GPIO
+    sim_uart_send_line("leds 2");
+    CHECK(sim_wait_for("LED blinker mode on\r\n", 500));
+    sim_run_ms(1100);
+    CHECK(sim_led_pwm_hz(IOID_6) == 0 && sim_led_pwm_hz(IOID_7) == 0);
+    CHECK(sim_led_duty(IOID_6) + sim_led_duty(IOID_7) == 1.0);
+
+    // nothing blinks once it's stopped
+    sim_uart_send_line("stop");
+    sim_run_ms(100);
+    CHECK(sim_gpio_dout() == LED_OFF);
+    level_t levels[EDGES_MAX];
+    CHECK(record(3000, levels) <= 0 && sim_gpio_dout() == LED_OFF);
+    CHECK(sim_led_duty(IOID_6) == 0 && sim_led_duty(IOID_7) == 0);
+
+    printf("test_leds: ok\n");
+    return 0;
+}
@@ -0,0 +1,256 @@
+// "moni batch": the delta/varint encoder against a decoder written from the packet description in main.c,
+// first on synthetic traces straight through moni_batch_add (lossless, bytes per sample, encode cycles per sample),
+// then end to end: the firmware samples a simulated BATMON and the packets it sends are decoded off the serial line
+#include <math.h>
+
+#include "firmware.h"
+#include "check.h"
+
+#define TRACE_LENGTH 100000
+static int16_t trace_temp[TRACE_LENGTH];
+static uint16_t trace_bat[TRACE_LENGTH];
+static int16_t decoded_temp[MONI_BATCH_MAX];
+static uint16_t decoded_bat[MONI_BATCH_MAX];
+
+// xorshift32, the traces are the same every run
+static uint32_t state = 2463534242u;
+static uint32_t next_random(void){
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static uint32_t get_varint(const uint8_t *data, uint32_t *at){
+    uint32_t value = 0;
+    for (int shift = 0; ; shift += 7){
+        uint8_t byte = data[(*at)++];
+        value |= (uint32_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)){
+            return value;
+        }
+    }
+}
+
+static int32_t unzigzag(uint32_t value){
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+// a MONI_PACKET_BATCH payload into decoded_temp/bat, returns the sample count, the first sample number goes to *first
+static uint32_t decode_batch(const uint8_t *payload, uint32_t length, uint32_t *first){
+    *first = payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t) payload[3] << 24;
+    uint32_t count = payload[4];
+    decoded_temp[0] = (int16_t) (payload[5] | payload[6] << 8);
+    decoded_bat[0] = (uint16_t) (payload[7] | payload[8] << 8);
+    uint32_t at = MONI_BATCH_HEADER;
+    for (uint32_t i = 1; i < count; i++){
+        uint32_t head = get_varint(payload, &at);
+        decoded_bat[i] = (uint16_t) (decoded_bat[i - 1] + unzigzag(head >> 1));
+        decoded_temp[i] = decoded_temp[i - 1];
+        if (head & 1){
+            decoded_temp[i] = (int16_t) (decoded_temp[i] + unzigzag(get_varint(payload, &at)));
+        }
+    }
+    CHECK(at == length);
+    return count;
+}
+
+// the whole trace through the encoder "batch" samples at a time, every batch is decoded again and compared
+static void round_trip(const char *name, uint32_t batch){
+    uint64_t frame_bytes = 0;
+    uint64_t encode_cycles = 0;
+
+    moni_stream_samples = 0;
+    moni_batch_count = 0;
+    for (uint32_t i = 0; i < TRACE_LENGTH; i++){
+        moni_stream_samples++;
+        sim_measure_start();
+        moni_batch_add(trace_temp[i], trace_bat[i]);
+        encode_cycles += sim_measure_cycles();
+        if (moni_batch_count < batch && i != TRACE_LENGTH - 1){
+            continue;
+        }
+
+        // what moni_send_packet would send: sequence, type, the payload, CRC, COBS and the 0x00
+        uint32_t length = 3 + moni_batch_length;
+        moni_packet[length] = moni_packet[length + 1] = 0;
+        frame_bytes += cobs_encode(moni_packet, length + 2, moni_frame) + 1;
+
+        uint32_t first;
+        uint32_t count = decode_batch(&moni_packet[3], moni_batch_length, &first);
+        uint32_t start = i + 1 - count;
+        CHECK(count == moni_batch_count && first == start + 1);
+        for (uint32_t j = 0; j < count; j++){
+            CHECK(decoded_temp[j] == trace_temp[start + j] && decoded_bat[j] == trace_bat[start + j]);
+        }
+        moni_batch_count = 0;
+    }
+
+    double per_sample = (double) frame_bytes / TRACE_LENGTH;
+    printf("  %-24s batch %2u  %5.2f bytes/sample (%4.1fx less than text)  %5.1f cycles/sample to encode\n", name, batch,
+           per_sample, 11.0 / per_sample, (double) encode_cycles / TRACE_LENGTH);
+    if (batch == 64 && strcmp(name, "steady, rare 1 LSB") == 0){
+        CHECK(per_sample < 11.0 / 8); // an order of magnitude on steady data
+    }
+}
+
+// the synthetic traces, temperatures and battery readings in the ranges the BATMON registers have (9 bit signed, 11 bit Q8)
+static void trace_steady(void){
+    for (uint32_t i = 0; i < TRACE_LENGTH; i++){
+        trace_temp[i] = 25 + (next_random() % 1000 == 0);
+        trace_bat[i] = 840 + (next_random() % 50 == 0);
+    }
+}
+
+static void trace_walk(void){
+    int16_t temp = 25;
+    uint16_t bat = 840;
+    for (uint32_t i = 0; i < TRACE_LENGTH; i++){
+        uint32_t r = next_random();
+        temp += (r % 64 == 0) ? ((r & 64) ? 1 : -1) : 0;
+        bat += (int) (r >> 8) % 3 - 1;
+        trace_temp[i] = temp;
+        trace_bat[i] = bat;
+    }
+}
+
+static void trace_uniform(void){
+    for (uint32_t i = 0; i < TRACE_LENGTH; i++){
+        trace_temp[i] = (int16_t) (next_random() % 512) - 256;
+        trace_bat[i] = next_random() % 0x800;
+    }
+    // and the biggest jumps there are, both ways
+    for (uint32_t i = 0; i < 64; i++){
+        trace_temp[i] = (i & 1) ? 255 : -256;
+        trace_bat[i] = (i & 1) ? 0x7FF : 0;
+    }
+}
+
+// the end to end part: a cell running down, the temperature creeping up, fast enough that a sample a second off would read a few LSB off
+#define NOISE_LSB 1.5
+static void batmon_waveform(double seconds, double *temperature_c, double *volts){
+    *temperature_c = 24.6 + seconds / 100.0;
+    *volts = 3.30 - seconds / 100.0;
+}
+
+static uint32_t wanted_samples;
+static bool enough_samples(void){
+    return moni_samples >= wanted_samples;
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+    sim_batmon(batmon_waveform, NOISE_LSB);
+
+    // text first, for the bytes per sample to compare with
+    sim_uart_send_line("moni 100");
+    CHECK(sim_wait_for("Temperature and Battery monitor mode on\r\n", 500));
+    sim_run_ms(2000);
+    uint32_t samples = moni_samples;
+    uint32_t bytes = moni_bytes;
+    sim_run_ms(5000);
+    double text_per_sample = (double) (moni_bytes - bytes) / (moni_samples - samples);
+
+    // then a sample packet each, 9 bytes with the sequence and the CRC and 2 for COBS, no smaller than a short text line
+    sim_uart_send_line("moni bin 100");
+    sim_run_ms(2000);
+    samples = moni_samples;
+    bytes = moni_bytes;
+    sim_run_ms(5000);
+    double sample_per_sample = (double) (moni_bytes - bytes) / (moni_samples - samples);
+
+    sim_uart_send_line("moni batch 32 100");
+    sim_tx_clear();
+    bytes = moni_bytes;
+    wanted_samples = moni_samples + 10*32;
+    CHECK(sim_run_until(enough_samples, 40000));
+    sim_uart_send_line("stop moni");
+    CHECK(sim_wait_for("error counters\r\n", 5000)); // nothing else runs, so the menu comes back after the batch stop flushed
+    CHECK(sim_run_until(uart_tx_idle, 1000));
+
+    // every frame on the line: text fails the CRC, the rest are the start packet and batches, nothing may be missing
+    const uint8_t *data = (const uint8_t *) sim_tx_data();
+    size_t length = sim_tx_length();
+    uint8_t packet[MONI_FRAME_MAX];
+    uint32_t packets = 0, decoded = 0, next_sample = 1;
+    uint16_t sequence = 0;
+    double start_seconds = 0, worst = 0;
+    for (size_t start = 0, end; start < length; start = end + 1){
+        for (end = start; end < length && data[end] != 0x00; end++){
+        }
+        if (end == length || end == start || end - start > MONI_FRAME_MAX){
+            continue;
+        }
+        // COBS back to the packet
+        uint32_t out = 0;
+        bool ok = true;
+        for (size_t at = start; at < end && ok; ){
+            uint8_t code = data[at++];
+            ok = at + code - 1 <= end;
+            for (uint32_t i = 1; i < code && ok; i++){
+                packet[out++] = data[at++];
+            }
+            if (code != 0xFF && at < end){
+                packet[out++] = 0;
+            }
+        }
+        if (!ok || out < 5 || crc16_ccitt(0xFFFF, packet, out - 2) != (packet[out - 2] << 8 | packet[out - 1])){
+            continue;
+        }
+
+        uint16_t packet_sequence = packet[0] | packet[1] << 8;
+        CHECK(packets == 0 || packet_sequence == (uint16_t) (sequence + 1));
+        sequence = packet_sequence;
+        if (packets++ == 0){
+            CHECK(packet[2] == MONI_PACKET_START);
+            CHECK((packet[3] | packet[4] << 8) == 100);
+            // sample 1 is read right after the 0x00 in front of the start packet is written, which goes out behind the mode message at worst
+            start_seconds = (double) sim_tx_time(start - 1) / SIM_CLOCK_HZ;
+            continue;
+        }
+        CHECK(packet[2] == MONI_PACKET_BATCH);
+        uint32_t first;
+        uint32_t count = decode_batch(&packet[3], out - 5, &first);
+        CHECK(first == next_sample);
+        next_sample += count;
+        decoded += count;
+        // every reading is what the waveform says at its own time, (number - 1) periods after sample 1, give or take the noise,
+        // the LSB it was rounded to and the 50 ms BATMON measures in (plus the start packet's wait, both a fraction of an LSB here)
+        for (uint32_t i = 0; i < count; i++){
+            double temperature, volts;
+            double seconds = start_seconds + (first + i - 1) * 0.1;
+            batmon_waveform(seconds, &temperature, &volts);
+            CHECK(decoded_temp[i] <= temperature && decoded_temp[i] > temperature - 1.01); // TEMP INT is the whole degrees
+            double off = fabs(decoded_bat[i] - volts * 256);
+            CHECK(off <= NOISE_LSB + 0.5 + 0.5);
+            worst = (off > worst) ? off : worst;
+        }
+    }
+    CHECK(packets > 1 && decoded >= 10*32);
+    double batch_per_sample = (double) (moni_bytes - bytes) / decoded; // the start packet included
+    CHECK(sample_per_sample <= text_per_sample && text_per_sample / batch_per_sample > 4);
+    printf("moni on the simulated board, %.1f LSB of noise: text %.2f bytes/sample, binary %.2f, batch 32 %.2f over %u samples, %.2f LSB off the waveform at most\n",
+           NOISE_LSB, text_per_sample, sample_per_sample, batch_per_sample, decoded, worst);
+
+    // the codec on its own, on the traces the firmware would see and on the worst it could see
+    printf("synthetic traces, %d samples each:\n", TRACE_LENGTH);
+    static const uint32_t batches[] = {8, 32, 64};
+    static const struct {
+        const char *name;
+        void (*make)(void);
+    } traces[] = {
+        {"steady, rare 1 LSB", trace_steady},
+        {"random walk", trace_walk},
+        {"uniform random (worst)", trace_uniform},
+    };
+    for (size_t t = 0; t < sizeof(traces)/sizeof(traces[0]); t++){
+        traces[t].make();
+        for (size_t b = 0; b < sizeof(batches)/sizeof(batches[0]); b++){
+            round_trip(traces[t].name, batches[b]);
+        }
+    }
+
+    printf("test_moni_batch: ok\n");
+    return 0;
+}
@@ -0,0 +1,175 @@
+// "moni change" over 10 hours of a simulated battery: 3.30V down to 3.00V with 2 LSB of noise on every reading and a 2c swing
+// on the temperature, polled every MONI_CHANGE_POLL_MS. Every report has to be close to the truth at the time it went out, the serial
+// traffic has to be a small part of what "moni" once a second sends, and the CPU has to sleep more than it does for that too
+// then any other moni command leaves change mode, and in binary the poll number of every change packet gives the time it went out,
+// a TX buffer that was full for a few seconds in between too
+#include <math.h>
+
+#include "firmware.h"
+#include "check.h"
+
+#define HOURS 10
+#define NOISE_LSB 2.0
+#define TEXT_LINE 11 // "25c 3.28v\n\r", what "moni" sends once a second
+#define HOLD_MS 5000
+
+static void discharge(double seconds, double *temperature_c, double *volts){
+    *temperature_c = 25.0 + 2.0*sin(2*M_PI * seconds / 3600.0);
+    *volts = 3.30 - 0.30 * seconds / (HOURS*3600.0);
+}
+
+// COBS back to the packet, 0 if it isn't one or the CRC doesn't match
+static uint32_t unframe(const uint8_t *data, size_t length, uint8_t *packet){
+    uint32_t out = 0;
+    for (size_t at = 0; at < length; ){
+        uint8_t code = data[at++];
+        if (code == 0 || at + code - 1 > length){
+            return 0;
+        }
+        for (uint32_t i = 1; i < code; i++){
+            packet[out++] = data[at++];
+        }
+        if (code != 0xFF && at < length){
+            packet[out++] = 0;
+        }
+    }
+    return (out >= 5 && crc16_ccitt(0xFFFF, packet, out - 2) == (packet[out - 2] << 8 | packet[out - 1])) ? out : 0;
+}
+
+static void moni(const char *command){
+    sim_tx_clear();
+    sim_uart_send_line(command);
+    CHECK(sim_wait_for("Temperature and Battery monitor mode on\r\n", 500));
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+    sim_batmon(discharge, NOISE_LSB);
+
+    sim_uart_send_line("moni change");
+    CHECK(sim_wait_for("Temperature and Battery monitor mode on\r\n", 500));
+    sim_tx_clear();
+    uint64_t start = sim_cycles();
+    uint64_t awake_start = sim_awake_cycles();
+    uint32_t reports_start = moni_change_reports;
+    sim_run_ms(HOURS*3600*1000u);
+    uint64_t awake = sim_awake_cycles() - awake_start;
+    uint32_t reports = moni_change_reports - reports_start;
+
+    // every report against the waveform at the time its first byte went out: the temperature is within the 1c threshold
+    // (and the rounding), the voltage within 10mV and a little for the noise that's left after averaging 16 readings
+    const char *data = sim_tx_data();
+    size_t length = sim_tx_length();
+    uint32_t lines = 0;
+    double worst_mv = 0;
+    for (size_t at = 0; at < length; ){
+        int temp;
+        double volts;
+        int used;
+        CHECK(sscanf(&data[at], "%dc %lfv\n\r%n", &temp, &volts, &used) == 2 && used > 0);
+        double seconds = (double) (sim_tx_time(at) - start) / SIM_CLOCK_HZ;
+        double true_temp, true_volts;
+        discharge(seconds, &true_temp, &true_volts);
+        CHECK(fabs(temp - true_temp) <= 1.5);
+        double error_mv = fabs(volts - true_volts) * 1000.0;
+        worst_mv = fmax(worst_mv, error_mv);
+        CHECK(error_mv < 10.0 + 2.0);
+        lines++;
+        at += used;
+    }
+    CHECK(lines == reports);
+    // the voltage alone moves 300mV, that's 30 reports, the temperature swings 4c ten times over, a few per swing
+    CHECK(reports >= 90 && reports < 400);
+    double awake_percent = 100.0 * awake / (sim_cycles() - start);
+
+    // the same board printing once a second for an hour, for the bytes and the time awake to compare with
+    sim_uart_send_line("moni change off");
+    CHECK(sim_wait_for("Temperature and Battery monitor mode on\r\n", 500));
+    sim_tx_clear();
+    start = sim_cycles();
+    awake_start = sim_awake_cycles();
+    sim_run_ms(3600*1000u);
+    double every_second_percent = 100.0 * (sim_awake_cycles() - awake_start) / (sim_cycles() - start);
+    uint64_t every_second = (uint64_t) HOURS * sim_tx_length();
+    CHECK(every_second >= (uint64_t) HOURS*3600 * TEXT_LINE);
+
+    CHECK(length * 100 < every_second);
+    // a poll wakes the CPU a little more often than printing once a second does, but it's a few register reads and no line to format and queue
+    CHECK(awake_percent < every_second_percent);
+    printf("%d hours, %.0f LSB noise: %u reports, %zu bytes, worst voltage error %.1f mV, awake %.4f%%\n",
+           HOURS, NOISE_LSB, reports, length, worst_mv, awake_percent);
+    printf("once a second instead: %llu bytes, awake %.4f%%\n", (unsigned long long) every_second, every_second_percent);
+
+    // anything else but "moni change" goes back to every period, a plain format switch back to once a second
+    moni("moni change");
+    CHECK(moni_change && tasks[TASK_MONI].period_ms == MONI_CHANGE_POLL_MS);
+    moni("moni 500");
+    CHECK(!moni_change && tasks[TASK_MONI].period_ms == 500);
+    moni("moni change");
+    moni("moni bin");
+    CHECK(!moni_change && moni_binary && tasks[TASK_MONI].period_ms == 1000);
+
+    // binary change packets for an hour, with the PC holding CTS off while the TX buffer is full halfway through
+    sim_uart_send_line("flow on");
+    CHECK(sim_wait_for("Hardware flow control on (RTS/CTS)\r\n", 1000));
+    sim_uart_host_flow(true, 3);
+    moni("moni change");
+    sim_run_ms(1000);
+    sim_tx_clear();
+    sim_run_ms(1800*1000u);
+    double hold_seconds = (double) sim_cycles() / SIM_CLOCK_HZ;
+    sim_uart_host_ready(false);
+    while (uart_tx_room(TASK_LINE_MAX)){
+        uart_write("-", 1);
+    }
+    sim_run_ms(HOLD_MS);
+    sim_uart_host_ready(true);
+    sim_run_ms(1800*1000u);
+
+    // poll n was (n - 1) polls after the one the start packet went out in, and a packet goes out the moment its poll finds the change
+    // (the ones the hold kept back go out as the buffer drains, but with the numbers of their polls)
+    const uint8_t *frames = (const uint8_t *) sim_tx_data();
+    length = sim_tx_length();
+    uint8_t packet[MONI_FRAME_MAX];
+    double start_seconds = -1, worst_ms = 0;
+    uint32_t changes = 0, after = 0, last = 0;
+    for (size_t begin = 0, end; begin < length; begin = end + 1){
+        for (end = begin; end < length && frames[end] != 0x00; end++){
+        }
+        if (end == length){
+            break;
+        }
+        // the frame after the filler has no 0x00 in front of it
+        uint32_t out = 0;
+        size_t from = (end - begin > MONI_FRAME_MAX) ? end - MONI_FRAME_MAX : begin;
+        for (; from < end && out == 0; from++){
+            out = unframe(&frames[from], end - from, packet);
+        }
+        if (out == 0){
+            continue;
+        }
+        double seconds = (double) sim_tx_time(from - 1) / SIM_CLOCK_HZ; // when its first byte left
+        if (packet[2] == MONI_PACKET_START){
+            start_seconds = seconds;
+            continue;
+        }
+        CHECK(packet[2] == MONI_PACKET_CHANGE && start_seconds >= 0);
+        uint32_t poll = packet[3] | packet[4] << 8 | packet[5] << 16 | (uint32_t) packet[6] << 24;
+        CHECK(poll > last);
+        last = poll;
+        double off_ms = (seconds - start_seconds) * 1000.0 - (poll - 1) * (double) MONI_CHANGE_POLL_MS;
+        CHECK(off_ms > -5 && off_ms < HOLD_MS + 1000);
+        worst_ms = (off_ms < HOLD_MS && off_ms > worst_ms) ? off_ms : worst_ms;
+        changes++;
+        after += (seconds > hold_seconds);
+    }
+    CHECK(changes >= 5 && after >= 3 && worst_ms < 20);
+    printf("binary, 1 hour with a %d s hold: %u change packets, %u after it, out %.1f ms after their poll's time at most\n",
+           HOLD_MS / 1000, changes, after, worst_ms);
+    sim_uart_send_line("stop moni");
+    sim_uart_host_flow(false, 0);
+
+    printf("test_moni_change: ok\n");
+    return 0;
+}
@@ -0,0 +1,196 @@
+// binary monitor timestamps when the line can't keep up: the battery voltage is a ramp, so every reading says when it was measured,
+// and the time the decoder gives each sample (its number times the period) has to match that virtual clock however far behind it is
+// "moni bin 10" at 9600 baud: a sample packet takes longer on the line than the period, the monitor keeps waiting for TX room and misses ticks
+// "moni batch 8 10" with the TX buffer filled up halfway through a batch and the PC holding CTS off for a while: the monitor waits,
+// the batch that was being built goes out early once there's room and the next one starts with the number of its first sample
+#include <math.h>
+
+#include "firmware.h"
+#include "check.h"
+
+#define PERIOD_MS 10
+#define BATCH 8
+#define RAMP_LSB_PER_S 51.2 // 0.2 V a second, a measurement every 50 ms is 2.56 LSB apart
+#define HOLDS 3
+#define HOLD_MS 200
+#define TOLERANCE_MS 100 // a reading is up to 50 ms old and rounded to the LSB, for both ends of the difference
+
+static void batmon_ramp(double seconds, double *temperature_c, double *volts){
+    *temperature_c = 25.0;
+    *volts = 1.0 + seconds * RAMP_LSB_PER_S / 256.0;
+}
+
+static bool batch_half(void){
+    return moni_batch_count == BATCH / 2;
+}
+
+static uint32_t get_varint(const uint8_t *data, uint32_t *at){
+    uint32_t value = 0;
+    for (int shift = 0; ; shift += 7){
+        uint8_t byte = data[(*at)++];
+        value |= (uint32_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)){
+            return value;
+        }
+    }
+}
+
+static int32_t unzigzag(uint32_t value){
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+typedef struct {
+    uint32_t samples;
+    uint32_t number; // of the last one, the periods the stream ran for
+    uint32_t short_batches; // batches of fewer samples than asked for, cut short by a hold-up (the one "stop moni" flushed doesn't count)
+    double first_ms; // when sample 1 was measured
+    double worst_ms; // how far off the decoded time was at most
+} stream_t;
+
+// one sample as decoded: its time from its number against the time its battery reading says
+static void check_sample(stream_t *stream, uint32_t number, uint16_t bat){
+    double measured_ms = (bat - 256) / RAMP_LSB_PER_S * 1000.0;
+    if (stream->samples++ == 0){
+        CHECK(number == 1);
+        stream->first_ms = measured_ms;
+    }
+    CHECK(number > stream->number);
+    stream->number = number;
+    double off = fabs((number - 1) * (double) PERIOD_MS - (measured_ms - stream->first_ms));
+    CHECK(off < TOLERANCE_MS);
+    stream->worst_ms = (off > stream->worst_ms) ? off : stream->worst_ms;
+}
+
+// COBS back to the packet, 0 if it isn't one or the CRC doesn't match
+static uint32_t unframe(const uint8_t *data, size_t length, uint8_t *packet){
+    uint32_t out = 0;
+    for (size_t at = 0; at < length; ){
+        uint8_t code = data[at++];
+        if (code == 0 || at + code - 1 > length){
+            return 0;
+        }
+        for (uint32_t i = 1; i < code; i++){
+            packet[out++] = data[at++];
+        }
+        if (code != 0xFF && at < length){
+            packet[out++] = 0;
+        }
+    }
+    return (out >= 5 && crc16_ccitt(0xFFFF, packet, out - 2) == (packet[out - 2] << 8 | packet[out - 1])) ? out : 0;
+}
+
+// every frame on the line, numbered the way tools/moni_decode.py does it: a sample packet is one period after the sample before it
+// for every packet since, a batch carries the number of its first sample
+static stream_t decode(void){
+    const uint8_t *data = (const uint8_t *) sim_tx_data();
+    size_t length = sim_tx_length();
+    uint8_t packet[MONI_FRAME_MAX];
+    stream_t stream = {0};
+    uint32_t number = 0, last_count = 0;
+    uint16_t sequence = 0;
+    bool started = false;
+    for (size_t start = 0, end; start < length; start = end + 1){
+        for (end = start; end < length && data[end] != 0x00; end++){
+        }
+        if (end == length){
+            break;
+        }
+        // a frame right after a text line has no 0x00 in front of it, so it may start anywhere in its last MONI_FRAME_MAX bytes
+        uint32_t out = 0;
+        for (size_t from = (end - start > MONI_FRAME_MAX) ? end - MONI_FRAME_MAX : start; from < end && out == 0; from++){
+            out = unframe(&data[from], end - from, packet);
+        }
+        if (out == 0){
+            continue;
+        }
+
+        uint16_t packet_sequence = packet[0] | packet[1] << 8;
+        CHECK(!started || packet_sequence == (uint16_t) (sequence + 1)); // nothing is dropped, the monitor waits for room
+        if (packet[2] == MONI_PACKET_START){
+            CHECK(!started && (packet[3] | packet[4] << 8) == PERIOD_MS);
+            started = true;
+            sequence = packet_sequence;
+            continue;
+        }
+        CHECK(started);
+        if (packet[2] == MONI_PACKET_SAMPLE){
+            number += (uint16_t) (packet_sequence - sequence);
+            check_sample(&stream, number, (uint16_t) (packet[5] | packet[6] << 8));
+        } else {
+            CHECK(packet[2] == MONI_PACKET_BATCH);
+            uint32_t first = packet[3] | packet[4] << 8 | packet[5] << 16 | (uint32_t) packet[6] << 24;
+            uint32_t count = packet[7];
+            uint16_t bat = (uint16_t) (packet[10] | packet[11] << 8);
+            uint32_t at = MONI_BATCH_HEADER;
+            check_sample(&stream, first, bat);
+            for (uint32_t i = 1; i < count; i++){
+                uint32_t head = get_varint(&packet[3], &at);
+                bat = (uint16_t) (bat + unzigzag(head >> 1));
+                if (head & 1){
+                    get_varint(&packet[3], &at);
+                }
+                check_sample(&stream, first + i, bat);
+            }
+            CHECK(at == out - 5);
+            number = first + count - 1;
+            stream.short_batches += (last_count != 0 && last_count < BATCH);
+            last_count = count;
+        }
+        sequence = packet_sequence;
+    }
+    CHECK(started && stream.samples > 0);
+    return stream;
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+    CHECK(uart_baud == 9600);
+    sim_batmon(batmon_ramp, 0);
+
+    sim_uart_send_line("moni bin 10");
+    CHECK(sim_wait_for("Temperature and Battery monitor mode on\r\n", 500));
+    sim_run_ms(10000);
+    sim_uart_send_line("stop moni");
+    CHECK(sim_wait_for("error counters\r\n", 5000));
+    CHECK(sim_run_until(uart_tx_idle, 5000)); // the menu takes a while at 9600
+
+    // the line fits 5 samples in 6 or so, the ones in between were skipped and the numbers say so, a late one goes out as a batch of one
+    stream_t bin = decode();
+    CHECK(bin.samples < bin.number && bin.number >= 10000 / PERIOD_MS - 10);
+    printf("9600 baud, moni bin %d: %u samples in %u periods, decoded times %.1f ms off the virtual clock at most\n",
+           PERIOD_MS, bin.samples, bin.number, bin.worst_ms);
+
+    // batches keep up with the line, until something else fills the TX buffer and the PC stops taking bytes for a bit
+    sim_uart_send_line("flow on");
+    CHECK(sim_wait_for("Hardware flow control on (RTS/CTS)\r\n", 1000));
+    sim_uart_host_flow(true, 3);
+    sim_tx_clear();
+    sim_uart_send_line("moni batch 8 10");
+    CHECK(sim_wait_for("Temperature and Battery monitor mode on\r\n", 500));
+    for (int i = 0; i < HOLDS; i++){
+        sim_run_ms(1000);
+        CHECK(sim_run_until(batch_half, 1000));
+        sim_uart_host_ready(false);
+        while (uart_tx_room(TASK_LINE_MAX)){
+            uart_write("-", 1);
+        }
+        sim_run_ms(HOLD_MS);
+        sim_uart_host_ready(true);
+    }
+    sim_run_ms(1000);
+    sim_uart_send_line("stop moni");
+    CHECK(sim_wait_for("error counters\r\n", 5000));
+    CHECK(sim_run_until(uart_tx_idle, 5000));
+    sim_uart_send_line("flow off");
+    CHECK(sim_wait_for("Hardware flow control off\r\n", 1000));
+    sim_uart_host_flow(false, 0);
+
+    stream_t batch = decode();
+    CHECK(batch.short_batches == HOLDS && batch.samples < batch.number);
+    printf("9600 baud, moni batch %d %d, held up %d times: %u samples in %u periods, %u batches cut short, decoded times %.1f ms off at most\n",
+           BATCH, PERIOD_MS, HOLDS, batch.samples, batch.number, batch.short_batches, batch.worst_ms);
+
+    printf("test_moni_time: ok\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+// UART over timer priority: RX bursts at the fastest rate while every GPT0 interrupt is stretched to a millisecond of work
+// with setup_Priorities() the UART interrupt cuts into the long timer handler and no byte is lost, with both at the same level it
+// waits behind it and the FIFO overruns; the NVIC latency and the stack nesting costs come out of the same runs
+#include "firmware.h"
+#include "check.h"
+
+#define BURST_BYTES 16384
+#define TIMER_STRETCH_CYCLES (SIM_CLOCK_HZ / 1000)
+
+static bool burst_done(void){
+    return sim_uart_send_pending() == 0;
+}
+
+typedef struct {
+    uint64_t overruns;
+    uint32_t received;
+    sim_isr_stats_t uart;
+    uint32_t timer_calls;
+    uint32_t stack;
+} burst_t;
+
+// one endless line during "moni 10", so the timer interrupt comes every 10 ms, then enter to get rid of it
+static burst_t burst(void){
+    static char data[BURST_BYTES];
+    memset(data, 'x', sizeof(data));
+    uint64_t overruns = sim_uart_stats.rx_overruns;
+    uint32_t bytes = uart_rx_bytes;
+    sim_uart_isr = sim_timer_isr = (sim_isr_stats_t) {0};
+    sim_stack_mark();
+
+    sim_uart_send(data, sizeof(data));
+    CHECK(sim_run_until(burst_done, 1000));
+    sim_run_ms(1);
+
+    burst_t result = {sim_uart_stats.rx_overruns - overruns, uart_rx_bytes - bytes, sim_uart_isr, sim_timer_isr.calls, sim_stack_used()};
+    sim_uart_send("\r", 1);
+    CHECK(sim_wait_for("too long", 100));
+    return result;
+}
+
+static void print_burst(const char *name, const burst_t *result){
+    printf("%-22s %5llu bytes lost, %u GPT0 interrupts, UART interrupt latency %5u cycles max, %3u nested, stack %u bytes\n", name,
+           (unsigned long long) result->overruns, result->timer_calls, result->uart.max_latency_cycles, result->uart.nested,
+           result->stack);
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    uint32_t fastest = 0;
+    for (int i = 0; i < UART_BAUD_RATE_COUNT; i++){
+        fastest = (uart_baud_rates[i] > fastest) ? uart_baud_rates[i] : fastest;
+    }
+    char line[32];
+    snprintf(line, sizeof(line), "baud %u", fastest);
+    sim_uart_send_line(line);
+    CHECK(sim_wait_for("send any command to keep it\r\n", 1000));
+    sim_uart_host_baud(fastest);
+    sim_uart_send_line("moni 10");
+    CHECK(sim_wait_for("v\n\r", 1000));
+    sim_isr_stretch(INT_GPT0A, TIMER_STRETCH_CYCLES);
+    sim_run_ms(100);
+
+    // as the firmware sets them up: the UART cuts in, waits a few cycles at most, and takes an interrupt frame on top of the timer's
+    burst_t priority = burst();
+    print_burst("UART above GPT0", &priority);
+    CHECK(priority.overruns == 0 && priority.received == BURST_BYTES);
+    CHECK(priority.timer_calls >= 4 && priority.uart.nested > 0);
+    CHECK(priority.uart.max_latency_cycles < TIMER_STRETCH_CYCLES / 20);
+
+    // the same level for both: nothing nests, the UART waits out the whole millisecond, and the uDMA halves and the FIFO fill up meanwhile
+    IntPrioritySet(INT_UART0_COMB, PRIORITY_TIMER);
+    burst_t flat = burst();
+    print_burst("UART level with GPT0", &flat);
+    CHECK(flat.overruns > 0 && flat.received + flat.overruns == BURST_BYTES);
+    CHECK(flat.uart.nested == 0);
+    CHECK(flat.uart.max_latency_cycles > TIMER_STRETCH_CYCLES * 9 / 10);
+    CHECK(priority.stack > flat.stack);
+    printf("nesting costs %u bytes of stack here (x86 frames)\n", priority.stack - flat.stack);
+
+    IntPrioritySet(INT_UART0_COMB, PRIORITY_UART);
+    sim_isr_stretch(INT_GPT0A, 0);
+    sim_uart_send_line("stop");
+    sim_run_ms(100);
+
+    printf("test_priority: ok\n");
+    return 0;
+}
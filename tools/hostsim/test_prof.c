@@ -0,0 +1,35 @@
+// the (prof) report is bigger than the TX buffer, at 9600 baud all of it still has to arrive
+#include "firmware.h"
+#include "check.h"
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    // some of everything first, so no line is short because its numbers are 0
+    sim_uart_send_line("moni 100");
+    sim_uart_send_line("trng 200");
+    sim_run_ms(3000);
+    sim_uart_send_line("stop");
+    CHECK(sim_wait_for("Operation stopped", 1000));
+    sim_run_ms(1000);
+
+    uint32_t dropped = uart_tx_dropped;
+    sim_tx_clear();
+    sim_uart_send_line("prof");
+    CHECK(sim_wait_for("\r\ndrbg reseeds ", 5000)); // the last line
+    CHECK(sim_run_until(uart_tx_idle, 1000));
+
+    const char *report = strstr(sim_tx_data(), "uart isr ");
+    CHECK(report != NULL);
+    printf("%s", report);
+    CHECK(sim_tx_count(" cycles\r\n") == PROF_LINES + COMMAND_COUNT + 1);
+    CHECK(sim_tx_contains("\r\ntx deferred "));
+    CHECK(sim_tx_contains("\r\nstack used "));
+    CHECK(sim_tx_contains("\r\ndrbg reseeds "));
+    CHECK(uart_tx_dropped == dropped);
+    CHECK(!tasks[TASK_PROF].running);
+
+    printf("test_prof: ok, %zu bytes at 9600 baud\n", strlen(report));
+    return 0;
+}
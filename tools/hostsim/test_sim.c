@@ -0,0 +1,40 @@
+// the simulator itself: the firmware boots, prints its menu at 9600, echoes what it's sent and sleeps in between
+#include "firmware.h"
+
+#include "check.h"
+
+int main(void){
+    sim_boot(firmware_main);
+
+    // the menu is the first thing out
+    CHECK(sim_wait_for("(stat) - shows the UART rate and its error counters\r\n", 2000));
+    CHECK(strncmp(sim_tx_data(), "Menu for", 8) == 0);
+    // 10 bits per character at 9600 baud
+    size_t length = sim_tx_length();
+    uint64_t span = sim_tx_time(length - 1) - sim_tx_time(0);
+    CHECK(span / (length - 1) == (48000000 * 10 + 4800) / 9600);
+    // "echo on\r" is 8 bytes, a multiple of the 4 byte RX FIFO level: the receive timeout still has to hand over the end of the line
+    sim_tx_clear();
+    sim_uart_send_line("echo on");
+    CHECK(sim_wait_for("Echo mode on\r\n", 200));
+    // with echo on every character comes back
+    sim_tx_clear();
+    sim_uart_send_line("stat");
+    CHECK(sim_wait_for("stat", 200));
+    CHECK(sim_wait_for("uart 9600", 500));
+
+    // the UART interrupt took the characters, nothing runs so GPT0 never had a reason to fire
+    CHECK(sim_timer_isr.calls == 0);
+    CHECK(sim_uart_isr.calls > 0);
+    CHECK(sim_uart_stats.rx_overruns == 0 && sim_uart_stats.rx_framing == 0);
+
+    // an idle board sleeps: once the TRNG pool is full there's nothing to do but wait for input
+    sim_run_ms(100);
+    uint64_t awake = sim_awake_cycles();
+    sim_run_ms(10000);
+    CHECK(sim_awake_cycles() - awake < SIM_MS(10000) / 100);
+
+    printf("test_sim: ok, %llu blocks, awake %.3f%% of %.1f s\n", (unsigned long long) sim_blocks(),
+           100.0 * sim_awake_cycles() / sim_cycles(), sim_cycles() / 48e6);
+    return 0;
+}
@@ -0,0 +1,94 @@
+// the software timer heap with hundreds of timers on GPT0: they expire in deadline order, on time, a stopped one never does,
+// and the GPT0 interrupt only grows with the log of how many are running
+#define SW_TIMER_MAX 512
+#include "firmware.h"
+#include "check.h"
+
+#define MANY 400
+#define FEW 8
+#define DELAY_MAX_MS 2000
+
+static sw_timer_t timers[MANY];
+static uint32_t fired[MANY]; // the GPT0 count each one expired at, 0 if it didn't
+static uint32_t order[MANY]; // which one expired, in the order they did
+static uint32_t order_count;
+
+static void expired(sw_timer_t *timer){
+    uint32_t i = (uint32_t) (timer - timers);
+    fired[i] = sw_timer_now();
+    order[order_count++] = i;
+}
+
+// xorshift32, so every run arms the same deadlines
+static uint32_t state = 2463534242u;
+static uint32_t next_random(void){
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// arm count one shots at random deadlines, stop every 4th one again, and run until they're all due
+// returns the GPT0 interrupt's cycles per expired timer, and the cycles of one sw_timer_start(), on average
+static uint64_t run(uint32_t count, uint64_t *start_cycles){
+    memset(fired, 0, sizeof(fired));
+    order_count = 0;
+    uint16_t running = sw_timer_count;
+
+    sim_measure_start();
+    for (uint32_t i = 0; i < count; i++){
+        timers[i].callback = expired;
+        timers[i].index = -1;
+        CHECK(sw_timer_start(&timers[i], 1 + next_random() % DELAY_MAX_MS, 0));
+    }
+    *start_cycles = sim_measure_cycles() / count;
+    CHECK(sw_timer_count == running + count);
+    for (uint32_t i = 0; i < count; i += 4){
+        sw_timer_stop(&timers[i]);
+    }
+
+    sim_timer_isr = (sim_isr_stats_t) {0};
+    sim_run_ms(DELAY_MAX_MS + 10);
+    CHECK(sw_timer_count == running);
+
+    // every running one expired once, not before its deadline and within 100 us of it, the stopped ones never did
+    CHECK(order_count == count - (count + 3) / 4);
+    for (uint32_t i = 0; i < count; i++){
+        if (i % 4 == 0){
+            CHECK(fired[i] == 0);
+            continue;
+        }
+        CHECK(fired[i] != 0);
+        uint32_t late = fired[i] - timers[i].deadline;
+        CHECK((int32_t) late >= 0 && late < MS_TO_TICKS(1) / 10);
+    }
+    // in deadline order, equal deadlines in any order
+    for (uint32_t i = 1; i < order_count; i++){
+        CHECK((int32_t) (timers[order[i]].deadline - timers[order[i - 1]].deadline) >= 0);
+    }
+    printf("%3u timers: sw_timer_start %4llu cycles, GPT0 interrupt %4llu cycles per timer, %3u calls %4u max\n", count,
+           (unsigned long long) *start_cycles, (unsigned long long) (sim_timer_isr.cycles / order_count), sim_timer_isr.calls,
+           sim_timer_isr.max_cycles);
+    return sim_timer_isr.cycles / order_count;
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    uint64_t few_start, many_start;
+    uint64_t few_isr = run(FEW, &few_start);
+    uint64_t many_isr = run(MANY, &many_start);
+
+    // 50 times the timers, the heap is 6 levels deeper: a few sift steps more per expiry, not 50 times the work
+    CHECK(many_isr < 2 * few_isr);
+    CHECK(many_start < 2 * few_start);
+
+    // the firmware goes on as before
+    sim_tx_clear();
+    sim_uart_send_line("stat");
+    CHECK(sim_wait_for("uart 9600", 500));
+
+    printf("test_sw_timer: ok\n");
+    return 0;
+}
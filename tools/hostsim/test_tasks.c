@@ -0,0 +1,98 @@
+// the blinker, "moni 100" and "trng 5000" at once on the one GPT0: for 20 s every monitor line comes 100 ms after the last,
+// every random number 5 s after the last, and the LEDs keep pattern 1's steps to the ms, none of them held up by the others
+#include <math.h>
+
+#include "firmware.h"
+#include "check.h"
+
+#define RUN_MS 20000
+#define SAMPLE_CYCLES (SIM_CLOCK_HZ / 10000)
+#define JITTER_MS 20 // a line can wait behind one of the other task's in the TX ring, at 9600 baud that's ~13 ms
+#define LINES_MAX 512
+
+// when each line of a kind finished going out, from "start" on: a monitor line ends in "v\n\r", a random number is only digits
+static int line_times(size_t start, bool moni, uint64_t *times){
+    const char *data = sim_tx_data();
+    size_t length = sim_tx_length(), begin = start;
+    int count = 0;
+    for (size_t i = start; i < length && count < LINES_MAX; i++){
+        if (data[i] != '\n'){
+            continue;
+        }
+        bool digits = i > begin;
+        for (size_t j = begin; j < i; j++){
+            digits = digits && data[j] >= '0' && data[j] <= '9';
+        }
+        bool is_moni = i > begin && data[i - 1] == 'v';
+        if (moni ? is_moni : digits){
+            times[count++] = sim_tx_time(i);
+        }
+        begin = i + 2; // past "\n\r"
+    }
+    return count;
+}
+
+// every gap is the period give or take the TX ring, and over the whole run there's no drift at all
+static void check_cadence(const char *name, const uint64_t *times, int count, uint32_t period_ms){
+    double worst = 0;
+    for (int i = 1; i < count; i++){
+        double gap = (times[i] - times[i - 1]) / (double) SIM_MS(1);
+        CHECK(gap > period_ms - JITTER_MS && gap < period_ms + JITTER_MS);
+        worst = (fabs(gap - period_ms) > worst) ? fabs(gap - period_ms) : worst;
+    }
+    double average = (times[count - 1] - times[0]) / (double) SIM_MS(1) / (count - 1);
+    CHECK(fabs(average - period_ms) * (count - 1) < JITTER_MS);
+    printf("%-6s %3d lines, every %8.3f ms on average, %.1f ms off at most\n", name, count, average, worst);
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    sim_uart_send_line("leds");
+    CHECK(sim_wait_for("LED blinker mode on\r\n", 500));
+    sim_uart_send_line("moni 100");
+    CHECK(sim_wait_for("v\n\r", 500));
+    sim_uart_send_line("trng 5000");
+    sim_run_ms(1000);
+    CHECK(tasks[TASK_LEDS].running && tasks[TASK_MONI].running && tasks[TASK_TRNG].running);
+
+    // the LEDs, sampled every 100 us while the other two print
+    size_t start = sim_tx_length();
+    uint32_t dout = sim_gpio_dout();
+    uint64_t since = 0;
+    int steps = 0, step = -1;
+    const int length = sizeof(led_steps_cycle)/sizeof(led_steps_cycle[0]);
+    for (uint64_t end = sim_cycles() + SIM_MS(RUN_MS); sim_cycles() < end;){
+        sim_run(SAMPLE_CYCLES);
+        if (sim_gpio_dout() == dout){
+            continue;
+        }
+        if (since != 0){
+            // which step that was, the first complete one fixes where in the pattern we are
+            uint32_t held = (uint32_t) ((sim_cycles() - since + SIM_MS(1) / 2) / SIM_MS(1));
+            for (int i = 0; i < length && step < 0; i++){
+                step = (led_steps_cycle[i].dout == dout && led_steps_cycle[i].duration_ms == held) ? i : -1;
+            }
+            CHECK(step >= 0 && led_steps_cycle[step].dout == dout && led_steps_cycle[step].duration_ms == held);
+            step = (step + 1) % length;
+            steps++;
+        }
+        dout = sim_gpio_dout();
+        since = sim_cycles();
+    }
+    printf("leds   %3d steps, each held to the ms\n", steps);
+    CHECK(steps >= RUN_MS / 1400 * 2 - 2);
+
+    static uint64_t times[LINES_MAX];
+    int count = line_times(start, true, times);
+    CHECK(count >= RUN_MS / 100 - 2);
+    check_cadence("moni", times, count, 100);
+    count = line_times(start, false, times);
+    CHECK(count == RUN_MS / 5000);
+    check_cadence("trng", times, count, 5000);
+    CHECK(uart_tx_dropped == 0);
+
+    printf("test_tasks: ok\n");
+    return 0;
+}
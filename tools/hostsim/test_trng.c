@@ -0,0 +1,149 @@
+// the TRNG: nothing is calibrated at startup, the pool just fills at the default setting, the first trng command gets its number
+// from there right away and starts the sweep behind it, which keeps the fastest setting that passes and doesn't run again
+// then a broken noise source: all zeros trips the repetition count test and nothing gets into the pool, the same number over and
+// over trips the adaptive proportion test, and a sweep with the source broken (or giving nothing at all) stays at the default setting
+#include "firmware.h"
+#include "check.h"
+
+static bool calibrated(void){
+    return !tasks[TASK_CAL].running;
+}
+
+static bool raw_done(void){
+    return !tasks[TASK_RAW].running;
+}
+
+// "trng cal" to the end, every setting's line has to say how many failures it saw
+static void sweep(void){
+    CHECK(sim_run_until(uart_tx_idle, 10000));
+    sim_tx_clear();
+    sim_uart_send_line("trng cal");
+    CHECK(sim_wait_for("TRNG calibration", 100));
+    CHECK(sim_run_until(calibrated, TRNG_SETTING_COUNT * (TRNG_CAL_WINDOW_MS + 100)));
+    CHECK(sim_wait_for("off now", 500));
+    CHECK(sim_tx_count("/s failures ") == TRNG_SETTING_COUNT);
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    // startup: no sweep, the default setting fills the pool and the TRNG goes quiet
+    CHECK(!tasks[TASK_CAL].running && !trng_calibrating && !trng_cal_done);
+    sim_run_ms(100);
+    CHECK(trng_pool_count() == TRNG_POOL_SIZE && trng_setting == TRNG_SETTING_DEFAULT);
+    uint32_t numbers = trng_numbers;
+    sim_run_ms(1000);
+    CHECK(trng_numbers == numbers);
+
+    // the health tests see the bytes in the order "trng raw" sends them, low word first, each low byte first: these two words
+    // put 0x11 on the line 6 times in a row, byte by byte from both words in turn it would only be 5 at a time
+    trng_rct_count = 0;
+    uint32_t rct = trng_rct_failures;
+    CHECK(!trng_health_number(0x11111111, 0x22331111) && trng_rct_failures == rct + 1);
+    trng_rct_count = 0;
+    CHECK(trng_health_number(0x11111111, 0x22113311));
+
+    // the first trng command: its first number comes out of the full pool, the sweep runs behind it and the numbers keep coming
+    sim_tx_clear();
+    uint64_t sent = sim_cycles();
+    sim_uart_send_line("trng");
+    CHECK(sim_wait_for("\n\r", 100));
+    double first_ms = (sim_cycles() - sent) / (double) SIM_MS(1);
+    CHECK(tasks[TASK_CAL].running && trng_calibrating);
+    CHECK(sim_run_until(calibrated, TRNG_SETTING_COUNT * (TRNG_CAL_WINDOW_MS + 100)));
+    double sweep_ms = (sim_cycles() - sent) / (double) SIM_MS(1);
+    CHECK(trng_cal_done && trng_setting == 0); // nothing fails in the model, the fastest one wins
+    sim_run_ms(2000);
+    CHECK(!sim_tx_contains("Not enough entropy") && sim_tx_count("\n\r") >= 5);
+    printf("first trng command: first number after %.1f ms, sweep done after %.0f ms, no number missed\n", first_ms, sweep_ms);
+
+    // once is enough
+    sim_uart_send_line("stop");
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+    sim_uart_send_line("trng raw 64");
+    sim_run_ms(100);
+    CHECK(!tasks[TASK_CAL].running);
+
+    // a raw stream while a sweep runs doesn't wait for it, the numbers that pass keep filling the pool whatever setting is measured:
+    // the bytes follow each other on the line as fast as 9600 baud goes all the way through
+    CHECK(sim_run_until(uart_tx_idle, 2000));
+    sim_uart_send_line("trng cal");
+    CHECK(sim_wait_for("TRNG calibration", 100));
+    sim_tx_clear();
+    sim_uart_send_line("trng raw 4096");
+    sim_run_ms(100);
+    CHECK(tasks[TASK_RAW].running && tasks[TASK_CAL].running);
+    CHECK(sim_run_until(raw_done, 10000) && sim_run_until(uart_tx_idle, 1000));
+    CHECK(!tasks[TASK_CAL].running); // 4096 bytes are 4.3 s at 9600, the sweep was over before the stream
+    double gap_ms = 0;
+    for (size_t i = 1; i < sim_tx_length(); i++){
+        double gap = (sim_tx_time(i) - sim_tx_time(i - 1)) / (double) SIM_MS(1);
+        gap_ms = (gap > gap_ms) ? gap : gap_ms;
+    }
+    CHECK(sim_tx_length() >= 4096 && gap_ms < 1.1); // a character is 1.04 ms
+    CHECK(trng_setting == 0);
+    printf("trng raw 4096 during a sweep: %.2f ms between two bytes at most\n", gap_ms);
+
+    // a sweep of its own can be stopped, by name or with everything else, and the TRNG goes back to the setting it had
+    sim_uart_send_line("trng cal");
+    sim_run_ms(TRNG_CAL_WINDOW_MS + 200);
+    CHECK(tasks[TASK_CAL].running && task_modes() == MODE_CAL);
+    sim_tx_clear();
+    sim_uart_send_line("stop");
+    CHECK(sim_wait_for("Operation stopped", 100));
+    CHECK(!tasks[TASK_CAL].running && !trng_calibrating && trng_setting == 0);
+    CHECK(sim_wait_for("error counters\r\n", 2000)); // and the menu, nothing runs
+
+    // stuck at zero: every number fails, the pool runs dry and the stream waits
+    uint32_t apt;
+    rct = trng_rct_failures;
+    numbers = trng_numbers;
+    sim_trng_fault(SIM_TRNG_STUCK);
+    sim_uart_send_line("trng raw 1024");
+    sim_run_ms(500);
+    uint32_t stuck_numbers = trng_numbers - numbers, stuck_failures = trng_rct_failures - rct;
+    // the number that was waiting was made before it broke, and the first 5 zeros are a run the test allows, every byte after fails
+    CHECK(stuck_numbers > 100 && stuck_failures == 8 * (stuck_numbers - 1) - (TRNG_RCT_CUTOFF - 1));
+    CHECK(trng_pool_count() == 0 && tasks[TASK_RAW].running);
+    // fixed, the stream finishes
+    sim_trng_fault(SIM_TRNG_OK);
+    CHECK(sim_run_until(raw_done, 500));
+    CHECK(sim_run_until(uart_tx_idle, 2000)); // commands wait while the TX buffer is full
+
+    // the same number over and over: only the first byte of each 512 byte window counts, it fails at its 62nd time
+    rct = trng_rct_failures;
+    apt = trng_apt_failures;
+    numbers = trng_numbers;
+    sim_trng_fault(SIM_TRNG_REPEAT);
+    sim_uart_send_line("trng raw 4096");
+    sim_run_ms(100);
+    CHECK(sim_run_until(raw_done, 5000));
+    uint32_t repeat_numbers = trng_numbers - numbers, repeat_failures = trng_apt_failures - apt;
+    CHECK(trng_rct_failures == rct);
+    CHECK(repeat_failures >= repeat_numbers / (TRNG_APT_WINDOW / 8) - 1 && repeat_failures > 0);
+    sim_trng_fault(SIM_TRNG_OK);
+    printf("stuck at zero: %u repetition count failures in %u numbers, repeating: %u adaptive proportion failures in %u numbers\n",
+           stuck_failures, stuck_numbers, repeat_failures, repeat_numbers);
+
+    // a sweep while it's broken finds nothing that passes and keeps the default, once it works again the fastest one is back
+    sim_trng_fault(SIM_TRNG_STUCK);
+    sweep();
+    CHECK(sim_tx_count("/s failures 0\r\n") == 0 && trng_setting == TRNG_SETTING_DEFAULT);
+    // no numbers at all: every setting gives up after a window, the sweep still ends and keeps the default
+    sim_trng_fault(SIM_TRNG_SILENT);
+    CHECK(sim_run_until(uart_tx_idle, 10000));
+    sim_tx_clear();
+    sim_uart_send_line("trng cal");
+    CHECK(sim_wait_for("TRNG calibration", 100));
+    CHECK(sim_run_until(calibrated, TRNG_SETTING_COUNT * (TRNG_CAL_WINDOW_MS + 100)));
+    CHECK(sim_wait_for("off now", 500));
+    CHECK(sim_tx_count(" no numbers\r\n") == TRNG_SETTING_COUNT && sim_tx_count("/s failures ") == 0);
+    CHECK(!trng_calibrating && trng_setting == TRNG_SETTING_DEFAULT);
+    sim_trng_fault(SIM_TRNG_OK);
+    sweep();
+    CHECK(sim_tx_count("/s failures 0\r\n") == TRNG_SETTING_COUNT && trng_setting == 0);
+
+    printf("test_trng: ok\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+// uDMA ping-pong receive at the highest rate setup_UART can switch to: 64 KB without a pause lose no byte, and the CPU only wakes up
+// once per 32 byte half instead of every 4 bytes, then the overrun case: with the uDMA held off the FIFO overflows and it's counted
+#include "firmware.h"
+#include "check.h"
+
+#define STREAM_BYTES 65536
+
+static bool stream_done(void){
+    return sim_uart_send_pending() == 0;
+}
+
+int main(void){
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+
+    uint32_t fastest = 0;
+    for (int i = 0; i < UART_BAUD_RATE_COUNT; i++){
+        fastest = (uart_baud_rates[i] > fastest) ? uart_baud_rates[i] : fastest;
+    }
+    char line[32];
+    snprintf(line, sizeof(line), "baud %u", fastest);
+    sim_uart_send_line(line);
+    CHECK(sim_wait_for("send any command to keep it\r\n", 1000));
+    sim_uart_host_baud(fastest);
+    sim_uart_send_line("stat");
+    CHECK(sim_wait_for(" baud flow off\r\n", 1000));
+    sim_run_ms(100);
+
+    // one endless line, too long for any command, the bytes still all have to get in
+    static char stream[STREAM_BYTES];
+    memset(stream, 'x', sizeof(stream));
+    uint32_t bytes = uart_rx_bytes;
+    sim_uart_isr = (sim_isr_stats_t) {0};
+    uint64_t awake = sim_awake_cycles(), start = sim_cycles();
+    sim_uart_send(stream, sizeof(stream));
+    CHECK(sim_run_until(stream_done, 5000));
+    sim_run_ms(10);
+    double seconds = (sim_cycles() - start) / 48e6;
+    printf("%u baud: %u bytes in %.1f ms, %llu overruns, RX FIFO at most %u, %u UART interrupts, %.1f%% awake\n", fastest,
+           uart_rx_bytes - bytes, seconds * 1000, (unsigned long long) sim_uart_stats.rx_overruns, sim_uart_stats.rx_fifo_max,
+           sim_uart_isr.calls, 100.0 * (sim_awake_cycles() - awake) / (sim_cycles() - start));
+    CHECK(uart_rx_bytes - bytes == STREAM_BYTES);
+    CHECK(sim_uart_stats.rx_overruns == 0 && uart_rx_overruns == 0);
+    CHECK(sim_uart_isr.calls <= STREAM_BYTES / 32 + 16); // a 4 byte RX interrupt would be 16384 of them
+    sim_uart_send("\r", 1);
+    CHECK(sim_wait_for("too long", 100));
+
+    // nobody takes the bytes: with the uDMA requests masked only the receive timeout could empty the FIFO, and a stream never pauses for it
+    uDMAChannelAttributeEnable(UDMA0_BASE, UDMA_CHAN_UART0_RX, UDMA_ATTR_REQMASK);
+    sim_uart_send(stream, 256);
+    CHECK(sim_run_until(stream_done, 1000));
+    sim_run_ms(1);
+    uDMAChannelAttributeDisable(UDMA0_BASE, UDMA_CHAN_UART0_RX, UDMA_ATTR_REQMASK);
+    sim_uart_send("\r", 1);
+    sim_run_ms(10);
+    printf("uDMA held off for 256 bytes: %llu bytes lost, %u overrun interrupts counted\n",
+           (unsigned long long) sim_uart_stats.rx_overruns, uart_rx_overruns);
+    CHECK(sim_uart_stats.rx_overruns == 256 - 32);
+    CHECK(uart_rx_overruns > 0 && uart_rx_overruns <= sim_uart_stats.rx_overruns);
+    sim_tx_clear();
+    sim_uart_send_line("stat");
+    CHECK(sim_wait_for("rx errors overrun ", 100));
+    CHECK(sim_wait_for("tx dropped ", 100));
+    CHECK(!sim_tx_contains("rx errors overrun 0 "));
+
+    printf("test_uart_rx: ok\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+// the TX ring buffer: a write costs a copy however long the message is, and the TX interrupt moves at most a FIFO's worth per call,
+// so neither the writer nor the interrupt takes longer for a longer message (the baseline spun on UARTCharPut for every byte, see "make compare")
+#include "firmware.h"
+#include "check.h"
+
+static char text[UART_TX_BUFFER_SIZE];
+
+// the cycles of writing "length" bytes in one uart_write() (or a uart_put_char() each, like uart_put_string() used to),
+// then the TX interrupt's while it all goes out
+static uint64_t write_cycles(uint32_t length, bool per_char, sim_isr_stats_t *isr){
+    CHECK(sim_run_until(uart_tx_idle, 5000));
+    sim_uart_isr = (sim_isr_stats_t) {0};
+    sim_tx_clear();
+
+    sim_measure_start();
+    if (per_char){
+        for (uint32_t i = 0; i < length; i++){
+            uart_put_char(text[i]);
+        }
+    }
+    else{
+        uart_write(text, length);
+    }
+    uint64_t cycles = sim_measure_cycles();
+
+    CHECK(sim_run_until(uart_tx_idle, 5000));
+    CHECK(sim_tx_length() == length && memcmp(sim_tx_data(), text, length) == 0);
+    *isr = sim_uart_isr;
+    return cycles;
+}
+
+int main(void){
+    for (size_t i = 0; i < sizeof(text); i++){
+        text[i] = (char) ('a' + i % 26);
+    }
+    sim_boot(firmware_main);
+    CHECK(sim_wait_for("error counters\r\n", 2000));
+    sim_uart_send_line("baud 115200");
+    CHECK(sim_wait_for("send any command to keep it\r\n", 1000));
+    sim_uart_host_baud(115200);
+    sim_uart_send_line("stat");
+    CHECK(sim_wait_for("uart 115200", 1000));
+
+    static const uint32_t lengths[] = {1, 16, 64, 256, 500};
+    uint64_t write[5];
+    sim_isr_stats_t isr[5];
+    for (int i = 0; i < 5; i++){
+        sim_isr_stats_t per_char_isr;
+        write[i] = write_cycles(lengths[i], false, &isr[i]);
+        uint64_t per_char = write_cycles(lengths[i], true, &per_char_isr);
+        printf("%3u bytes: uart_write %5llu cycles (a uart_put_char each %6llu), TX interrupt %3u calls %4llu avg %4u max\n",
+               lengths[i], (unsigned long long) write[i], (unsigned long long) per_char, isr[i].calls,
+               (unsigned long long) (isr[i].calls ? isr[i].cycles / isr[i].calls : 0), isr[i].max_cycles);
+        if (lengths[i] >= 64){
+            CHECK(write[i] * 5 < per_char);
+        }
+    }
+
+    // past the FIFO the write only grows by the copy, a cycle or two per byte
+    CHECK(write[4] - write[3] < 2 * (500 - 256));
+    // the longest TX interrupt is the same for 64 bytes and 500, only the number of them grows
+    CHECK(isr[4].max_cycles <= isr[2].max_cycles + isr[2].max_cycles / 10);
+    CHECK(isr[4].calls > isr[3].calls && isr[3].calls > isr[2].calls);
+    CHECK(uart_tx_dropped == 0);
+
+    printf("test_uart_tx: ok\n");
+    return 0;
+}
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""Decode the binary monitor packets the board sends after (moni bin).
+
+Reads a serial port (needs pyserial) or a file or pipe, for example:
+
+    python3 tools/moni_decode.py /dev/ttyACM0
+    python3 tools/moni_decode.py capture.bin --csv samples.csv
+    cat /dev/ttyACM0 | python3 tools/moni_decode.py -
+
+Every packet is COBS framed and ends with a 0x00. Once decoded it is
+sequence (2 bytes), type (1 byte), payload, then CRC-16/CCITT (init
+0xFFFF, high byte first) over everything before it. All fields are
+little endian. The text the board prints (like the mode message) fails
+the CRC and is skipped.
+"""
+
+import argparse
+import struct
+import sys
+
+PACKET_START = 1
+PACKET_SAMPLE = 2
+PACKET_BATCH = 3
+PACKET_CHANGE = 4
+TEXT_BYTES = 11  # "25c 3.28v\n\r", what (moni txt) sends per sample
+
+
+def crc16_ccitt(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def read_varint(data, at):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[at]
+        at += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, at
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame) + 1:
+            return None
+        out += frame[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def frames(stream):
+    """Yield every 0x00 delimited frame, the first one is dropped since we may have started in the middle of it."""
+    buffer = bytearray()
+    first = True
+    while True:
+        if hasattr(stream, "in_waiting"):
+            chunk = stream.read(stream.in_waiting or 1)  # a serial port: what's there, or wait for the next byte
+        else:
+            chunk = stream.read1(4096)  # a file or pipe: what's there, without waiting for the rest of the 4096
+        if not chunk:
+            return
+        buffer += chunk
+        while True:
+            end = buffer.find(b"\x00")
+            if end < 0:
+                break
+            frame = bytes(buffer[:end])
+            del buffer[:end + 1]
+            if first:
+                first = False
+                continue
+            if frame:
+                yield frame
+
+
+class Decoder:
+    def __init__(self):
+        self.period_ms = None
+        self.number = None  # number of the last sample since the start packet
+        self.number_sequence = None  # and the unwrapped sequence of the packet it came in
+        self.sequence = None  # last sequence number, unwrapped
+        self.bad = 0
+        self.lost = 0
+        self.samples = 0
+        self.frame_bytes = 0
+
+    def unwrap(self, sequence):
+        if self.sequence is None:
+            return sequence
+        step = (sequence - self.sequence) & 0xFFFF
+        return self.sequence + step
+
+    def packet(self, frame):
+        """Decode one frame, return a list of (time in s or None, sequence, temperature in C, volts) samples."""
+        data = cobs_decode(frame)
+        if data is None or len(data) < 5 or crc16_ccitt(data[:-2]) != struct.unpack(">H", data[-2:])[0]:
+            self.bad += 1
+            return []
+        self.frame_bytes += len(frame) + 1
+
+        sequence, kind = struct.unpack_from("<HB", data)
+        sequence = self.unwrap(sequence)
+        if self.sequence is not None and sequence != self.sequence + 1:
+            self.lost += sequence - self.sequence - 1
+        self.sequence = sequence
+        payload = data[3:-2]
+
+        if kind == PACKET_START:
+            (self.period_ms,) = struct.unpack("<I", payload)
+            self.number, self.number_sequence = 0, sequence
+            return []
+        if kind == PACKET_SAMPLE:
+            # one period after the sample before it, every packet in between (lost ones too) was a sample as well
+            temperature, bat = struct.unpack("<hH", payload)
+            number = None
+            if self.number is not None:
+                number = self.number + sequence - self.number_sequence
+                self.number, self.number_sequence = number, sequence
+            return [self.sample(sequence, number, temperature, bat)]
+        if kind == PACKET_BATCH:
+            return self.batch(sequence, payload)
+        if kind == PACKET_CHANGE:
+            # (moni change): the poll it was found at, degrees C and the averaged voltage in Q12
+            number, temperature, bat = struct.unpack("<IhH", payload)
+            self.number, self.number_sequence = number, sequence
+            time, sequence, temperature, _ = self.sample(sequence, number, temperature, 0)
+            return [(time, sequence, temperature, bat / 4096.0)]
+        return []
+
+    def batch(self, sequence, payload):
+        """A keyframe and the changes from one sample to the next, see MONI_PACKET_BATCH in main.c.
+        A batch of one also stands in for a sample packet that came late, its number puts the samples after it back in place."""
+        first, count, temperature, bat = struct.unpack_from("<IBhH", payload)
+        self.number, self.number_sequence = first + count - 1, sequence
+        samples = [self.sample(sequence, first, temperature, bat)]
+        at = 9
+        for i in range(1, count):
+            value, at = read_varint(payload, at)
+            bat = (bat + unzigzag(value >> 1)) & 0xFFFF
+            if value & 1:
+                change, at = read_varint(payload, at)
+                temperature += unzigzag(change)
+            samples.append(self.sample(sequence, first + i, temperature, bat))
+        return samples
+
+    def sample(self, sequence, number, temperature, bat):
+        """Sample number since the start packet (the first one is 1, taken with it), it was taken number - 1 periods after it."""
+        time = None
+        if number is not None and self.period_ms is not None:
+            time = (number - 1) * self.period_ms / 1000.0
+        self.samples += 1
+        return (time, sequence, temperature, bat / 256.0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="serial device, file, or - for stdin")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--csv", help="write the samples to this CSV file instead of printing them")
+    args = parser.parse_args()
+
+    if args.source == "-":
+        stream = sys.stdin.buffer
+    elif args.source.startswith("/dev/") or args.source.upper().startswith("COM"):
+        import serial
+        stream = serial.Serial(args.source, args.baud, timeout=None)
+    else:
+        stream = open(args.source, "rb")
+
+    out = open(args.csv, "w") if args.csv else sys.stdout
+    if args.csv:
+        out.write("time_s,sequence,temperature_c,battery_v\n")
+
+    decoder = Decoder()
+    try:
+        for frame in frames(stream):
+            for time, sequence, temperature, volts in decoder.packet(frame):
+                time_text = "" if time is None else "%.3f" % time
+                if args.csv:
+                    out.write("%s,%d,%d,%.5f\n" % (time_text, sequence, temperature, volts))
+                else:
+                    out.write("%8s  #%-6d %4dc %.4fv\n" % (time_text, sequence, temperature, volts))
+                out.flush()
+    except KeyboardInterrupt:
+        pass
+
+    per_sample = decoder.frame_bytes / decoder.samples if decoder.samples else 0
+    ratio = TEXT_BYTES / per_sample if per_sample else 0
+    sys.stderr.write("%d samples, %d lost packets, %d bad frames, %.2f bytes per sample (%.1fx smaller than text)\n"
+                     % (decoder.samples, decoder.lost, decoder.bad, per_sample, ratio))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""Send the board a burst of commands as fast as the port goes and check that none were lost.
+
+    python3 tools/uart_stress.py /dev/ttyACM0 --baud 3000000 --flow --lines 2000
+
+The board has to be at --baud already (use (baud N) first), and with --flow
+it needs (flow on) too. pyserial then waits for CTS before every byte. The
+board's (stat) counters are read before and after the burst. Every line has
+to arrive as a command, with no overruns and no framing errors.
+"""
+
+import argparse
+import re
+import sys
+import time
+
+import serial
+
+COUNTERS = {
+    "lines": r"rx bytes \d+ lines (\d+)",
+    "dropped": r"lines \d+ dropped (\d+)",
+    "overrun": r"overrun (\d+)",
+    "framing": r"framing (\d+)",
+    "tx dropped": r"tx dropped (\d+)",
+}
+
+
+def read_stat(port):
+    port.reset_input_buffer()
+    port.write(b"stat\r")
+    text = b""
+    deadline = time.time() + 2
+    while b"tx dropped" not in text or not text.endswith(b"\n"):
+        if time.time() > deadline:
+            sys.exit("no answer to (stat), is the board at this baud rate?")
+        text += port.read(port.in_waiting or 1)
+    text = text.decode("ascii", "replace")
+    return {name: int(re.search(pattern, text).group(1)) for name, pattern in COUNTERS.items()}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--flow", action="store_true", help="RTS/CTS flow control, the board needs (flow on)")
+    parser.add_argument("--lines", type=int, default=1000)
+    parser.add_argument("--command", default="echo off", help="what to send, it should answer with little text")
+    args = parser.parse_args()
+
+    port = serial.Serial(args.port, args.baud, rtscts=args.flow, timeout=0.1)
+    before = read_stat(port)
+
+    burst = (args.command + "\r").encode() * args.lines
+    start = time.time()
+    port.write(burst)
+    port.flush()
+    seconds = time.time() - start
+    time.sleep(0.5)  # let the board answer the last ones
+
+    after = read_stat(port)
+    change = {name: after[name] - before[name] for name in COUNTERS}
+    change["lines"] -= 1  # the (stat) that read them counted itself
+
+    print("%d bytes in %.2f s, %.0f bytes/s" % (len(burst), seconds, len(burst) / seconds))
+    for name in COUNTERS:
+        print("%-10s %d" % (name, change[name]))
+
+    lost = args.lines - change["lines"]
+    if lost or change["overrun"] or change["framing"]:
+        print("LOST %d lines" % lost)
+        sys.exit(1)
+    print("no loss")
+
+
+if __name__ == "__main__":
+    main()